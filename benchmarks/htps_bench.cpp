@@ -0,0 +1,413 @@
+/* Micro benchmarks for the search.
+ * Run all benchmarks with ./bench, or select some of them by name, e.g. ./bench parallel_selection
+ * The searches run against a synthetic, deterministic environment, so numbers are comparable between builds.
+ * */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+#include "../src/graph/htps.h"
+#include "../src/graph/scheduler.h"
+#include "../src/model/kernels.h"
+
+using namespace htps;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /* Expands theorems into a fixed number of tactics with one or two children each. Children are drawn from a
+     * bounded pool of goals, so the resulting graph shares nodes and contains cycles, just like real searches do.
+     * Everything is derived from the unique string of the goal, expanding the same goal twice gives the same result.
+     * */
+    class SyntheticEnv {
+    private:
+        size_t n_tactics;
+        size_t n_goals;
+        double solve_probability;
+        std::vector<std::shared_ptr<tactic>> tactics;
+
+    public:
+        SyntheticEnv(size_t n_tactics, size_t n_goals, double solve_probability) :
+                n_tactics(n_tactics), n_goals(n_goals), solve_probability(solve_probability) {
+            for (size_t i = 0; i < n_tactics; i++) {
+                auto tac = std::make_shared<tactic>();
+                tac->unique_string = "tac_" + std::to_string(i);
+                tac->is_valid = true;
+                tac->duration = 1 + i % 5;
+                tactics.push_back(tac);
+            }
+        }
+
+        static TheoremPointer goal(size_t id) {
+            return std::make_shared<theorem>("goal_" + std::to_string(id), std::vector<hypothesis>{});
+        }
+
+        std::shared_ptr<env_expansion> expand(const TheoremPointer &thm) const {
+            std::mt19937 rng(std::hash<std::string>{}(thm->unique_string));
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            bool solved = uniform(rng) < solve_probability;
+            std::vector<std::vector<TheoremPointer>> children_for_tactic;
+            std::vector<double> priors;
+            std::vector<std::shared_ptr<env_effect>> effects;
+            double prior_sum = 0;
+            for (size_t i = 0; i < n_tactics; i++) {
+                std::vector<TheoremPointer> children;
+                if (!solved) {
+                    size_t n_children = 1 + rng() % 2;
+                    size_t first_child = rng() % n_goals;
+                    children.push_back(goal(first_child));
+                    // Children of a tactic are distinct
+                    if (n_children > 1)
+                        children.push_back(goal((first_child + 1 + rng() % (n_goals - 1)) % n_goals));
+                }
+                auto effect = std::make_shared<env_effect>();
+                effect->goal = thm;
+                effect->tac = tactics[i];
+                effect->children = children;
+                effects.push_back(effect);
+                children_for_tactic.push_back(children);
+                priors.push_back(0.1 + uniform(rng));
+                prior_sum += priors.back();
+            }
+            for (auto &p: priors)
+                p /= prior_sum;
+            auto expansion = std::make_shared<env_expansion>();
+            expansion->thm = thm;
+            expansion->expander_duration = 1;
+            expansion->generation_duration = 1;
+            expansion->env_durations = std::vector<size_t>(n_tactics, 1);
+            expansion->effects = effects;
+            expansion->log_critic = solved ? 0.0 : std::log(0.05 + 0.9 * uniform(rng));
+            expansion->tactics = tactics;
+            expansion->children_for_tactic = children_for_tactic;
+            expansion->priors = priors;
+            return expansion;
+        }
+    };
+
+    htps_params default_params() {
+        htps_params params{};
+        params.exploration = 1.0;
+        params.policy_type = AlphaZero;
+        params.num_expansions = 2000;
+        params.succ_expansions = 32;
+        params.early_stopping = false;
+        params.backup_once = false;
+        params.backup_one_for_solved = true;
+        params.depth_penalty = 0.95;
+        params.count_threshold = 10;
+        params.tactic_init_value = 0.5;
+        params.q_value_solved = OneOverCounts;
+        params.policy_temperature = 0.0;
+        params.metric = SIZE;
+        params.node_mask = MinimalProof;
+        params.effect_subsampling_rate = 1.0;
+        params.critic_subsampling_rate = 1.0;
+        params.virtual_loss = 1;
+        params.num_threads = 1;
+        return params;
+    }
+
+    struct SearchTiming {
+        double selection_seconds = 0;
+        double backup_seconds = 0;
+        size_t batches = 0;
+        size_t expansions = 0;
+    };
+
+    SearchTiming run_search(const htps_params &params, const SyntheticEnv &env) {
+        TheoremPointer root = SyntheticEnv::goal(0);
+        HTPS search(root, params);
+        SearchTiming timing;
+        while (!search.is_done()) {
+            auto start = Clock::now();
+            auto theorems = search.theorems_to_expand();
+            timing.selection_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            if (theorems.empty())
+                break;
+            std::vector<std::shared_ptr<env_expansion>> expansions;
+            for (const auto &thm: theorems)
+                expansions.push_back(env.expand(thm));
+            start = Clock::now();
+            search.expand_and_backup(expansions);
+            timing.backup_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            timing.batches++;
+            timing.expansions += theorems.size();
+        }
+        return timing;
+    }
+
+    void bench_parallel_selection() {
+        std::printf("== parallel_selection: leaf selection time per batch by thread count ==\n");
+        std::printf("%8s %8s %14s %14s %10s\n", "threads", "batch", "select ms/batch", "descents/s", "speedup");
+        SyntheticEnv env(16, 5000, 0.02);
+        for (size_t batch: {32, 128}) {
+            double baseline = 0;
+            for (size_t threads: {1, 2, 4, 8}) {
+                auto params = default_params();
+                params.succ_expansions = batch;
+                params.num_threads = threads;
+                htps::seed = 0;
+                auto timing = run_search(params, env);
+                double per_batch = timing.selection_seconds / static_cast<double>(std::max<size_t>(1, timing.batches));
+                if (threads == 1)
+                    baseline = per_batch;
+                double descents = static_cast<double>(timing.batches * batch) / timing.selection_seconds;
+                std::printf("%8zu %8zu %14.3f %14.0f %9.2fx\n", threads, batch, per_batch * 1e3, descents,
+                            baseline / per_batch);
+            }
+        }
+    }
+
+    // Time of get_train_samples and get_proof_samples on a large finished search, by thread count
+    void bench_train_samples() {
+        std::printf("== train_samples: sample extraction of a search with 20000 expansions ==\n");
+        std::printf("%8s %10s %14s %10s\n", "threads", "samples", "extract ms", "speedup");
+        SyntheticEnv env(16, 50000, 0.02);
+        auto params = default_params();
+        params.num_expansions = 20000;
+        params.succ_expansions = 128;
+        params.node_mask = None;
+        params.count_threshold = 1;
+        params.effect_subsampling_rate = 0.5;
+        params.critic_subsampling_rate = 0.5;
+        htps::seed = 0;
+        TheoremPointer root = SyntheticEnv::goal(0);
+        HTPS search(root, params);
+        while (!search.is_done()) {
+            auto theorems = search.theorems_to_expand();
+            if (theorems.empty())
+                break;
+            std::vector<std::shared_ptr<env_expansion>> expansions;
+            for (const auto &thm: theorems)
+                expansions.push_back(env.expand(thm));
+            search.expand_and_backup(expansions);
+        }
+        double baseline = 0;
+        for (size_t threads: {1, 2, 4, 8}) {
+            params.num_threads = threads;
+            search.set_params(params);
+            const size_t repetitions = 5;
+            size_t samples = 0;
+            auto start = Clock::now();
+            for (size_t i = 0; i < repetitions; i++) {
+                std::vector<HTPSSampleEffect> effects;
+                std::vector<HTPSSampleCritic> critic;
+                std::vector<HTPSSampleTactics> tactics, proof_tactics;
+                search.get_train_samples(effects, critic, tactics);
+                search.get_proof_samples(proof_tactics);
+                samples = effects.size() + critic.size() + tactics.size() + proof_tactics.size();
+            }
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / repetitions;
+            if (threads == 1)
+                baseline = ms;
+            std::printf("%8zu %10zu %14.2f %9.2fx\n", threads, samples, ms, baseline / ms);
+        }
+    }
+
+    /* Many small searches, pooled by the scheduler. Reports how full the combined batches are, and how many
+     * expansions the deduplication of shared goals saves. */
+    void bench_scheduler() {
+        std::printf("== scheduler: combined batches of 256 searches with 4 expansions per batch ==\n");
+        std::printf("%10s %10s %14s %14s %12s\n", "max batch", "batches", "mean batch", "requested", "total s");
+        SyntheticEnv env(8, 2000, 0.05);
+        for (size_t max_batch_size: {16, 64, 256}) {
+            auto params = default_params();
+            params.succ_expansions = 4;
+            params.num_expansions = 100;
+            params.early_stopping = true;
+            htps::seed = 0;
+            HTPSScheduler scheduler(max_batch_size);
+            for (size_t i = 0; i < 256; i++) {
+                TheoremPointer root = SyntheticEnv::goal(i);
+                scheduler.add_search(root, params);
+            }
+            size_t batches = 0, expanded = 0;
+            auto start = Clock::now();
+            while (!scheduler.is_done()) {
+                auto theorems = scheduler.theorems_to_expand();
+                if (theorems.empty())
+                    continue;
+                std::vector<std::shared_ptr<env_expansion>> expansions;
+                for (const auto &thm: theorems)
+                    expansions.push_back(env.expand(thm));
+                scheduler.expand_and_backup(expansions);
+                batches++;
+                expanded += theorems.size();
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            std::printf("%10zu %10zu %14.1f %14zu %12.3f\n", max_batch_size, batches,
+                        static_cast<double>(expanded) / static_cast<double>(std::max<size_t>(1, batches)), expanded,
+                        seconds);
+        }
+    }
+    /* The element-wise loops of the tree policies for typical numbers of tactics per node, per instruction set.
+     * Every 8th tactic is invalid, as killed tactics would be. "alpha_zero" are the scores and their normalization,
+     * "rpo" a single step of the solver for alpha. */
+    void bench_policy_kernels() {
+        std::printf("== policy_kernels: ns per call by number of tactics ==\n");
+        std::printf("%8s %8s %14s %10s %14s %10s\n", "tactics", "isa", "alpha_zero ns", "speedup", "rpo ns", "speedup");
+        const PolicyKernels &scalar = *policy_kernels(InstructionSet::Scalar);
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (size_t n: {8, 16, 32, 64, 128, 256}) {
+            std::vector<double> q(n), pi(n), out(n);
+            std::vector<size_t> counts(n);
+            for (size_t i = 0; i < n; i++) {
+                q[i] = i % 8 == 7 ? MIN_FLOAT : uniform(rng);
+                pi[i] = uniform(rng) / static_cast<double>(n);
+                counts[i] = rng() % 100;
+            }
+            const size_t repetitions = 4000000 / n;
+            double scalar_alpha_zero = 0, scalar_rpo = 0;
+            for (auto instruction_set: {InstructionSet::Scalar, InstructionSet::AVX2, InstructionSet::AVX512}) {
+                const PolicyKernels *kernels = policy_kernels(instruction_set);
+                if (!kernels)
+                    continue;
+                double checksum = 0;
+                auto start = Clock::now();
+                for (size_t r = 0; r < repetitions; r++) {
+                    double sum;
+                    kernels->alpha_zero_scores(q.data(), pi.data(), counts.data(), n, 1.0, 10.0, out.data(), sum);
+                    kernels->normalize(out.data(), n, sum);
+                    checksum += out[0];
+                }
+                double alpha_zero = std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+                                    static_cast<double>(repetitions);
+                start = Clock::now();
+                for (size_t r = 0; r < repetitions; r++) {
+                    bool zero_difference;
+                    double derivative;
+                    checksum += kernels->rpo_difference_sum(q.data(), pi.data(), n, 2.0 + checksum * 1e-300,
+                                                            derivative, zero_difference);
+                }
+                double rpo = std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+                             static_cast<double>(repetitions);
+                if (kernels == &scalar) {
+                    scalar_alpha_zero = alpha_zero;
+                    scalar_rpo = rpo;
+                }
+                std::printf("%8zu %8s %14.1f %9.2fx %14.1f %9.2fx%s\n", n, to_string(instruction_set), alpha_zero,
+                            scalar_alpha_zero / alpha_zero, rpo, scalar_rpo / rpo, std::isnan(checksum) ? " nan" : "");
+            }
+        }
+    }
+
+    size_t resident_bytes() {
+        FILE *file = std::fopen("/proc/self/statm", "r");
+        if (!file)
+            return 0;
+        size_t size = 0, resident = 0;
+        if (std::fscanf(file, "%zu %zu", &size, &resident) != 2)
+            resident = 0;
+        std::fclose(file);
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    /* Memory of the per-tactic statistics in this build, and the effect of single precision storage on the policy.
+     * The memory part depends on the build, compare a default build with one configured with -DHTPS_FLOAT_STATS=ON.
+     * The policy part emulates both modes in the same process: the same random backups are accumulated into double
+     * and float log values exactly like HTPSNode::update does, then the AlphaZero policies of both are compared. */
+    void bench_float_stats() {
+        std::printf("== float_stats: statistics stored in %s precision ==\n",
+                    std::is_same_v<stat_t, float> ? "single" : "double");
+        // priors, log_w, counts and virtual_counts
+        const size_t bytes_per_tactic = 2 * sizeof(stat_t) + 2 * sizeof(count_t);
+        std::printf("%8s %8s %10s %12s %10s\n", "tactics", "nodes", "bytes/tac", "stats MiB", "rss MiB");
+        for (size_t n_tactics: {16, 64}) {
+            auto params = default_params();
+            params.num_expansions = 4000;
+            params.succ_expansions = 64;
+            SyntheticEnv env(n_tactics, 50000, 0.0);
+            htps::seed = 0;
+            TheoremPointer root = SyntheticEnv::goal(0);
+            HTPS search(root, params);
+            size_t nodes = 0;
+            while (!search.is_done()) {
+                auto theorems = search.theorems_to_expand();
+                if (theorems.empty())
+                    break;
+                std::vector<std::shared_ptr<env_expansion>> expansions;
+                for (const auto &thm: theorems)
+                    expansions.push_back(env.expand(thm));
+                search.expand_and_backup(expansions);
+                nodes += theorems.size();
+            }
+            double stats = static_cast<double>(nodes * n_tactics * bytes_per_tactic) / (1 << 20);
+            std::printf("%8zu %8zu %10zu %12.1f %10.1f\n", n_tactics, nodes, bytes_per_tactic, stats,
+                        static_cast<double>(resident_bytes()) / (1 << 20));
+        }
+
+        std::printf("%8s %8s %18s %14s\n", "tactics", "visits", "max policy diff", "same argmax");
+        Policy policy(AlphaZero, 1.0);
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        const size_t trials = 100;
+        for (size_t n: {16, 64, 256}) {
+            for (size_t visits: {100, 10000, 100000}) {
+                double max_difference = 0;
+                size_t same_argmax = 0;
+                for (size_t trial = 0; trial < trials; trial++) {
+                    std::vector<double> value(n), pi(n, 1.0 / static_cast<double>(n));
+                    std::vector<double> log_w_double(n, MIN_FLOAT);
+                    std::vector<float> log_w_float(n, -std::numeric_limits<float>::infinity());
+                    std::vector<size_t> counts(n, 0);
+                    for (auto &v: value)
+                        v = 0.1 + 0.8 * uniform(rng);
+                    for (size_t visit = 0; visit < visits; visit++) {
+                        // Better tactics are visited more often, as they would be in a search
+                        size_t i = rng() % n;
+                        if (uniform(rng) > value[i])
+                            i = rng() % n;
+                        double backup = std::log(value[i] * (0.5 + 0.5 * uniform(rng)));
+                        log_w_double[i] = log_add_exp(log_w_double[i], backup);
+                        log_w_float[i] = static_cast<float>(log_add_exp(log_w_float[i], backup));
+                        counts[i]++;
+                    }
+                    std::vector<double> q_double(n), q_float(n), policy_double, policy_float;
+                    for (size_t i = 0; i < n; i++) {
+                        auto count = static_cast<double>(std::max<size_t>(1, counts[i]));
+                        q_double[i] = counts[i] == 0 ? 0.5 : std::exp(log_w_double[i]) / count;
+                        q_float[i] = counts[i] == 0 ? 0.5 : std::exp(static_cast<double>(log_w_float[i])) / count;
+                    }
+                    policy.get_policy(q_double, pi, counts, policy_double);
+                    policy.get_policy(q_float, pi, counts, policy_float);
+                    for (size_t i = 0; i < n; i++)
+                        max_difference = std::max(max_difference, std::abs(policy_double[i] - policy_float[i]));
+                    same_argmax += std::max_element(policy_double.begin(), policy_double.end()) -
+                                   policy_double.begin() ==
+                                   std::max_element(policy_float.begin(), policy_float.end()) - policy_float.begin();
+                }
+                std::printf("%8zu %8zu %18.2e %13.1f%%\n", n, visits, max_difference,
+                            100.0 * static_cast<double>(same_argmax) / trials);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+            {"parallel_selection", bench_parallel_selection},
+            {"scheduler",          bench_scheduler},
+            {"policy_kernels",     bench_policy_kernels},
+            {"float_stats",        bench_float_stats},
+            {"train_samples",      bench_train_samples},
+    };
+    for (const auto &[name, fn]: benchmarks) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; i++)
+            selected |= name == argv[i];
+        if (selected)
+            fn();
+    }
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include "./htps.h"
 #include <structmember.h>
 #include "../src/graph/htps.h"
+#include "../src/graph/columns.h"
+#include "../src/graph/shard.h"
+#include "../src/graph/engine.h"
+#include "../src/graph/scheduler.h"
 
 static PyObject *PolicyTypeEnum = NULL;
 static PyObject *QValueSolvedEnum = NULL;
@@ -154,6 +158,10 @@ static int Params_init(PyObject *self, PyObject *args, PyObject *kwargs) {
     double exploration, depth_penalty, tactic_init_value, policy_temperature, effect_subsampling_rate,
             critic_subsampling_rate;
     size_t num_expansions, succ_expansions, count_threshold, virtual_loss;
+    size_t num_threads = 1;
+    int async_expansions = 0;
+    size_t time_budget_ms = 0;
+    double widening_constant = 0.0, widening_exponent = 0.5;
     int early_stopping, no_critic, backup_once, backup_one_for_solved, tactic_p_threshold, tactic_sample_q_conditioning,
             only_learn_best_tactics, early_stopping_solved_if_root_not_proven;
     PyObject *policy_obj, *q_value_solved_obj, *metric_obj, *node_mask_obj;
@@ -180,9 +188,14 @@ static int Params_init(PyObject *self, PyObject *args, PyObject *kwargs) {
             "critic_subsampling_rate",
             "early_stopping_solved_if_root_not_proven",
             "virtual_loss",
+            "num_threads",
+            "async_expansions",
+            "time_budget_ms",
+            "widening_constant",
+            "widening_exponent",
             NULL
     };
-    const char *format = "dO" "nn" "pppp" "d" "n" "ppp" "d" "O" "d" "OO" "dd" "pn";
+    const char *format = "dO" "nn" "pppp" "d" "n" "ppp" "d" "O" "d" "OO" "dd" "pn" "|npn" "dd";
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, const_cast<char**>(kwlist),
                                      &exploration,
                                      &policy_obj,
@@ -205,7 +218,12 @@ static int Params_init(PyObject *self, PyObject *args, PyObject *kwargs) {
                                      &effect_subsampling_rate,
                                      &critic_subsampling_rate,
                                      &early_stopping_solved_if_root_not_proven,
-                                     &virtual_loss)) {
+                                     &virtual_loss,
+                                     &num_threads,
+                                     &async_expansions,
+                                     &time_budget_ms,
+                                     &widening_constant,
+                                     &widening_exponent)) {
         return -1;
     }
 
@@ -240,6 +258,11 @@ static int Params_init(PyObject *self, PyObject *args, PyObject *kwargs) {
     params->critic_subsampling_rate = critic_subsampling_rate;
     params->early_stopping_solved_if_root_not_proven = early_stopping_solved_if_root_not_proven ? true : false;
     params->virtual_loss = virtual_loss;
+    params->num_threads = num_threads;
+    params->async_expansions = async_expansions ? true : false;
+    params->time_budget_ms = time_budget_ms;
+    params->widening_constant = widening_constant;
+    params->widening_exponent = widening_exponent;
     return 0;
 }
 
@@ -340,6 +363,11 @@ static PyMemberDef Params_members[] = {
     {"critic_subsampling_rate", T_DOUBLE, offsetof(htps::htps_params, critic_subsampling_rate), 0, "critic subsampling rate"},
     {"early_stopping_solved_if_root_not_proven", T_BOOL, offsetof(htps::htps_params, early_stopping_solved_if_root_not_proven), 0, "early stopping solved flag"},
     {"virtual_loss",        T_ULONG,   offsetof(htps::htps_params, virtual_loss),        0, "virtual loss"},
+    {"num_threads",         T_ULONG,   offsetof(htps::htps_params, num_threads),         0, "threads used for leaf selection"},
+    {"async_expansions",    T_BOOL,     offsetof(htps::htps_params, async_expansions),    0, "select theorems while expansions are outstanding"},
+    {"time_budget_ms",      T_ULONG,   offsetof(htps::htps_params, time_budget_ms),      0, "wall-clock budget of a search in milliseconds"},
+    {"widening_constant",   T_DOUBLE,  offsetof(htps::htps_params, widening_constant),   0, "progressive widening constant, 0 disables it"},
+    {"widening_exponent",   T_DOUBLE,  offsetof(htps::htps_params, widening_exponent),   0, "progressive widening exponent"},
     {NULL}
 };
 
@@ -2039,7 +2067,7 @@ static PyObject *PyHTPSSampleEffect_get_tactic(PyHTPSSampleEffect *self, void *c
 }
 
 static PyObject *PyHTPSSampleEffect_get_children(PyHTPSSampleEffect *self, void *closure) {
-    std::vector<htps::TheoremPointer> children = self->cpp_obj.get_children();
+    const std::vector<htps::TheoremPointer> &children = self->cpp_obj.get_children();
     PyObject *list = PyList_New(children.size());
     if (!list)
         return PyErr_NoMemory();
@@ -2703,14 +2731,15 @@ static int PyHTPSResult_init(PyObject *self, PyObject *args, PyObject *kwargs) {
     auto *proof = (PyProof *) py_proof;
     result->cpp_obj.~HTPSResult();
     std::optional<htps::proof> proof_opt = proof->cpp_obj;
-    new(&result->cpp_obj) htps::HTPSResult(critic_samples, tactic_samples, effect_samples, metric,
-                                           proof_samples_tactics, thm, proof_opt);
+    new(&result->cpp_obj) htps::HTPSResult(std::move(critic_samples), std::move(tactic_samples),
+                                           std::move(effect_samples), metric, std::move(proof_samples_tactics), thm,
+                                           std::move(proof_opt));
     return 0;
 }
 
 
 static PyObject *PyHTPSResult_get_critic_samples(PyHTPSResult *self, void *closure) {
-    auto vec = self->cpp_obj.get_critic_samples();
+    const auto &vec = self->cpp_obj.get_critic_samples();
     PyObject *list = PyList_New(vec.size());
     if (!list)
         return PyErr_NoMemory();
@@ -2741,7 +2770,7 @@ static PyObject *PyHTPSResult_get_critic_samples(PyHTPSResult *self, void *closu
 }
 
 static PyObject *PyHTPSResult_get_tactic_samples(PyHTPSResult *self, void *closure) {
-    auto vec = self->cpp_obj.get_tactic_samples();
+    const auto &vec = self->cpp_obj.get_tactic_samples();
     PyObject *list = PyList_New(vec.size());
     if (!list)
         return PyErr_NoMemory();
@@ -2831,7 +2860,7 @@ static PyObject *PyHTPSResult_get_tactic_samples(PyHTPSResult *self, void *closu
 }
 
 static PyObject *PyHTPSResult_get_effect_samples(PyHTPSResult *self, void *closure) {
-    auto vec = self->cpp_obj.get_effect_samples();
+    const auto &vec = self->cpp_obj.get_effect_samples();
     PyObject *list = PyList_New(vec.size());
     if (!list)
         return PyErr_NoMemory();
@@ -2886,7 +2915,7 @@ static PyObject *PyHTPSResult_get_effect_samples(PyHTPSResult *self, void *closu
 }
 
 static PyObject *PyHTPSResult_get_proof_samples_tactics(PyHTPSResult *self, void *closure) {
-    auto vec = self->cpp_obj.get_proof_samples();
+    const auto &vec = self->cpp_obj.get_proof_samples();
     PyObject *list = PyList_New(vec.size());
     if (!list)
         return PyErr_NoMemory();
@@ -2983,9 +3012,9 @@ static PyObject *PyHTPSResult_get_goal(PyHTPSResult *self, void *closure) {
 }
 
 static PyObject *PyHTPSResult_get_proof(PyHTPSResult *self, void *closure) {
-    auto p = self->cpp_obj.get_proof();
+    const auto &p = self->cpp_obj.get_proof();
     if (!p.has_value())
-        return Py_None;
+        Py_RETURN_NONE;
     return PyProof_NewFromProof(p.value());
 }
 
@@ -3000,7 +3029,184 @@ static PyGetSetDef PyHTPSResult_getsetters[] = {
         {NULL}
 };
 
+typedef struct {
+    PyObject_HEAD
+    std::shared_ptr<const void> owner; // Keeps the memory of the column alive while buffers are exported
+    const void *data;
+    Py_ssize_t length;
+    Py_ssize_t itemsize;
+    const char *format;
+} PyColumnBuffer;
+
+static void ColumnBuffer_dealloc(PyColumnBuffer *self) {
+    self->owner.~shared_ptr<const void>();
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+static int ColumnBuffer_getbuffer(PyColumnBuffer *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "Column buffers are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    static const char empty = 0; // Consumers expect a valid pointer even for empty columns
+    view->buf = const_cast<void *>(self->length > 0 ? self->data : &empty);
+    view->obj = (PyObject *) self;
+    Py_INCREF(self);
+    view->len = self->length * self->itemsize;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char *>(self->format) : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->length : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs ColumnBuffer_as_buffer = {
+        (getbufferproc) ColumnBuffer_getbuffer,
+        NULL,
+};
+
+static PyTypeObject ColumnBufferType = {
+        PyObject_HEAD_INIT(NULL) "htps.ColumnBuffer",
+        sizeof(PyColumnBuffer),
+        0,
+        (destructor) ColumnBuffer_dealloc,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        &ColumnBuffer_as_buffer,
+        Py_TPFLAGS_DEFAULT,
+        "Read-only view of a column of Result.columns(), supports the buffer protocol, e.g. numpy.asarray or memoryview",
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+};
+
+static const char *column_format(htps::ColumnType type) {
+    static_assert(sizeof(unsigned long long) == sizeof(uint64_t));
+    switch (type) {
+        case htps::ColumnType::UInt8:
+            return "B";
+        case htps::ColumnType::UInt32:
+            return "I";
+        case htps::ColumnType::UInt64:
+            return "Q";
+        case htps::ColumnType::Float64:
+            return "d";
+    }
+    return "B";
+}
+
+// Adds a buffer viewing count elements at data under key to dict, without copying them. owner keeps data alive
+static bool add_column(PyObject *dict, const char *key, const std::shared_ptr<const void> &owner, const void *data,
+                       size_t count, htps::ColumnType type) {
+    auto *buffer = (PyColumnBuffer *) ColumnBufferType.tp_alloc(&ColumnBufferType, 0);
+    if (!buffer)
+        return false;
+    new(&(buffer->owner)) std::shared_ptr<const void>(owner);
+    buffer->data = data;
+    buffer->length = static_cast<Py_ssize_t>(count);
+    buffer->itemsize = static_cast<Py_ssize_t>(htps::column_type_size(type));
+    buffer->format = column_format(type);
+    int status = PyDict_SetItemString(dict, key, (PyObject *) buffer);
+    Py_DECREF(buffer);
+    return status == 0;
+}
+
+// Returns the dict for group in groups, creating it if needed. Borrowed reference
+static PyObject *column_group(PyObject *groups, const char *group) {
+    PyObject *dict = PyDict_GetItemString(groups, group);
+    if (dict)
+        return dict;
+    dict = PyDict_New();
+    if (!dict)
+        return NULL;
+    int status = PyDict_SetItemString(groups, group, dict);
+    Py_DECREF(dict);
+    return status == 0 ? dict : NULL;
+}
+
+static PyObject *strings_to_list(const std::vector<std::string> &strings) {
+    PyObject *list = PyList_New(static_cast<Py_ssize_t>(strings.size()));
+    if (!list)
+        return NULL;
+    for (size_t i = 0; i < strings.size(); i++) {
+        PyObject *s = PyUnicode_FromStringAndSize(strings[i].data(), static_cast<Py_ssize_t>(strings[i].size()));
+        if (!s) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), s);
+    }
+    return list;
+}
+
+// Sets key of dict to value and releases value, fails if value is NULL
+static bool set_item_steal(PyObject *dict, const char *key, PyObject *value) {
+    if (!value)
+        return false;
+    int status = PyDict_SetItemString(dict, key, value);
+    Py_DECREF(value);
+    return status == 0;
+}
+
+static PyObject *PyHTPSResult_columns(PyHTPSResult *self, PyObject *Py_UNUSED(ignored)) {
+    std::shared_ptr<const htps::SampleColumns> columns;
+    try {
+        columns = std::make_shared<const htps::SampleColumns>(self->cpp_obj);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    PyObject *dict = PyDict_New();
+    if (!dict)
+        return NULL;
+    bool ok = set_item_steal(dict, "goals", strings_to_list(columns->goals.strings)) &&
+              set_item_steal(dict, "tactics", strings_to_list(columns->tactics.strings));
+    htps::for_each_column(*columns, [&](const char *group, const char *name, const auto &column) {
+        using T = typename std::decay_t<decltype(column)>::value_type;
+        if (!ok)
+            return;
+        PyObject *group_dict = column_group(dict, group);
+        ok = group_dict && add_column(group_dict, name, columns, column.data(), column.size(), htps::column_type<T>());
+    });
+    if (!ok) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    return dict;
+}
+
 static PyMethodDef PyHTPSResult_methods[] = {
+        {"columns", (PyCFunction) PyHTPSResult_columns, METH_NOARGS,
+                "Training samples as columns of flat buffers with interned goals and tactics"},
         {NULL, NULL, 0, NULL}
 };
 
@@ -3045,66 +3251,1047 @@ PyTypeObject PyHTPSResultType = {
         (newfunc) PyHTPSResult_new,
 };
 
-static PyObject *PyHTPSResult_NewFromResult(const htps::HTPSResult &result) {
+static PyObject *PyHTPSResult_NewFromResult(htps::HTPSResult result) {
     PyObject *obj = PyHTPSResult_new(&PyHTPSResultType, NULL, NULL);
     if (obj == NULL)
         return NULL;
     auto *py_result = (PyHTPSResult *) obj;
-    py_result->cpp_obj = result;
+    py_result->cpp_obj = std::move(result);
     return obj;
 }
 
 typedef struct {
     PyObject_HEAD
-    htps::HTPS graph;
-} PyHTPS;
+    std::shared_ptr<htps::ExpansionCache> cache;
+} PyExpansionCache;
 
+static PyObject *ExpansionCache_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    auto *self = (PyExpansionCache *) type->tp_alloc(type, 0);
+    if (!self) {
+        PyErr_SetString(PyExc_MemoryError, "could not allocate memory");
+        return NULL;
+    }
+    new(&(self->cache)) std::shared_ptr<htps::ExpansionCache>();
+    return (PyObject *) self;
+}
 
-static PyObject *HTPS_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
-    auto *self = (PyHTPS *) type->tp_alloc(type, 0);
+static int ExpansionCache_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    auto *py_cache = (PyExpansionCache *) self;
+    Py_ssize_t capacity;
+    const char *path = NULL;
+    static char *kwlist[] = {(char *) "capacity", (char *) "path", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|z", kwlist, &capacity, &path))
+        return -1;
+    if (capacity <= 0) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be positive");
+        return -1;
+    }
+    try {
+        if (path)
+            py_cache->cache = std::make_shared<htps::ExpansionCache>(std::string(path), static_cast<size_t>(capacity));
+        else
+            py_cache->cache = std::make_shared<htps::ExpansionCache>(static_cast<size_t>(capacity));
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+    return 0;
+}
+
+static void ExpansionCache_dealloc(PyExpansionCache *self) {
+    self->cache.~shared_ptr<htps::ExpansionCache>();
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *ExpansionCache_compact(PyExpansionCache *self, PyObject *Py_UNUSED(ignored)) {
+    try {
+        self->cache->compact();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *ExpansionCache_size(PyExpansionCache *self, PyObject *Py_UNUSED(ignored)) {
+    return PyLong_FromSize_t(self->cache->size());
+}
+
+static PyObject *ExpansionCache_hits(PyExpansionCache *self, PyObject *Py_UNUSED(ignored)) {
+    return PyLong_FromSize_t(self->cache->get_hits());
+}
+
+static PyObject *ExpansionCache_misses(PyExpansionCache *self, PyObject *Py_UNUSED(ignored)) {
+    return PyLong_FromSize_t(self->cache->get_misses());
+}
+
+static PyMethodDef ExpansionCache_methods[] = {
+        {"compact", (PyCFunction) ExpansionCache_compact, METH_NOARGS, "Rewrites the backing file with the cached expansions only"},
+        {"size",    (PyCFunction) ExpansionCache_size,    METH_NOARGS, "Number of cached expansions"},
+        {"hits",    (PyCFunction) ExpansionCache_hits,    METH_NOARGS, "Number of lookups answered from the cache"},
+        {"misses",  (PyCFunction) ExpansionCache_misses,  METH_NOARGS, "Number of lookups not answered from the cache"},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject ExpansionCacheType = {
+        PyObject_HEAD_INIT(NULL) "htps.ExpansionCache",
+        sizeof(PyExpansionCache),
+        0,
+        (destructor) ExpansionCache_dealloc,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        Py_TPFLAGS_DEFAULT,
+        "LRU cache of EnvExpansions shared between searches, optionally backed by a file",
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        ExpansionCache_methods,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        (initproc) ExpansionCache_init,
+        NULL,
+        (newfunc) ExpansionCache_new,
+};
+
+typedef struct {
+    PyObject_HEAD
+    std::shared_ptr<htps::ShardWriter> writer;
+} PyShardWriter;
+
+static PyObject *ShardWriter_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    auto *self = (PyShardWriter *) type->tp_alloc(type, 0);
     if (!self) {
         PyErr_SetString(PyExc_MemoryError, "could not allocate memory");
         return NULL;
     }
-    new(&(self->graph)) htps::HTPS();
+    new(&(self->writer)) std::shared_ptr<htps::ShardWriter>();
     return (PyObject *) self;
 }
 
-static int HTPS_init(PyObject *self, PyObject *args, PyObject *kwargs) {
-    auto *tree = (PyHTPS *) self;
-    PyObject *thm, *params;
-    static char *kwlist[] = {(char *) "theorem", (char *) "params", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", kwlist, &thm, &params))
+static int ShardWriter_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    auto *py_writer = (PyShardWriter *) self;
+    const char *path;
+    static char *kwlist[] = {(char *) "path", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", kwlist, &path))
         return -1;
-    if (!PyObject_TypeCheck(thm, &TheoremType)) {
-        PyErr_SetString(PyExc_TypeError, "theorem must be a Theorem object");
+    try {
+        py_writer->writer = std::make_shared<htps::ShardWriter>(std::string(path));
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+    return 0;
+}
+
+static void ShardWriter_dealloc(PyShardWriter *self) {
+    self->writer.~shared_ptr<htps::ShardWriter>();
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *ShardWriter_append(PyShardWriter *self, PyObject *args) {
+    PyObject *py_result;
+    if (!PyArg_ParseTuple(args, "O!", &PyHTPSResultType, &py_result))
+        return NULL;
+    // Other threads can append to the same shard meanwhile
+    std::optional<std::string> error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        self->writer->append(((PyHTPSResult *) py_result)->cpp_obj);
+    } catch (std::exception &e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (error) {
+        PyErr_SetString(PyExc_RuntimeError, error->c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *ShardWriter_close(PyShardWriter *self, PyObject *Py_UNUSED(ignored)) {
+    try {
+        self->writer->close();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *ShardWriter_size(PyShardWriter *self, PyObject *Py_UNUSED(ignored)) {
+    return PyLong_FromSize_t(self->writer->size());
+}
+
+static PyObject *ShardWriter_enter(PyShardWriter *self, PyObject *Py_UNUSED(ignored)) {
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+static PyObject *ShardWriter_exit(PyShardWriter *self, PyObject *Py_UNUSED(args)) {
+    PyObject *closed = ShardWriter_close(self, NULL);
+    if (!closed)
+        return NULL;
+    Py_DECREF(closed);
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef ShardWriter_methods[] = {
+        {"append",    (PyCFunction) ShardWriter_append, METH_VARARGS, "Appends the samples of a Result"},
+        {"close",     (PyCFunction) ShardWriter_close,  METH_NOARGS,  "Writes the footer, the shard can only be read afterwards"},
+        {"size",      (PyCFunction) ShardWriter_size,   METH_NOARGS,  "Number of appended results"},
+        {"__enter__", (PyCFunction) ShardWriter_enter,  METH_NOARGS,  NULL},
+        {"__exit__",  (PyCFunction) ShardWriter_exit,   METH_VARARGS, NULL},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject ShardWriterType = {
+        PyObject_HEAD_INIT(NULL) "htps.ShardWriter",
+        sizeof(PyShardWriter),
+        0,
+        (destructor) ShardWriter_dealloc,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        Py_TPFLAGS_DEFAULT,
+        "Writes the samples of many Results to a binary training shard",
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        ShardWriter_methods,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        (initproc) ShardWriter_init,
+        NULL,
+        (newfunc) ShardWriter_new,
+};
+
+typedef struct {
+    PyObject_HEAD
+    std::shared_ptr<const htps::ShardReader> reader;
+} PyShardReader;
+
+static PyObject *ShardReader_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    auto *self = (PyShardReader *) type->tp_alloc(type, 0);
+    if (!self) {
+        PyErr_SetString(PyExc_MemoryError, "could not allocate memory");
+        return NULL;
+    }
+    new(&(self->reader)) std::shared_ptr<const htps::ShardReader>();
+    return (PyObject *) self;
+}
+
+static int ShardReader_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    auto *py_reader = (PyShardReader *) self;
+    const char *path;
+    static char *kwlist[] = {(char *) "path", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", kwlist, &path))
+        return -1;
+    try {
+        py_reader->reader = std::make_shared<const htps::ShardReader>(std::string(path));
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
         return -1;
     }
-    auto *c_thm = (PyTheorem *) thm;
+    return 0;
+}
+
+static void ShardReader_dealloc(PyShardReader *self) {
+    self->reader.~shared_ptr<const htps::ShardReader>();
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *ShardReader_size(PyShardReader *self, PyObject *Py_UNUSED(ignored)) {
+    return PyLong_FromSize_t(self->reader->size());
+}
+
+static PyObject *ShardReader_goals(PyShardReader *self, PyObject *Py_UNUSED(ignored)) {
+    return strings_to_list(self->reader->get_goals());
+}
+
+static PyObject *ShardReader_tactics(PyShardReader *self, PyObject *Py_UNUSED(ignored)) {
+    return strings_to_list(self->reader->get_tactics());
+}
+
+static PyObject *ShardReader_record(PyShardReader *self, PyObject *args) {
+    Py_ssize_t index;
+    if (!PyArg_ParseTuple(args, "n", &index))
+        return NULL;
+    const auto &reader = self->reader;
+    if (index < 0 || static_cast<size_t>(index) >= reader->size()) {
+        PyErr_SetString(PyExc_IndexError, "record index out of range");
+        return NULL;
+    }
+    auto record = static_cast<size_t>(index);
+    PyObject *dict = PyDict_New();
+    if (!dict)
+        return NULL;
+    bool ok = set_item_steal(dict, "goal", PyLong_FromUnsignedLong(reader->get_goal_id(record))) &&
+              set_item_steal(dict, "metric", PyObject_CallFunction(MetricEnum, "i", reader->get_metric(record))) &&
+              set_item_steal(dict, "proven", PyBool_FromLong(reader->is_proven(record)));
+    const auto &schema = reader->get_schema();
+    for (size_t i = 0; ok && i < schema.size(); i++) {
+        auto [data, count] = reader->column_data(record, i);
+        PyObject *group_dict = column_group(dict, schema[i].group.c_str());
+        ok = group_dict && add_column(group_dict, schema[i].name.c_str(), reader, data, count, schema[i].type);
+    }
+    if (!ok) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+static PyMethodDef ShardReader_methods[] = {
+        {"size",    (PyCFunction) ShardReader_size,    METH_NOARGS,  "Number of records, i.e. Results, in the shard"},
+        {"goals",   (PyCFunction) ShardReader_goals,   METH_NOARGS,  "Unique strings of the goals, indexed by the goal ids"},
+        {"tactics", (PyCFunction) ShardReader_tactics, METH_NOARGS,  "Unique strings of the tactics, indexed by the tactic ids"},
+        {"record",  (PyCFunction) ShardReader_record,  METH_VARARGS, "Columns of a record as in Result.columns, viewing the mapped file"},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject ShardReaderType = {
+        PyObject_HEAD_INIT(NULL) "htps.ShardReader",
+        sizeof(PyShardReader),
+        0,
+        (destructor) ShardReader_dealloc,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        Py_TPFLAGS_DEFAULT,
+        "Memory maps a binary training shard written by ShardWriter",
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        ShardReader_methods,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        (initproc) ShardReader_init,
+        NULL,
+        (newfunc) ShardReader_new,
+};
+
+typedef struct {
+    PyObject_HEAD
+    htps::HTPS graph;
+} PyHTPS;
+
+
+static PyObject *HTPS_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    auto *self = (PyHTPS *) type->tp_alloc(type, 0);
+    if (!self) {
+        PyErr_SetString(PyExc_MemoryError, "could not allocate memory");
+        return NULL;
+    }
+    new(&(self->graph)) htps::HTPS();
+    return (PyObject *) self;
+}
+
+static int HTPS_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    auto *tree = (PyHTPS *) self;
+    PyObject *thm, *params;
+    static char *kwlist[] = {(char *) "theorem", (char *) "params", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", kwlist, &thm, &params))
+        return -1;
+    if (!PyObject_TypeCheck(thm, &TheoremType)) {
+        PyErr_SetString(PyExc_TypeError, "theorem must be a Theorem object");
+        return -1;
+    }
+    auto *c_thm = (PyTheorem *) thm;
+    if (!PyObject_TypeCheck(params, &ParamsType)) {
+        PyErr_SetString(PyExc_TypeError, "params must be a SearchParams object");
+        return -1;
+    }
+    auto *c_params = (htps::htps_params *) params;
+    auto shared_thm = c_thm->cpp_obj;
+    tree->graph.set_root(shared_thm);
+    tree->graph.set_params(*c_params);
+    return 0;
+}
+
+static PyObject *PyHTPS_theorems_to_expand(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    std::vector<htps::TheoremPointer> thms;
+    try {
+        thms = self->graph.theorems_to_expand();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+
+    PyObject *list = PyList_New(thms.size());
+    if (!list)
+        return PyErr_NoMemory();
+
+    for (size_t i = 0; i < thms.size(); i++) {
+        PyObject *pythm = Theorem_NewFromShared(thms[i]);
+        if (!pythm) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, pythm);
+    }
+    return list;
+}
+
+static PyObject *PyHTPS_expand_and_backup(PyHTPS *self, PyObject *args) {
+    PyObject *py_expansions;
+    if (!PyArg_ParseTuple(args, "O", &py_expansions)) {
+        PyErr_SetString(PyExc_TypeError, "expand_and_backup expects an iterable of EnvExpansion objects");
+        return NULL;
+    }
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+    PyObject *iterator = PyObject_GetIter(py_expansions);
+    if (!iterator) {
+        PyErr_SetString(PyExc_TypeError, "Provided object is not iterable");
+        return NULL;
+    }
+    PyObject *item;
+    while ((item = PyIter_Next(iterator)) != NULL) {
+        if (!PyObject_TypeCheck(item, &EnvExpansionType)) {
+            PyErr_SetString(PyExc_TypeError, "each item in the iterable must be an EnvExpansion object");
+            Py_DECREF(item);
+            Py_DECREF(iterator);
+            return NULL;
+        }
+        auto *exp = (PyEnvExpansion *) item;
+        std::shared_ptr<htps::env_expansion> shared_exp(
+                &exp->expansion,
+                [](htps::env_expansion *) {
+                    // no deletion: the memory is owned by the Python object.
+                }
+        );
+        //expansions.push_back(std::make_shared<htps::env_expansion>(exp->expansion));
+        expansions.push_back(shared_exp);
+        Py_DECREF(item);
+    }
+    Py_DECREF(iterator);
+    try {
+        self->graph.expand_and_backup(expansions);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyHTPS_is_proven(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *res = self->graph.is_proven() ? Py_True : Py_False;
+    Py_INCREF(res);
+    return res;
+}
+
+static PyObject *PyHTPS_is_done(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *res = self->graph.is_done() ? Py_True : Py_False;
+    Py_INCREF(res);
+    return res;
+}
+
+static PyObject *PyHTPS_expansions(PyHTPS *self, void *closure) {
+    return PyLong_FromSize_t(self->graph.num_expansions());
+}
+
+static void PyHTPS_dealloc(PyHTPS *self) {
+    self->graph.~HTPS();
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *PyHTPS_get_result(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    htps::HTPSResult result;
+    try {
+        result = self->graph.get_result();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return PyHTPSResult_NewFromResult(std::move(result));
+}
+
+static PyObject *PyHTPS_harvest(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    htps::HTPSResult result;
+    try {
+        result = self->graph.harvest();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return PyHTPSResult_NewFromResult(std::move(result));
+}
+
+static PyObject *PyHTPS_get_jsonstr(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    std::string result;
+    try {
+        result = nlohmann::json(self->graph).dump();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return PyObject_from_string(result);
+}
+
+static PyObject *PyHTPS_from_jsonstr(PyTypeObject *type, PyObject *args) {
+    const char *json_str;
+    if (!PyArg_ParseTuple(args, "s", &json_str)) {
+        PyErr_SetString(PyExc_TypeError, "from_jsonstr expects a string");
+        return NULL;
+    }
+    try {
+        auto json = nlohmann::json::parse(json_str);
+        auto graph = htps::HTPS::from_json(json);
+        PyObject *obj = HTPS_new(type, NULL, NULL);
+        if (obj == NULL)
+            return NULL;
+        auto *py_graph = (PyHTPS *) obj;
+        py_graph->graph = graph;
+        return obj;
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+}
+
+static PyObject *PyHTPS_get_binary(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    std::string result;
+    try {
+        result = self->graph.get_binary();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return PyBytes_FromStringAndSize(result.data(), static_cast<Py_ssize_t>(result.size()));
+}
+
+static PyObject *PyHTPS_wrap_graph(PyTypeObject *type, htps::HTPS &&graph) {
+    PyObject *obj = HTPS_new(type, NULL, NULL);
+    if (obj == NULL)
+        return NULL;
+    ((PyHTPS *) obj)->graph = std::move(graph);
+    return obj;
+}
+
+static PyObject *PyHTPS_from_binary(PyTypeObject *type, PyObject *args) {
+    Py_buffer data;
+    if (!PyArg_ParseTuple(args, "y*", &data))
+        return NULL;
+    std::optional<htps::HTPS> graph;
+    try {
+        graph = htps::HTPS::from_binary({static_cast<const char *>(data.buf), static_cast<size_t>(data.len)});
+    } catch (std::exception &e) {
+        PyBuffer_Release(&data);
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    PyBuffer_Release(&data);
+    return PyHTPS_wrap_graph(type, std::move(*graph));
+}
+
+static PyObject *PyHTPS_save_binary(PyHTPS *self, PyObject *args) {
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    try {
+        self->graph.save_binary(path);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyHTPS_load_binary(PyTypeObject *type, PyObject *args) {
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    std::optional<htps::HTPS> graph;
+    try {
+        graph = htps::HTPS::load_binary(path);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return PyHTPS_wrap_graph(type, std::move(*graph));
+}
+
+static PyObject *PyHTPS_move_root(PyHTPS *self, PyObject *args) {
+    PyObject *thm;
+    if (!PyArg_ParseTuple(args, "O", &thm))
+        return NULL;
+    if (!PyObject_TypeCheck(thm, &TheoremType)) {
+        PyErr_SetString(PyExc_TypeError, "theorem must be a Theorem object");
+        return NULL;
+    }
+    auto shared_thm = ((PyTheorem *) thm)->cpp_obj;
+    try {
+        self->graph.move_root(shared_thm);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyHTPS_set_seed(PyHTPS *self, PyObject *args) {
+    unsigned long long seed;
+    if (!PyArg_ParseTuple(args, "K", &seed))
+        return NULL;
+    self->graph.set_seed(seed);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyHTPS_set_expansion_cache(PyHTPS *self, PyObject *args) {
+    PyObject *cache;
+    if (!PyArg_ParseTuple(args, "O", &cache))
+        return NULL;
+    if (cache == Py_None) {
+        self->graph.set_expansion_cache(nullptr);
+        Py_RETURN_NONE;
+    }
+    if (!PyObject_TypeCheck(cache, &ExpansionCacheType)) {
+        PyErr_SetString(PyExc_TypeError, "cache must be an ExpansionCache object or None");
+        return NULL;
+    }
+    self->graph.set_expansion_cache(((PyExpansionCache *) cache)->cache);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyHTPS_is_expanding(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *res = self->graph.is_expanding() ? Py_True : Py_False;
+    Py_INCREF(res);
+    return res;
+}
+
+static PyGetSetDef HTPS_getsetters[] = {
+        {"expansions", (getter) PyHTPS_expansions, NULL, "Number of expansions", NULL},
+        {NULL}
+};
+
+static PyMethodDef HTPS_methods[] = {
+        {"theorems_to_expand", (PyCFunction) PyHTPS_theorems_to_expand, METH_NOARGS,  "Returns a list of subsequent theorems to expand"},
+        {"expand_and_backup",  (PyCFunction) PyHTPS_expand_and_backup,  METH_VARARGS, "Expands and backups using the provided list of EnvExpansion objects"},
+        {"proven",             (PyCFunction) PyHTPS_is_proven,          METH_NOARGS,  "Whether the start theorem is proven or not"},
+        {"get_result",         (PyCFunction) PyHTPS_get_result,         METH_NOARGS,  "Returns the result of the HTPS run"},
+        {"harvest",            (PyCFunction) PyHTPS_harvest,            METH_NOARGS,  "Returns the training samples that became available since the last harvest"},
+        {"is_done",            (PyCFunction) PyHTPS_is_done,            METH_NOARGS,  "Whether the HTPS run is done or not"},
+        {"is_expanding",       (PyCFunction) PyHTPS_is_expanding,       METH_NOARGS,  "Whether the HTPS run is still awaiting EnvExpansions or not (in which case new theorems can be requested)"},
+        {"move_root",          (PyCFunction) PyHTPS_move_root,          METH_VARARGS, "Re-roots the search on a descendant theorem, keeping all nodes reachable from it"},
+        {"set_expansion_cache", (PyCFunction) PyHTPS_set_expansion_cache, METH_VARARGS, "Answers theorems expanded before from the given ExpansionCache, None detaches it"},
+        {"set_seed",           (PyCFunction) PyHTPS_set_seed,           METH_VARARGS, "Restarts the random numbers of the search from the given seed"},
+        {"get_json_str",       (PyCFunction) PyHTPS_get_jsonstr,        METH_NOARGS,  "Returns a JSON string representation of the HTPS object"},
+        {"from_json_str",      (PyCFunction) PyHTPS_from_jsonstr,       METH_VARARGS |
+                                                                        METH_CLASS, "Creates a HTPS object from a JSON string"},
+        {"get_binary",         (PyCFunction) PyHTPS_get_binary,         METH_NOARGS,  "Returns a compact binary snapshot of the HTPS object as bytes"},
+        {"from_binary",        (PyCFunction) PyHTPS_from_binary,        METH_VARARGS |
+                                                                        METH_CLASS, "Creates a HTPS object from a binary snapshot"},
+        {"save_binary",        (PyCFunction) PyHTPS_save_binary,        METH_VARARGS, "Writes a binary snapshot of the HTPS object to the given path"},
+        {"load_binary",        (PyCFunction) PyHTPS_load_binary,        METH_VARARGS |
+                                                                        METH_CLASS, "Creates a HTPS object from a binary snapshot file, which is memory-mapped"},
+        {NULL, NULL, 0,                                                             NULL}
+};
+
+static PyTypeObject HTPSType = {
+        PyObject_HEAD_INIT(NULL) "htps.HTPS",
+        sizeof(PyHTPS),
+        0,
+        (destructor) PyHTPS_dealloc,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        Py_TPFLAGS_DEFAULT,
+        "The HyperTreeProofSearch",
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        HTPS_methods,
+        NULL,
+        HTPS_getsetters,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        (initproc) HTPS_init,
+        NULL,
+        (newfunc) HTPS_new,
+};
+
+
+typedef struct {
+    PyObject_HEAD
+    htps::HTPSEngine *engine;
+} PySearchEngine;
+
+static PyObject *SearchEngine_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    auto *self = (PySearchEngine *) type->tp_alloc(type, 0);
+    if (!self) {
+        PyErr_SetString(PyExc_MemoryError, "could not allocate memory");
+        return NULL;
+    }
+    self->engine = nullptr;
+    return (PyObject *) self;
+}
+
+static int SearchEngine_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    auto *py_engine = (PySearchEngine *) self;
+    PyObject *thm, *params;
+    Py_ssize_t queue_capacity = 8, max_batches_in_flight = 2;
+    static char *kwlist[] = {(char *) "theorem", (char *) "params", (char *) "queue_capacity",
+                             (char *) "max_batches_in_flight", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|nn", kwlist, &thm, &params, &queue_capacity,
+                                     &max_batches_in_flight))
+        return -1;
+    if (!PyObject_TypeCheck(thm, &TheoremType)) {
+        PyErr_SetString(PyExc_TypeError, "theorem must be a Theorem object");
+        return -1;
+    }
+    if (!PyObject_TypeCheck(params, &ParamsType)) {
+        PyErr_SetString(PyExc_TypeError, "params must be a SearchParams object");
+        return -1;
+    }
+    if (queue_capacity <= 0 || max_batches_in_flight <= 0) {
+        PyErr_SetString(PyExc_ValueError, "queue_capacity and max_batches_in_flight must be positive");
+        return -1;
+    }
+    if (py_engine->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "SearchEngine is already initialized");
+        return -1;
+    }
+    auto shared_thm = ((PyTheorem *) thm)->cpp_obj;
+    try {
+        py_engine->engine = new htps::HTPSEngine(shared_thm, *((htps::htps_params *) params),
+                                                 static_cast<size_t>(queue_capacity),
+                                                 static_cast<size_t>(max_batches_in_flight));
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+    return 0;
+}
+
+static void SearchEngine_dealloc(PySearchEngine *self) {
+    if (self->engine) {
+        // The search thread might be waiting for the GIL, so it has to be released while joining
+        Py_BEGIN_ALLOW_THREADS
+        self->engine->stop();
+        Py_END_ALLOW_THREADS
+        delete self->engine;
+    }
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static bool SearchEngine_check(PySearchEngine *self) {
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "SearchEngine is not initialized");
+        return false;
+    }
+    return true;
+}
+
+static PyObject *SearchEngine_start(PySearchEngine *self, PyObject *Py_UNUSED(ignored)) {
+    if (!SearchEngine_check(self))
+        return NULL;
+    try {
+        self->engine->start();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *SearchEngine_stop(PySearchEngine *self, PyObject *Py_UNUSED(ignored)) {
+    if (!SearchEngine_check(self))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    self->engine->stop();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject *SearchEngine_get_theorems(PySearchEngine *self, PyObject *Py_UNUSED(ignored)) {
+    if (!SearchEngine_check(self))
+        return NULL;
+    std::optional<std::vector<htps::TheoremPointer>> thms;
+    Py_BEGIN_ALLOW_THREADS
+    thms = self->engine->get_theorems();
+    Py_END_ALLOW_THREADS
+    if (!thms)
+        Py_RETURN_NONE;
+    PyObject *list = PyList_New(thms->size());
+    if (!list)
+        return PyErr_NoMemory();
+    for (size_t i = 0; i < thms->size(); i++) {
+        PyObject *pythm = Theorem_NewFromShared((*thms)[i]);
+        if (!pythm) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, pythm);
+    }
+    return list;
+}
+
+static PyObject *SearchEngine_submit(PySearchEngine *self, PyObject *args) {
+    if (!SearchEngine_check(self))
+        return NULL;
+    PyObject *py_expansions;
+    if (!PyArg_ParseTuple(args, "O", &py_expansions)) {
+        PyErr_SetString(PyExc_TypeError, "submit expects an iterable of EnvExpansion objects");
+        return NULL;
+    }
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+    PyObject *iterator = PyObject_GetIter(py_expansions);
+    if (!iterator) {
+        PyErr_SetString(PyExc_TypeError, "Provided object is not iterable");
+        return NULL;
+    }
+    PyObject *item;
+    while ((item = PyIter_Next(iterator)) != NULL) {
+        if (!PyObject_TypeCheck(item, &EnvExpansionType)) {
+            PyErr_SetString(PyExc_TypeError, "each item in the iterable must be an EnvExpansion object");
+            Py_DECREF(item);
+            Py_DECREF(iterator);
+            return NULL;
+        }
+        // The search thread uses the expansion later on, so the Python object is kept alive until it is done
+        auto *exp = (PyEnvExpansion *) item;
+        expansions.emplace_back(&exp->expansion, [item](htps::env_expansion *) {
+            PyGILState_STATE state = PyGILState_Ensure();
+            Py_DECREF(item);
+            PyGILState_Release(state);
+        });
+    }
+    Py_DECREF(iterator);
+    if (PyErr_Occurred())
+        return NULL;
+    bool accepted;
+    Py_BEGIN_ALLOW_THREADS
+    accepted = self->engine->submit_expansions(std::move(expansions));
+    Py_END_ALLOW_THREADS
+    PyObject *res = accepted ? Py_True : Py_False;
+    Py_INCREF(res);
+    return res;
+}
+
+static PyObject *SearchEngine_get_result(PySearchEngine *self, PyObject *Py_UNUSED(ignored)) {
+    if (!SearchEngine_check(self))
+        return NULL;
+    std::optional<htps::HTPSResult> result;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        result = self->engine->get_result();
+    } catch (std::exception &e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    if (!result)
+        Py_RETURN_NONE;
+    return PyHTPSResult_NewFromResult(std::move(*result));
+}
+
+static PyObject *SearchEngine_is_running(PySearchEngine *self, PyObject *Py_UNUSED(ignored)) {
+    if (!SearchEngine_check(self))
+        return NULL;
+    PyObject *res = self->engine->is_running() ? Py_True : Py_False;
+    Py_INCREF(res);
+    return res;
+}
+
+static PyMethodDef SearchEngine_methods[] = {
+        {"start",        (PyCFunction) SearchEngine_start,        METH_NOARGS,  "Starts the search thread"},
+        {"stop",         (PyCFunction) SearchEngine_stop,         METH_NOARGS,  "Stops the search thread, dropping pending work"},
+        {"get_theorems", (PyCFunction) SearchEngine_get_theorems, METH_NOARGS,  "Blocks until the next batch of theorems to expand is available. Returns None once the search does not need more expansions"},
+        {"submit",       (PyCFunction) SearchEngine_submit,       METH_VARARGS, "Submits EnvExpansion objects for previously requested theorems. Returns False if the engine does not accept expansions anymore"},
+        {"get_result",   (PyCFunction) SearchEngine_get_result,   METH_NOARGS,  "Blocks until the search finished and returns its Result, or None if it was stopped"},
+        {"is_running",   (PyCFunction) SearchEngine_is_running,   METH_NOARGS,  "Whether the search thread is still running"},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject SearchEngineType = {
+        PyObject_HEAD_INIT(NULL) "htps.SearchEngine",
+        sizeof(PySearchEngine),
+        0,
+        (destructor) SearchEngine_dealloc,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        Py_TPFLAGS_DEFAULT,
+        "HyperTreeProofSearch running on a background thread",
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        SearchEngine_methods,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        (initproc) SearchEngine_init,
+        NULL,
+        (newfunc) SearchEngine_new,
+};
+
+
+typedef struct {
+    PyObject_HEAD
+    htps::HTPSScheduler scheduler;
+} PyScheduler;
+
+static PyObject *Scheduler_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    auto *self = (PyScheduler *) type->tp_alloc(type, 0);
+    if (!self) {
+        PyErr_SetString(PyExc_MemoryError, "could not allocate memory");
+        return NULL;
+    }
+    new(&(self->scheduler)) htps::HTPSScheduler();
+    return (PyObject *) self;
+}
+
+static int Scheduler_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    auto *py_scheduler = (PyScheduler *) self;
+    Py_ssize_t max_batch_size = 32;
+    static char *kwlist[] = {(char *) "max_batch_size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", kwlist, &max_batch_size))
+        return -1;
+    if (max_batch_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max_batch_size must be positive");
+        return -1;
+    }
+    py_scheduler->scheduler = htps::HTPSScheduler(static_cast<size_t>(max_batch_size));
+    return 0;
+}
+
+static void Scheduler_dealloc(PyScheduler *self) {
+    self->scheduler.~HTPSScheduler();
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Scheduler_add_search(PyScheduler *self, PyObject *args, PyObject *kwargs) {
+    PyObject *thm, *params;
+    int priority = 0;
+    static char *kwlist[] = {(char *) "theorem", (char *) "params", (char *) "priority", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|i", kwlist, &thm, &params, &priority))
+        return NULL;
+    if (!PyObject_TypeCheck(thm, &TheoremType)) {
+        PyErr_SetString(PyExc_TypeError, "theorem must be a Theorem object");
+        return NULL;
+    }
     if (!PyObject_TypeCheck(params, &ParamsType)) {
         PyErr_SetString(PyExc_TypeError, "params must be a SearchParams object");
-        return -1;
+        return NULL;
     }
-    auto *c_params = (htps::htps_params *) params;
-    auto shared_thm = c_thm->cpp_obj;
-    tree->graph.set_root(shared_thm);
-    tree->graph.set_params(*c_params);
-    return 0;
+    auto shared_thm = ((PyTheorem *) thm)->cpp_obj;
+    size_t id;
+    try {
+        id = self->scheduler.add_search(shared_thm, *((htps::htps_params *) params), priority);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return PyLong_FromSize_t(id);
 }
 
-static PyObject *PyHTPS_theorems_to_expand(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
+static PyObject *Scheduler_theorems_to_expand(PyScheduler *self, PyObject *Py_UNUSED(ignored)) {
     std::vector<htps::TheoremPointer> thms;
     try {
-        thms = self->graph.theorems_to_expand();
+        thms = self->scheduler.theorems_to_expand();
     } catch (std::exception &e) {
         PyErr_SetString(PyExc_RuntimeError, e.what());
         return NULL;
     }
-
     PyObject *list = PyList_New(thms.size());
     if (!list)
         return PyErr_NoMemory();
-
     for (size_t i = 0; i < thms.size(); i++) {
         PyObject *pythm = Theorem_NewFromShared(thms[i]);
         if (!pythm) {
@@ -3116,7 +4303,7 @@ static PyObject *PyHTPS_theorems_to_expand(PyHTPS *self, PyObject *Py_UNUSED(ign
     return list;
 }
 
-static PyObject *PyHTPS_expand_and_backup(PyHTPS *self, PyObject *args) {
+static PyObject *Scheduler_expand_and_backup(PyScheduler *self, PyObject *args) {
     PyObject *py_expansions;
     if (!PyArg_ParseTuple(args, "O", &py_expansions)) {
         PyErr_SetString(PyExc_TypeError, "expand_and_backup expects an iterable of EnvExpansion objects");
@@ -3137,19 +4324,13 @@ static PyObject *PyHTPS_expand_and_backup(PyHTPS *self, PyObject *args) {
             return NULL;
         }
         auto *exp = (PyEnvExpansion *) item;
-        std::shared_ptr<htps::env_expansion> shared_exp(
-                &exp->expansion,
-                [](htps::env_expansion *) {
-                    // no deletion: the memory is owned by the Python object.
-                }
-        );
-        //expansions.push_back(std::make_shared<htps::env_expansion>(exp->expansion));
-        expansions.push_back(shared_exp);
+        // no deletion: the memory is owned by the Python object.
+        expansions.emplace_back(&exp->expansion, [](htps::env_expansion *) {});
         Py_DECREF(item);
     }
     Py_DECREF(iterator);
     try {
-        self->graph.expand_and_backup(expansions);
+        self->scheduler.expand_and_backup(expansions);
     } catch (std::exception &e) {
         PyErr_SetString(PyExc_RuntimeError, e.what());
         return NULL;
@@ -3157,99 +4338,76 @@ static PyObject *PyHTPS_expand_and_backup(PyHTPS *self, PyObject *args) {
     Py_RETURN_NONE;
 }
 
-static PyObject *PyHTPS_is_proven(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
-    PyObject *res = self->graph.is_proven() ? Py_True : Py_False;
-    Py_INCREF(res);
-    return res;
-}
-
-static PyObject *PyHTPS_is_done(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
-    PyObject *res = self->graph.is_done() ? Py_True : Py_False;
-    Py_INCREF(res);
-    return res;
-}
-
-static PyObject *PyHTPS_expansions(PyHTPS *self, void *closure) {
-    return PyLong_FromSize_t(self->graph.num_expansions());
-}
-
-static void PyHTPS_dealloc(PyHTPS *self) {
-    self->graph.~HTPS();
-    Py_TYPE(self)->tp_free((PyObject *) self);
+static PyObject *Scheduler_take_results(PyScheduler *self, PyObject *Py_UNUSED(ignored)) {
+    auto results = self->scheduler.take_results();
+    PyObject *list = PyList_New(results.size());
+    if (!list)
+        return PyErr_NoMemory();
+    for (size_t i = 0; i < results.size(); i++) {
+        PyObject *py_result = PyHTPSResult_NewFromResult(std::move(results[i].second));
+        if (!py_result) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyObject *tuple = Py_BuildValue("(nN)", static_cast<Py_ssize_t>(results[i].first), py_result);
+        if (!tuple) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, tuple);
+    }
+    return list;
 }
 
-static PyObject *PyHTPS_get_result(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
-    htps::HTPSResult result;
-    try {
-        result = self->graph.get_result();
-    } catch (std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+static PyObject *Scheduler_set_expansion_cache(PyScheduler *self, PyObject *args) {
+    PyObject *cache;
+    if (!PyArg_ParseTuple(args, "O", &cache))
         return NULL;
+    if (cache == Py_None) {
+        self->scheduler.set_expansion_cache(nullptr);
+        Py_RETURN_NONE;
     }
-    return PyHTPSResult_NewFromResult(result);
-}
-
-static PyObject *PyHTPS_get_jsonstr(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
-    std::string result;
-    try {
-        result = nlohmann::json(self->graph).dump();
-    } catch (std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+    if (!PyObject_TypeCheck(cache, &ExpansionCacheType)) {
+        PyErr_SetString(PyExc_TypeError, "cache must be an ExpansionCache object or None");
         return NULL;
     }
-    return PyObject_from_string(result);
+    self->scheduler.set_expansion_cache(((PyExpansionCache *) cache)->cache);
+    Py_RETURN_NONE;
 }
 
-static PyObject *PyHTPS_from_jsonstr(PyTypeObject *type, PyObject *args) {
-    const char *json_str;
-    if (!PyArg_ParseTuple(args, "s", &json_str)) {
-        PyErr_SetString(PyExc_TypeError, "from_jsonstr expects a string");
-        return NULL;
-    }
-    try {
-        auto json = nlohmann::json::parse(json_str);
-        auto graph = htps::HTPS::from_json(json);
-        PyObject *obj = HTPS_new(type, NULL, NULL);
-        if (obj == NULL)
-            return NULL;
-        auto *py_graph = (PyHTPS *) obj;
-        py_graph->graph = graph;
-        return obj;
-    } catch (std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
-        return NULL;
-    }
+static PyObject *Scheduler_num_searches(PyScheduler *self, PyObject *Py_UNUSED(ignored)) {
+    return PyLong_FromSize_t(self->scheduler.num_searches());
 }
 
-static PyObject *PyHTPS_is_expanding(PyHTPS *self, PyObject *Py_UNUSED(ignored)) {
-    PyObject *res = self->graph.is_expanding() ? Py_True : Py_False;
+static PyObject *Scheduler_is_done(PyScheduler *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *res = self->scheduler.is_done() ? Py_True : Py_False;
     Py_INCREF(res);
     return res;
 }
 
-static PyGetSetDef HTPS_getsetters[] = {
-        {"expansions", (getter) PyHTPS_expansions, NULL, "Number of expansions", NULL},
-        {NULL}
-};
+static PyObject *Scheduler_is_expanding(PyScheduler *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *res = self->scheduler.is_expanding() ? Py_True : Py_False;
+    Py_INCREF(res);
+    return res;
+}
 
-static PyMethodDef HTPS_methods[] = {
-        {"theorems_to_expand", (PyCFunction) PyHTPS_theorems_to_expand, METH_NOARGS,  "Returns a list of subsequent theorems to expand"},
-        {"expand_and_backup",  (PyCFunction) PyHTPS_expand_and_backup,  METH_VARARGS, "Expands and backups using the provided list of EnvExpansion objects"},
-        {"proven",             (PyCFunction) PyHTPS_is_proven,          METH_NOARGS,  "Whether the start theorem is proven or not"},
-        {"get_result",         (PyCFunction) PyHTPS_get_result,         METH_NOARGS,  "Returns the result of the HTPS run"},
-        {"is_done",            (PyCFunction) PyHTPS_is_done,            METH_NOARGS,  "Whether the HTPS run is done or not"},
-        {"is_expanding",       (PyCFunction) PyHTPS_is_expanding,       METH_NOARGS,  "Whether the HTPS run is still awaiting EnvExpansions or not (in which case new theorems can be requested)"},
-        {"get_json_str",       (PyCFunction) PyHTPS_get_jsonstr,        METH_NOARGS,  "Returns a JSON string representation of the HTPS object"},
-        {"from_json_str",      (PyCFunction) PyHTPS_from_jsonstr,       METH_VARARGS |
-                                                                        METH_CLASS, "Creates a HTPS object from a JSON string"},
-        {NULL, NULL, 0,                                                             NULL}
+static PyMethodDef Scheduler_methods[] = {
+        {"add_search",         (PyCFunction) Scheduler_add_search,         METH_VARARGS | METH_KEYWORDS, "Adds a search for the given theorem and returns its id. Searches with a higher priority are asked for theorems first"},
+        {"theorems_to_expand", (PyCFunction) Scheduler_theorems_to_expand, METH_NOARGS,                  "Returns the combined batch of theorems to expand over all searches"},
+        {"expand_and_backup",  (PyCFunction) Scheduler_expand_and_backup,  METH_VARARGS,                 "Routes the EnvExpansions back to the searches that requested them"},
+        {"take_results",       (PyCFunction) Scheduler_take_results,       METH_NOARGS,                  "Returns (id, Result) tuples for all searches that finished since the last call"},
+        {"set_expansion_cache", (PyCFunction) Scheduler_set_expansion_cache, METH_VARARGS,               "Attaches the ExpansionCache to all current and future searches, None detaches it"},
+        {"num_searches",       (PyCFunction) Scheduler_num_searches,       METH_NOARGS,                  "Number of searches that have not finished yet"},
+        {"is_done",            (PyCFunction) Scheduler_is_done,            METH_NOARGS,                  "Whether all searches finished"},
+        {"is_expanding",       (PyCFunction) Scheduler_is_expanding,       METH_NOARGS,                  "Whether some handed out theorems have not been expanded yet"},
+        {NULL, NULL, 0, NULL}
 };
 
-static PyTypeObject HTPSType = {
-        PyObject_HEAD_INIT(NULL) "htps.HTPS",
-        sizeof(PyHTPS),
+static PyTypeObject SchedulerType = {
+        PyObject_HEAD_INIT(NULL) "htps.Scheduler",
+        sizeof(PyScheduler),
         0,
-        (destructor) PyHTPS_dealloc,
+        (destructor) Scheduler_dealloc,
         NULL,
         NULL,
         NULL,
@@ -3265,24 +4423,24 @@ static PyTypeObject HTPSType = {
         NULL,
         NULL,
         Py_TPFLAGS_DEFAULT,
-        "The HyperTreeProofSearch",
+        "Pools the theorems to expand of many HyperTreeProofSearches into combined batches",
         NULL,
         NULL,
         NULL,
         NULL,
         NULL,
         NULL,
-        HTPS_methods,
+        Scheduler_methods,
         NULL,
-        HTPS_getsetters,
         NULL,
         NULL,
         NULL,
         NULL,
         NULL,
-        (initproc) HTPS_init,
         NULL,
-        (newfunc) HTPS_new,
+        (initproc) Scheduler_init,
+        NULL,
+        (newfunc) Scheduler_new,
 };
 
 
@@ -3343,50 +4501,217 @@ PyInit_htps(void) {
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
         Py_DECREF(q_value_solved);
-        Py_XDECREF(node_mask);
+        Py_XDECREF(node_mask);
+        return NULL;
+    }
+    if (PyModule_AddObject(m, "NodeMask", node_mask) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        return NULL;
+    }
+
+    PyObject *metric = make_metric(m, enum_mod);
+    if (metric == NULL) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_XDECREF(metric);
+        return NULL;
+    }
+    if (PyModule_AddObject(m, "Metric", metric) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        return NULL;
+    }
+
+    PyObject *in_proof = make_in_proof(m, enum_mod);
+    if (in_proof == NULL) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_XDECREF(in_proof);
+        return NULL;
+    }
+    if (PyModule_AddObject(m, "InProof", in_proof) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        return NULL;
+    }
+
+    if (PyType_Ready(&ParamsType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        return NULL;
+    }
+    Py_INCREF(&ParamsType);
+    if (PyModule_AddObject(m, "SearchParams", (PyObject *) &ParamsType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_XDECREF(&ParamsType);
+        return NULL;
+    }
+
+    if (PyType_Ready(&HypothesisType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        return NULL;
+    }
+
+    Py_INCREF(&HypothesisType);
+    if (PyModule_AddObject(m, "Hypothesis", (PyObject *) &HypothesisType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_XDECREF(&HypothesisType);
+        return NULL;
+    }
+
+    if (PyType_Ready(&TacticType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        return NULL;
+    }
+
+    Py_INCREF(&TacticType);
+    if (PyModule_AddObject(m, "Tactic", (PyObject *) &TacticType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_XDECREF(&TacticType);
+        return NULL;
+    }
+
+    if (PyType_Ready(&ContextType) < 0) {
+        Py_DECREF(m);
+        Py_DECREF(enum_mod);
+        Py_DECREF(policy_type);
+        Py_DECREF(q_value_solved);
+        Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
         return NULL;
     }
-    if (PyModule_AddObject(m, "NodeMask", node_mask) < 0) {
+
+    Py_INCREF(&ContextType);
+    if (PyModule_AddObject(m, "Context", (PyObject *) &ContextType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
         Py_DECREF(q_value_solved);
         Py_DECREF(node_mask);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_XDECREF(&ContextType);
         return NULL;
     }
 
-    PyObject *metric = make_metric(m, enum_mod);
-    if (metric == NULL) {
+    if (PyType_Ready(&TheoremType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
         Py_DECREF(q_value_solved);
         Py_DECREF(node_mask);
-        Py_XDECREF(metric);
+        Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
         return NULL;
     }
-    if (PyModule_AddObject(m, "Metric", metric) < 0) {
+
+    Py_INCREF(&TheoremType);
+    if (PyModule_AddObject(m, "Theorem", (PyObject *) &TheoremType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
         Py_DECREF(q_value_solved);
         Py_DECREF(node_mask);
         Py_DECREF(metric);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_XDECREF(&TheoremType);
         return NULL;
     }
 
-    PyObject *in_proof = make_in_proof(m, enum_mod);
-    if (in_proof == NULL) {
+    if (PyType_Ready(&EnvEffectType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
         Py_DECREF(q_value_solved);
         Py_DECREF(node_mask);
         Py_DECREF(metric);
-        Py_XDECREF(in_proof);
+        Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
         return NULL;
     }
-    if (PyModule_AddObject(m, "InProof", in_proof) < 0) {
+
+    Py_INCREF(&EnvEffectType);
+    if (PyModule_AddObject(m, "EnvEffect", (PyObject *) &EnvEffectType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3394,10 +4719,17 @@ PyInit_htps(void) {
         Py_DECREF(node_mask);
         Py_DECREF(metric);
         Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_XDECREF(&EnvEffectType);
         return NULL;
     }
 
-    if (PyType_Ready(&ParamsType) < 0) {
+
+    if (PyType_Ready(&EnvExpansionType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3405,10 +4737,17 @@ PyInit_htps(void) {
         Py_DECREF(node_mask);
         Py_DECREF(metric);
         Py_DECREF(in_proof);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
         return NULL;
     }
-    Py_INCREF(&ParamsType);
-    if (PyModule_AddObject(m, "SearchParams", (PyObject *) &ParamsType) < 0) {
+
+    Py_INCREF(&EnvExpansionType);
+    if (PyModule_AddObject(m, "EnvExpansion", (PyObject *) &EnvExpansionType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3416,11 +4755,17 @@ PyInit_htps(void) {
         Py_DECREF(node_mask);
         Py_DECREF(metric);
         Py_DECREF(in_proof);
-        Py_XDECREF(&ParamsType);
+        Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_XDECREF(&EnvExpansionType);
         return NULL;
     }
 
-    if (PyType_Ready(&HypothesisType) < 0) {
+    if (PyType_Ready(&PyHTPSSampleEffectType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3429,11 +4774,17 @@ PyInit_htps(void) {
         Py_DECREF(metric);
         Py_DECREF(in_proof);
         Py_DECREF(&ParamsType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
         return NULL;
     }
 
-    Py_INCREF(&HypothesisType);
-    if (PyModule_AddObject(m, "Hypothesis", (PyObject *) &HypothesisType) < 0) {
+    Py_INCREF(&PyHTPSSampleEffectType);
+    if (PyModule_AddObject(m, "SampleEffect", (PyObject *) &PyHTPSSampleEffectType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3442,11 +4793,17 @@ PyInit_htps(void) {
         Py_DECREF(metric);
         Py_DECREF(in_proof);
         Py_DECREF(&ParamsType);
-        Py_XDECREF(&HypothesisType);
+        Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_XDECREF(&PyHTPSSampleEffectType);
         return NULL;
     }
 
-    if (PyType_Ready(&TacticType) < 0) {
+    if (PyType_Ready(&PyHTPSSampleCriticType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3456,11 +4813,17 @@ PyInit_htps(void) {
         Py_DECREF(in_proof);
         Py_DECREF(&ParamsType);
         Py_DECREF(&HypothesisType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
         return NULL;
     }
 
-    Py_INCREF(&TacticType);
-    if (PyModule_AddObject(m, "Tactic", (PyObject *) &TacticType) < 0) {
+    Py_INCREF(&PyHTPSSampleCriticType);
+    if (PyModule_AddObject(m, "SampleCritic", (PyObject *) &PyHTPSSampleCriticType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3470,11 +4833,17 @@ PyInit_htps(void) {
         Py_DECREF(in_proof);
         Py_DECREF(&ParamsType);
         Py_DECREF(&HypothesisType);
-        Py_XDECREF(&TacticType);
+        Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_XDECREF(&PyHTPSSampleCriticType);
         return NULL;
     }
 
-    if (PyType_Ready(&ContextType) < 0) {
+    if (PyType_Ready(&PyHTPSSampleTacticsType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3485,11 +4854,17 @@ PyInit_htps(void) {
         Py_DECREF(&ParamsType);
         Py_DECREF(&HypothesisType);
         Py_DECREF(&TacticType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
         return NULL;
     }
 
-    Py_INCREF(&ContextType);
-    if (PyModule_AddObject(m, "Context", (PyObject *) &ContextType) < 0) {
+    Py_INCREF(&PyHTPSSampleTacticsType);
+    if (PyModule_AddObject(m, "SampleTactics", (PyObject *) &PyHTPSSampleTacticsType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3500,11 +4875,17 @@ PyInit_htps(void) {
         Py_DECREF(&ParamsType);
         Py_DECREF(&HypothesisType);
         Py_DECREF(&TacticType);
-        Py_XDECREF(&ContextType);
+        Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_XDECREF(&PyHTPSSampleTacticsType);
         return NULL;
     }
 
-    if (PyType_Ready(&TheoremType) < 0) {
+    if (PyType_Ready(&PyProofType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3516,11 +4897,17 @@ PyInit_htps(void) {
         Py_DECREF(&HypothesisType);
         Py_DECREF(&TacticType);
         Py_DECREF(&ContextType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
         return NULL;
     }
 
-    Py_INCREF(&TheoremType);
-    if (PyModule_AddObject(m, "Theorem", (PyObject *) &TheoremType) < 0) {
+    Py_INCREF(&PyProofType);
+    if (PyModule_AddObject(m, "Proof", (PyObject *) &PyProofType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3532,11 +4919,17 @@ PyInit_htps(void) {
         Py_DECREF(&HypothesisType);
         Py_DECREF(&TacticType);
         Py_DECREF(&ContextType);
-        Py_XDECREF(&TheoremType);
+        Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_XDECREF(&PyProofType);
         return NULL;
     }
 
-    if (PyType_Ready(&EnvEffectType) < 0) {
+    if (PyType_Ready(&PyHTPSResultType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3549,11 +4942,17 @@ PyInit_htps(void) {
         Py_DECREF(&TacticType);
         Py_DECREF(&ContextType);
         Py_DECREF(&TheoremType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
         return NULL;
     }
 
-    Py_INCREF(&EnvEffectType);
-    if (PyModule_AddObject(m, "EnvEffect", (PyObject *) &EnvEffectType) < 0) {
+    Py_INCREF(&PyHTPSResultType);
+    if (PyModule_AddObject(m, "Result", (PyObject *) &PyHTPSResultType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3566,12 +4965,17 @@ PyInit_htps(void) {
         Py_DECREF(&TacticType);
         Py_DECREF(&ContextType);
         Py_DECREF(&TheoremType);
-        Py_XDECREF(&EnvEffectType);
+        Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_XDECREF(&PyHTPSResultType);
         return NULL;
     }
 
-
-    if (PyType_Ready(&EnvExpansionType) < 0) {
+    if (PyType_Ready(&HTPSType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3585,11 +4989,17 @@ PyInit_htps(void) {
         Py_DECREF(&ContextType);
         Py_DECREF(&TheoremType);
         Py_DECREF(&EnvEffectType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
         return NULL;
     }
 
-    Py_INCREF(&EnvExpansionType);
-    if (PyModule_AddObject(m, "EnvExpansion", (PyObject *) &EnvExpansionType) < 0) {
+    Py_INCREF(&HTPSType);
+    if (PyModule_AddObject(m, "HTPS", (PyObject *) &HTPSType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3603,11 +5013,17 @@ PyInit_htps(void) {
         Py_DECREF(&ContextType);
         Py_DECREF(&TheoremType);
         Py_DECREF(&EnvEffectType);
-        Py_XDECREF(&EnvExpansionType);
+        Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_XDECREF(&HTPSType);
         return NULL;
     }
 
-    if (PyType_Ready(&PyHTPSSampleEffectType) < 0) {
+    if (PyType_Ready(&SearchEngineType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3622,11 +5038,17 @@ PyInit_htps(void) {
         Py_DECREF(&TheoremType);
         Py_DECREF(&EnvEffectType);
         Py_DECREF(&EnvExpansionType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
         return NULL;
     }
 
-    Py_INCREF(&PyHTPSSampleEffectType);
-    if (PyModule_AddObject(m, "SampleEffect", (PyObject *) &PyHTPSSampleEffectType) < 0) {
+    Py_INCREF(&SearchEngineType);
+    if (PyModule_AddObject(m, "SearchEngine", (PyObject *) &SearchEngineType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3641,11 +5063,17 @@ PyInit_htps(void) {
         Py_DECREF(&TheoremType);
         Py_DECREF(&EnvEffectType);
         Py_DECREF(&EnvExpansionType);
-        Py_XDECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_XDECREF(&SearchEngineType);
         return NULL;
     }
 
-    if (PyType_Ready(&PyHTPSSampleCriticType) < 0) {
+    if (PyType_Ready(&SchedulerType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3661,11 +5089,17 @@ PyInit_htps(void) {
         Py_DECREF(&EnvEffectType);
         Py_DECREF(&EnvExpansionType);
         Py_DECREF(&PyHTPSSampleEffectType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
         return NULL;
     }
 
-    Py_INCREF(&PyHTPSSampleCriticType);
-    if (PyModule_AddObject(m, "SampleCritic", (PyObject *) &PyHTPSSampleCriticType) < 0) {
+    Py_INCREF(&SchedulerType);
+    if (PyModule_AddObject(m, "Scheduler", (PyObject *) &SchedulerType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3681,11 +5115,17 @@ PyInit_htps(void) {
         Py_DECREF(&EnvEffectType);
         Py_DECREF(&EnvExpansionType);
         Py_DECREF(&PyHTPSSampleEffectType);
-        Py_XDECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_XDECREF(&SchedulerType);
         return NULL;
     }
 
-    if (PyType_Ready(&PyHTPSSampleTacticsType) < 0) {
+    if (PyType_Ready(&ExpansionCacheType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3702,11 +5142,17 @@ PyInit_htps(void) {
         Py_DECREF(&EnvExpansionType);
         Py_DECREF(&PyHTPSSampleEffectType);
         Py_DECREF(&PyHTPSSampleCriticType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
         return NULL;
     }
 
-    Py_INCREF(&PyHTPSSampleTacticsType);
-    if (PyModule_AddObject(m, "SampleTactics", (PyObject *) &PyHTPSSampleTacticsType) < 0) {
+    Py_INCREF(&ExpansionCacheType);
+    if (PyModule_AddObject(m, "ExpansionCache", (PyObject *) &ExpansionCacheType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3723,11 +5169,17 @@ PyInit_htps(void) {
         Py_DECREF(&EnvExpansionType);
         Py_DECREF(&PyHTPSSampleEffectType);
         Py_DECREF(&PyHTPSSampleCriticType);
-        Py_XDECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_XDECREF(&ExpansionCacheType);
         return NULL;
     }
 
-    if (PyType_Ready(&PyProofType) < 0) {
+    if (PyType_Ready(&ColumnBufferType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3745,11 +5197,17 @@ PyInit_htps(void) {
         Py_DECREF(&PyHTPSSampleEffectType);
         Py_DECREF(&PyHTPSSampleCriticType);
         Py_DECREF(&PyHTPSSampleTacticsType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_DECREF(&ExpansionCacheType);
         return NULL;
     }
 
-    Py_INCREF(&PyProofType);
-    if (PyModule_AddObject(m, "Proof", (PyObject *) &PyProofType) < 0) {
+    Py_INCREF(&ColumnBufferType);
+    if (PyModule_AddObject(m, "ColumnBuffer", (PyObject *) &ColumnBufferType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3767,11 +5225,17 @@ PyInit_htps(void) {
         Py_DECREF(&PyHTPSSampleEffectType);
         Py_DECREF(&PyHTPSSampleCriticType);
         Py_DECREF(&PyHTPSSampleTacticsType);
-        Py_XDECREF(&PyProofType);
+        Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_DECREF(&ExpansionCacheType);
+        Py_XDECREF(&ColumnBufferType);
         return NULL;
     }
 
-    if (PyType_Ready(&PyHTPSResultType) < 0) {
+    if (PyType_Ready(&ShardWriterType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3790,11 +5254,17 @@ PyInit_htps(void) {
         Py_DECREF(&PyHTPSSampleCriticType);
         Py_DECREF(&PyHTPSSampleTacticsType);
         Py_DECREF(&PyProofType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_DECREF(&ExpansionCacheType);
+        Py_DECREF(&ColumnBufferType);
         return NULL;
     }
 
-    Py_INCREF(&PyHTPSResultType);
-    if (PyModule_AddObject(m, "Result", (PyObject *) &PyHTPSResultType) < 0) {
+    Py_INCREF(&ShardWriterType);
+    if (PyModule_AddObject(m, "ShardWriter", (PyObject *) &ShardWriterType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3813,11 +5283,17 @@ PyInit_htps(void) {
         Py_DECREF(&PyHTPSSampleCriticType);
         Py_DECREF(&PyHTPSSampleTacticsType);
         Py_DECREF(&PyProofType);
-        Py_XDECREF(&PyHTPSResultType);
+        Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_DECREF(&ExpansionCacheType);
+        Py_DECREF(&ColumnBufferType);
+        Py_XDECREF(&ShardWriterType);
         return NULL;
     }
 
-    if (PyType_Ready(&HTPSType) < 0) {
+    if (PyType_Ready(&ShardReaderType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3837,11 +5313,17 @@ PyInit_htps(void) {
         Py_DECREF(&PyHTPSSampleTacticsType);
         Py_DECREF(&PyProofType);
         Py_DECREF(&PyHTPSResultType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_DECREF(&ExpansionCacheType);
+        Py_DECREF(&ColumnBufferType);
+        Py_DECREF(&ShardWriterType);
         return NULL;
     }
 
-    Py_INCREF(&HTPSType);
-    if (PyModule_AddObject(m, "HTPS", (PyObject *) &HTPSType) < 0) {
+    Py_INCREF(&ShardReaderType);
+    if (PyModule_AddObject(m, "ShardReader", (PyObject *) &ShardReaderType) < 0) {
         Py_DECREF(m);
         Py_DECREF(enum_mod);
         Py_DECREF(policy_type);
@@ -3861,7 +5343,13 @@ PyInit_htps(void) {
         Py_DECREF(&PyHTPSSampleTacticsType);
         Py_DECREF(&PyProofType);
         Py_DECREF(&PyHTPSResultType);
-        Py_XDECREF(&HTPSType);
+        Py_DECREF(&HTPSType);
+        Py_DECREF(&SearchEngineType);
+        Py_DECREF(&SchedulerType);
+        Py_DECREF(&ExpansionCacheType);
+        Py_DECREF(&ColumnBufferType);
+        Py_DECREF(&ShardWriterType);
+        Py_XDECREF(&ShardReaderType);
         return NULL;
     }
 
@@ -4,15 +4,17 @@ import os
 module = Extension(
     "htps",
     sources=[
-        "python/htps.cpp", "src/graph/htps.cpp", "src/graph/base.cpp",
-        "src/graph/graph.cpp", "src/env/core.cpp", "src/model/policy.cpp"
+        "python/htps.cpp", "src/graph/htps.cpp", "src/graph/engine.cpp", "src/graph/scheduler.cpp",
+        "src/graph/budget.cpp", "src/graph/columns.cpp", "src/graph/shard.cpp", "src/graph/snapshot.cpp", "src/graph/base.cpp", "src/graph/graph.cpp", "src/env/core.cpp", "src/env/cache.cpp",
+        "src/model/policy.cpp", "src/model/kernels.cpp", "src/util/concurrency.cpp", "src/util/binary.cpp"
     ],
     include_dirs=["src", "external/glob/single_include"],
     runtime_library_dirs=[],
     libraries=[],
     extra_compile_args=["-std=c++20", "-O2", "-pedantic", "-DPYTHON_BINDINGS"],
     extra_link_args=[],
-    define_macros=[],
+    # HTPS_FLOAT_STATS=1 pip3 install . stores the per-tactic statistics of the search in single precision
+    define_macros=[("HTPS_FLOAT_STATS", None)] if os.environ.get("HTPS_FLOAT_STATS") else [],
 )
 
 directory = os.path.abspath(os.path.dirname(__file__))
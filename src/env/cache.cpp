@@ -0,0 +1,248 @@
+#include "cache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace htps;
+
+namespace {
+    /* The file starts with the magic, followed by records of the form
+     * [uint64 key length][key][uint64 payload length][payload], where the payload is the MessagePack encoding of the
+     * expansion. Lengths are stored in native byte order, cache files are not meant to be moved between machines. */
+    constexpr char MAGIC[] = "HTPSEXC1";
+    constexpr size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+    std::string encode_record(const std::string &key, const std::string &payload) {
+        std::string record;
+        uint64_t key_length = key.size();
+        uint64_t payload_length = payload.size();
+        record.append(reinterpret_cast<const char *>(&key_length), sizeof(key_length));
+        record.append(key);
+        record.append(reinterpret_cast<const char *>(&payload_length), sizeof(payload_length));
+        record.append(payload);
+        return record;
+    }
+
+    std::string encode_expansion(const env_expansion &expansion) {
+        std::vector<uint8_t> bytes = nlohmann::json::to_msgpack(nlohmann::json(expansion));
+        return {bytes.begin(), bytes.end()};
+    }
+}
+
+ExpansionCache::ExpansionCache(size_t capacity) : entries(), index(), capacity(capacity), hits(0), misses(0), path(),
+                                                  fd(-1), mapped(nullptr), mapped_size(0), records(0) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Cache capacity must be positive");
+    }
+}
+
+ExpansionCache::ExpansionCache(const std::string &path, size_t capacity) : ExpansionCache(capacity) {
+    this->path = path;
+    open_file();
+    load_records();
+    maybe_compact();
+}
+
+ExpansionCache::~ExpansionCache() {
+    close_file();
+}
+
+void ExpansionCache::open_file() {
+    fd = ::open(path->c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open cache file " + *path + ": " + std::strerror(errno));
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        close_file();
+        throw std::runtime_error("Could not read cache file " + *path);
+    }
+    mapped_size = info.st_size;
+    if (mapped_size == 0) {
+        if (::write(fd, MAGIC, MAGIC_SIZE) != static_cast<ssize_t>(MAGIC_SIZE)) {
+            close_file();
+            throw std::runtime_error("Could not write cache file " + *path);
+        }
+        return;
+    }
+    void *mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapped_size = 0;
+        close_file();
+        throw std::runtime_error("Could not map cache file " + *path);
+    }
+    mapped = static_cast<const char *>(mapping);
+    if (mapped_size < MAGIC_SIZE || std::memcmp(mapped, MAGIC, MAGIC_SIZE) != 0) {
+        close_file();
+        throw std::runtime_error(*path + " is not an expansion cache file");
+    }
+}
+
+void ExpansionCache::close_file() {
+    if (mapped) {
+        munmap(const_cast<char *>(mapped), mapped_size);
+        mapped = nullptr;
+        mapped_size = 0;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void ExpansionCache::load_records() {
+    size_t position = MAGIC_SIZE;
+    while (position < mapped_size) {
+        uint64_t key_length, payload_length;
+        if (mapped_size - position < sizeof(key_length))
+            break;
+        std::memcpy(&key_length, mapped + position, sizeof(key_length));
+        size_t key_offset = position + sizeof(key_length);
+        if (key_length > mapped_size - key_offset || mapped_size - key_offset - key_length < sizeof(payload_length))
+            break;
+        std::memcpy(&payload_length, mapped + key_offset + key_length, sizeof(payload_length));
+        size_t payload_offset = key_offset + key_length + sizeof(payload_length);
+        if (mapped_size - payload_offset < payload_length)
+            break;
+        // Later records of the same goal replace earlier ones
+        insert_entry({std::string(mapped + key_offset, key_length), nullptr, payload_offset, payload_length});
+        records++;
+        position = payload_offset + payload_length;
+    }
+    if (position < mapped_size) {
+        // The last record was only written partially, drop it so that new records are appended to a valid file
+        if (ftruncate(fd, position) != 0) {
+            throw std::runtime_error("Could not repair cache file " + *path);
+        }
+    }
+}
+
+void ExpansionCache::append_record(const std::string &key, const std::string &payload) {
+    std::string record = encode_record(key, payload);
+    if (::write(fd, record.data(), record.size()) != static_cast<ssize_t>(record.size())) {
+        throw std::runtime_error("Could not write cache file " + *path);
+    }
+    records++;
+}
+
+void ExpansionCache::insert_entry(Entry entry) {
+    auto existing = index.find(entry.key);
+    if (existing != index.end()) {
+        entries.erase(existing->second);
+        index.erase(existing);
+    }
+    entries.push_front(std::move(entry));
+    index.emplace(entries.front().key, entries.begin());
+    evict();
+}
+
+void ExpansionCache::evict() {
+    while (entries.size() > capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+std::shared_ptr<env_expansion> ExpansionCache::lookup(const TheoremPointer &thm) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(thm->unique_string);
+    if (it == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    Entry &entry = entries.front();
+    if (!entry.expansion) {
+        auto j = nlohmann::json::from_msgpack(mapped + entry.offset, mapped + entry.offset + entry.length);
+        entry.expansion = std::make_shared<const env_expansion>(env_expansion::from_json(j));
+    }
+    auto result = std::make_shared<env_expansion>(*entry.expansion);
+    result->thm = thm;
+    return result;
+}
+
+void ExpansionCache::insert(const std::shared_ptr<env_expansion> &expansion) {
+    if (expansion->is_error())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::string &key = expansion->thm->unique_string;
+    if (path)
+        append_record(key, encode_expansion(*expansion));
+    // Entries that are not part of the mapping have a length of 0
+    insert_entry({key, std::make_shared<const env_expansion>(*expansion), 0, 0});
+    maybe_compact();
+}
+
+void ExpansionCache::compact() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!path)
+        return;
+    compact_file();
+}
+
+void ExpansionCache::maybe_compact() {
+    // Rewriting takes time linear in the live entries, which amortizes over the dead records that triggered it
+    if (path && records - entries.size() > entries.size())
+        compact_file();
+}
+
+void ExpansionCache::compact_file() {
+    std::string tmp_path = *path + ".tmp";
+    std::vector<std::pair<size_t, size_t>> locations;
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Could not open " + tmp_path);
+        }
+        file.write(MAGIC, MAGIC_SIZE);
+        size_t position = MAGIC_SIZE;
+        // Least recently used first, so that reloading the file restores the order
+        for (auto it = entries.rbegin(); it != entries.rend(); it++) {
+            std::string payload = it->length > 0 ? std::string(mapped + it->offset, it->length)
+                                                 : encode_expansion(*it->expansion);
+            std::string record = encode_record(it->key, payload);
+            locations.emplace_back(position + record.size() - payload.size(), payload.size());
+            file.write(record.data(), static_cast<std::streamsize>(record.size()));
+            position += record.size();
+        }
+        if (!file.good()) {
+            throw std::runtime_error("Error writing to file: " + tmp_path);
+        }
+    }
+    close_file();
+    if (std::rename(tmp_path.c_str(), path->c_str()) != 0) {
+        // The old file is still intact, keep using it
+        open_file();
+        throw std::runtime_error("Could not replace cache file " + *path);
+    }
+    open_file();
+    size_t i = 0;
+    for (auto it = entries.rbegin(); it != entries.rend(); it++, i++) {
+        it->offset = locations[i].first;
+        it->length = locations[i].second;
+    }
+    records = entries.size();
+}
+
+size_t ExpansionCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t ExpansionCache::get_hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+size_t ExpansionCache::get_misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
@@ -0,0 +1,95 @@
+#ifndef HTPS_CACHE_H
+#define HTPS_CACHE_H
+
+#include "core.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace htps {
+
+    /* Cache of environment expansions, shared by any number of searches and keyed by the unique string of the goal.
+     * Goals that recur across searches, or across repeated attempts on the same theorem, are answered from the cache
+     * instead of going back to the model and the environment. At most capacity goals are kept, the least recently used
+     * ones are evicted first. Expansions with an error are never cached, as these are often transient (e.g. timeouts).
+     *
+     * Optionally, the cache is backed by a file. Every insertion is appended to it, so cached goals survive the
+     * process. Upon opening, the file is memory mapped and only indexed, expansions are decoded on their first hit.
+     * compact rewrites the file with the live entries only, in least recently used order, so that reopening it
+     * restores the order of evictions as well. It runs automatically whenever the file holds more records of evicted or
+     * replaced goals than live ones, so the file holds at most about twice as many records as there are live goals.
+     * Cached expansions share their theorems with the search that produced them, theorems restored from the file
+     * carry no metadata.
+     * */
+    class ExpansionCache {
+    private:
+        struct Entry {
+            std::string key;
+            std::shared_ptr<const env_expansion> expansion; // Empty while the expansion has only been mapped
+            size_t offset;
+            size_t length;
+        };
+
+        mutable std::mutex mutex;
+        std::list<Entry> entries; // Most recently used at the front
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t capacity;
+        size_t hits;
+        size_t misses;
+        std::optional<std::string> path;
+        int fd;
+        const char *mapped; // Contents of the file at the time it was opened
+        size_t mapped_size;
+        size_t records; // Records in the file, including the ones of evicted or replaced goals
+
+        void open_file();
+
+        void close_file();
+
+        void load_records();
+
+        void append_record(const std::string &key, const std::string &payload);
+
+        void insert_entry(Entry entry);
+
+        void evict();
+
+        // Compacts once the dead records outnumber the live ones
+        void maybe_compact();
+
+        void compact_file();
+
+    public:
+        explicit ExpansionCache(size_t capacity);
+
+        ExpansionCache(const std::string &path, size_t capacity);
+
+        ExpansionCache(const ExpansionCache &) = delete;
+
+        ExpansionCache &operator=(const ExpansionCache &) = delete;
+
+        ~ExpansionCache();
+
+        /* Returns the cached expansion of a goal with the same unique string as thm, rewritten to refer to thm.
+         * Returns nullptr on a miss. */
+        std::shared_ptr<env_expansion> lookup(const TheoremPointer &thm);
+
+        void insert(const std::shared_ptr<env_expansion> &expansion);
+
+        /* Rewrites the backing file with the live entries only. Does nothing for caches without a file. */
+        void compact();
+
+        size_t size() const;
+
+        size_t get_hits() const;
+
+        size_t get_misses() const;
+    };
+}
+
+#endif //HTPS_CACHE_H
@@ -0,0 +1,93 @@
+#include "budget.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+using namespace htps;
+
+TimeBudget::TimeBudget(size_t budget_ms) : budget_ms(static_cast<double>(budget_ms)), start(), round_start(),
+                                           round_cost_ms(0.0), round_theorems(0), expansion_ms(), wall_ratio(),
+                                           theorem_wall_ms(), theorems_per_descent() {
+    if (budget_ms == 0) {
+        throw std::invalid_argument("Time budget must be positive");
+    }
+}
+
+void TimeBudget::smooth(std::optional<double> &average, double observation) {
+    if (average)
+        *average = SMOOTHING * observation + (1 - SMOOTHING) * *average;
+    else
+        average = observation;
+}
+
+double TimeBudget::milliseconds(Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+double TimeBudget::elapsed_ms(Clock::time_point now) const {
+    if (!start)
+        return 0.0;
+    return milliseconds(now - *start);
+}
+
+bool TimeBudget::expired(Clock::time_point now) const {
+    return start && elapsed_ms(now) >= budget_ms;
+}
+
+double TimeBudget::expected_batch_ms(size_t descents) const {
+    double theorems = static_cast<double>(descents) * theorems_per_descent.value_or(1.0);
+    if (expansion_ms && *expansion_ms > 0)
+        return theorems * *expansion_ms * wall_ratio.value_or(1.0);
+    if (theorem_wall_ms)
+        return theorems * *theorem_wall_ms;
+    return 0.0;
+}
+
+size_t TimeBudget::batch_size(size_t max_descents, Clock::time_point now) {
+    if (!start)
+        start = now;
+    double remaining_ms = budget_ms - elapsed_ms(now);
+    if (remaining_ms <= 0)
+        return 0;
+    double descent_ms = expected_batch_ms(1);
+    if (descent_ms <= 0)
+        return max_descents;
+    double fitting = std::floor(remaining_ms / descent_ms);
+    if (fitting >= static_cast<double>(max_descents))
+        return max_descents;
+    return static_cast<size_t>(fitting);
+}
+
+void TimeBudget::record_batch(size_t descents, size_t theorems, Clock::time_point now) {
+    if (descents == 0)
+        return;
+    if (!round_start) {
+        round_start = now;
+        round_cost_ms = 0.0;
+        round_theorems = 0;
+    }
+    round_theorems += theorems;
+    smooth(theorems_per_descent, static_cast<double>(theorems) / static_cast<double>(descents));
+}
+
+void TimeBudget::record_expansions(const std::vector<std::shared_ptr<env_expansion>> &expansions) {
+    for (const auto &expansion: expansions) {
+        double env_ms = std::accumulate(expansion->env_durations.begin(), expansion->env_durations.end(), 0.0);
+        double cost_ms = std::max(static_cast<double>(expansion->expander_duration),
+                                  static_cast<double>(expansion->generation_duration) + env_ms);
+        smooth(expansion_ms, cost_ms);
+        round_cost_ms += cost_ms;
+    }
+}
+
+void TimeBudget::end_round(Clock::time_point now) {
+    if (!round_start)
+        return;
+    double wall_ms = milliseconds(now - *round_start);
+    if (round_cost_ms > 0)
+        smooth(wall_ratio, wall_ms / round_cost_ms);
+    if (round_theorems > 0)
+        smooth(theorem_wall_ms, wall_ms / static_cast<double>(round_theorems));
+    round_start.reset();
+}
@@ -0,0 +1,70 @@
+#ifndef HTPS_BUDGET_H
+#define HTPS_BUDGET_H
+
+#include "../env/core.h"
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace htps {
+
+    /* Wall-clock budget of a single search, together with a model of how long a batch takes to come back.
+     * The cost of an expansion is taken from the durations reported in the env expansions, i.e. the larger of
+     * expander_duration and generation_duration plus the sum of env_durations, in milliseconds. Since expanders usually
+     * work on a batch in parallel, the reported costs are scaled by the ratio of the wall-clock time of a round (from
+     * handing out the first batch until no expansion is outstanding anymore) to the costs reported in that round.
+     * Expanders that do not report durations are modelled by the wall-clock time of a round per handed out theorem.
+     * All estimates are exponential moving averages, so the model follows changes in the load of the expander.
+     *
+     * batch_size limits the number of descents of the next batch such that the batch is expected to come back before
+     * the deadline. Once not even a single descent fits, the search should stop selecting.
+     * The clock starts with the first call to batch_size.
+     * */
+    class TimeBudget {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        static constexpr double SMOOTHING = 0.3; // Weight of the newest observation in the moving averages
+
+        double budget_ms;
+        std::optional<Clock::time_point> start;
+        std::optional<Clock::time_point> round_start; // Time the first outstanding batch was handed out
+        double round_cost_ms; // Reported cost of all expansions received in the current round
+        size_t round_theorems; // Theorems handed out in the current round
+        std::optional<double> expansion_ms; // Reported cost per expansion
+        std::optional<double> wall_ratio; // Wall-clock time per reported millisecond
+        std::optional<double> theorem_wall_ms; // Wall-clock time per handed out theorem
+        std::optional<double> theorems_per_descent;
+
+        static void smooth(std::optional<double> &average, double observation);
+
+        static double milliseconds(Clock::duration duration);
+
+    public:
+        explicit TimeBudget(size_t budget_ms);
+
+        double elapsed_ms(Clock::time_point now = Clock::now()) const;
+
+        bool expired(Clock::time_point now = Clock::now()) const;
+
+        /* Expected wall-clock time until a batch of the given number of descents is expanded, 0 while nothing has
+         * been observed yet. */
+        double expected_batch_ms(size_t descents) const;
+
+        /* Returns the number of descents, at most max_descents, for which the batch is expected to be expanded before
+         * the deadline. Returns 0 once the deadline has passed or cannot be met by a single descent. */
+        size_t batch_size(size_t max_descents, Clock::time_point now = Clock::now());
+
+        void record_batch(size_t descents, size_t theorems, Clock::time_point now = Clock::now());
+
+        void record_expansions(const std::vector<std::shared_ptr<env_expansion>> &expansions);
+
+        // Called once no expansion is outstanding anymore
+        void end_round(Clock::time_point now = Clock::now());
+    };
+}
+
+#endif //HTPS_BUDGET_H
@@ -0,0 +1,93 @@
+#include "columns.h"
+#include <limits>
+#include <stdexcept>
+
+using namespace htps;
+
+uint32_t StringTable::intern(const std::string &s) {
+    auto [it, inserted] = ids.try_emplace(s, static_cast<uint32_t>(strings.size()));
+    if (inserted) {
+        if (strings.size() == std::numeric_limits<uint32_t>::max()) {
+            throw std::overflow_error("Too many distinct strings for 32 bit ids");
+        }
+        strings.push_back(s);
+    }
+    return it->second;
+}
+
+SampleColumns::SampleColumns(const HTPSResult &result) {
+    add_samples(result, goals, tactics);
+}
+
+SampleColumns::SampleColumns(const HTPSResult &result, StringTable &goal_table, StringTable &tactic_table) {
+    add_samples(result, goal_table, tactic_table);
+}
+
+void SampleColumns::add_samples(const HTPSResult &result, StringTable &goal_table, StringTable &tactic_table) {
+    add_tactic_samples(tactic_samples, result.get_tactic_samples(), goal_table, tactic_table);
+    add_tactic_samples(proof_samples, result.get_proof_samples(), goal_table, tactic_table);
+
+    const auto &critics = result.get_critic_samples();
+    critic_samples.goal_ids.reserve(critics.size());
+    critic_samples.q_estimates.reserve(critics.size());
+    critic_samples.solved.reserve(critics.size());
+    critic_samples.bad.reserve(critics.size());
+    critic_samples.critic.reserve(critics.size());
+    critic_samples.visit_counts.reserve(critics.size());
+    for (const auto &sample: critics) {
+        critic_samples.goal_ids.push_back(goal_table.intern(sample.get_goal()->unique_string));
+        critic_samples.q_estimates.push_back(sample.get_q_estimate());
+        critic_samples.solved.push_back(sample.is_solved());
+        critic_samples.bad.push_back(sample.is_bad());
+        critic_samples.critic.push_back(sample.get_critic());
+        critic_samples.visit_counts.push_back(sample.get_visit_count());
+    }
+
+    const auto &effects = result.get_effect_samples();
+    effect_samples.goal_ids.reserve(effects.size());
+    effect_samples.tactic_ids.reserve(effects.size());
+    effect_samples.child_offsets.reserve(effects.size() + 1);
+    for (const auto &sample: effects) {
+        effect_samples.goal_ids.push_back(goal_table.intern(sample.get_goal()->unique_string));
+        effect_samples.tactic_ids.push_back(tactic_table.intern(sample.get_tactic()->unique_string));
+        for (const auto &child: sample.get_children()) {
+            effect_samples.child_ids.push_back(goal_table.intern(child->unique_string));
+        }
+        effect_samples.child_offsets.push_back(effect_samples.child_ids.size());
+    }
+}
+
+void SampleColumns::add_tactic_samples(TacticSampleColumns &columns, const std::vector<HTPSSampleTactics> &samples,
+                                       StringTable &goal_table, StringTable &tactic_table) {
+    columns.goal_ids.reserve(samples.size());
+    columns.offsets.reserve(samples.size() + 1);
+    columns.inproof.reserve(samples.size());
+    columns.visit_counts.reserve(samples.size());
+    for (const auto &sample: samples) {
+        columns.goal_ids.push_back(goal_table.intern(sample.get_goal()->unique_string));
+        const auto &sample_tactics = sample.get_tactics();
+        const auto &q_estimates = sample.get_q_estimates();
+        for (size_t i = 0; i < sample_tactics.size(); i++) {
+            columns.tactic_ids.push_back(tactic_table.intern(sample_tactics[i]->unique_string));
+            columns.target_pi.push_back(sample.get_target_pi()[i]);
+            columns.q_estimates.push_back(q_estimates.empty() ? std::numeric_limits<double>::quiet_NaN() : q_estimates[i]);
+        }
+        columns.offsets.push_back(columns.tactic_ids.size());
+        columns.inproof.push_back(static_cast<uint8_t>(sample.get_inproof()));
+        columns.visit_counts.push_back(sample.get_visit_count());
+    }
+}
+
+size_t htps::column_type_size(ColumnType type) {
+    switch (type) {
+        case ColumnType::UInt8:
+            return sizeof(uint8_t);
+        case ColumnType::UInt32:
+            return sizeof(uint32_t);
+        case ColumnType::UInt64:
+            return sizeof(uint64_t);
+        case ColumnType::Float64:
+            return sizeof(double);
+    }
+    throw std::invalid_argument("Invalid column type");
+}
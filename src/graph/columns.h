@@ -0,0 +1,145 @@
+#ifndef HTPS_COLUMNS_H
+#define HTPS_COLUMNS_H
+
+#include "htps.h"
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+namespace htps {
+
+    /* Goals and tactics of the samples are interned, the ids index into the string tables of SampleColumns which hold
+     * their unique strings in order of first appearance. */
+    class StringTable {
+    private:
+        std::unordered_map<std::string, uint32_t> ids;
+
+    public:
+        std::vector<std::string> strings;
+
+        uint32_t intern(const std::string &s);
+    };
+
+    /* Tactic samples as flat arrays. The tactics of sample i are tactic_ids[offsets[i]] to tactic_ids[offsets[i + 1] - 1],
+     * target_pi and q_estimates are aligned with tactic_ids. Samples without q-estimates have NaN entries. */
+    struct TacticSampleColumns {
+        std::vector<uint32_t> goal_ids;
+        std::vector<uint64_t> offsets{0};
+        std::vector<uint32_t> tactic_ids;
+        std::vector<double> target_pi;
+        std::vector<double> q_estimates;
+        std::vector<uint8_t> inproof;
+        std::vector<uint64_t> visit_counts;
+
+        size_t size() const {
+            return goal_ids.size();
+        }
+    };
+
+    struct CriticSampleColumns {
+        std::vector<uint32_t> goal_ids;
+        std::vector<double> q_estimates;
+        std::vector<uint8_t> solved;
+        std::vector<uint8_t> bad;
+        std::vector<double> critic;
+        std::vector<uint64_t> visit_counts;
+
+        size_t size() const {
+            return goal_ids.size();
+        }
+    };
+
+    // The children of sample i are child_ids[child_offsets[i]] to child_ids[child_offsets[i + 1] - 1]
+    struct EffectSampleColumns {
+        std::vector<uint32_t> goal_ids;
+        std::vector<uint32_t> tactic_ids;
+        std::vector<uint64_t> child_offsets{0};
+        std::vector<uint32_t> child_ids;
+
+        size_t size() const {
+            return goal_ids.size();
+        }
+    };
+
+    /* Columnar layout of the training samples of an HTPSResult, for data loaders that batch the samples anyway.
+     * Children of effects are goals and share the goal table. */
+    struct SampleColumns {
+        StringTable goals;
+        StringTable tactics;
+        TacticSampleColumns tactic_samples;
+        TacticSampleColumns proof_samples;
+        CriticSampleColumns critic_samples;
+        EffectSampleColumns effect_samples;
+
+        explicit SampleColumns(const HTPSResult &result);
+
+        /* Interns into the given tables instead, e.g. to share the ids between the results of a shard. The own tables
+         * stay empty. */
+        SampleColumns(const HTPSResult &result, StringTable &goal_table, StringTable &tactic_table);
+
+        SampleColumns() = default;
+
+    private:
+        void add_samples(const HTPSResult &result, StringTable &goal_table, StringTable &tactic_table);
+
+        static void add_tactic_samples(TacticSampleColumns &columns, const std::vector<HTPSSampleTactics> &samples,
+                                       StringTable &goal_table, StringTable &tactic_table);
+    };
+
+    // Element types of the columns
+    enum class ColumnType : uint8_t {
+        UInt8,
+        UInt32,
+        UInt64,
+        Float64
+    };
+
+    template<typename T>
+    constexpr ColumnType column_type() {
+        if constexpr (std::is_same_v<T, uint8_t>)
+            return ColumnType::UInt8;
+        else if constexpr (std::is_same_v<T, uint32_t>)
+            return ColumnType::UInt32;
+        else if constexpr (std::is_same_v<T, uint64_t>)
+            return ColumnType::UInt64;
+        else {
+            static_assert(std::is_same_v<T, double>, "Unsupported column type");
+            return ColumnType::Float64;
+        }
+    }
+
+    size_t column_type_size(ColumnType type);
+
+    /* Calls fn(group, name, column) for every column of columns, in a fixed order. The groups are the sample kinds,
+     * i.e. tactic_samples, proof_samples, critic_samples and effect_samples. */
+    template<typename Fn>
+    void for_each_column(const SampleColumns &columns, Fn &&fn) {
+        for (auto [group, tactic_columns]: {std::pair{"tactic_samples", &columns.tactic_samples},
+                                            std::pair{"proof_samples", &columns.proof_samples}}) {
+            fn(group, "goal_ids", tactic_columns->goal_ids);
+            fn(group, "offsets", tactic_columns->offsets);
+            fn(group, "tactic_ids", tactic_columns->tactic_ids);
+            fn(group, "target_pi", tactic_columns->target_pi);
+            fn(group, "q_estimates", tactic_columns->q_estimates);
+            fn(group, "inproof", tactic_columns->inproof);
+            fn(group, "visit_counts", tactic_columns->visit_counts);
+        }
+        const auto &critic = columns.critic_samples;
+        fn("critic_samples", "goal_ids", critic.goal_ids);
+        fn("critic_samples", "q_estimates", critic.q_estimates);
+        fn("critic_samples", "solved", critic.solved);
+        fn("critic_samples", "bad", critic.bad);
+        fn("critic_samples", "critic", critic.critic);
+        fn("critic_samples", "visit_counts", critic.visit_counts);
+        const auto &effect = columns.effect_samples;
+        fn("effect_samples", "goal_ids", effect.goal_ids);
+        fn("effect_samples", "tactic_ids", effect.tactic_ids);
+        fn("effect_samples", "child_offsets", effect.child_offsets);
+        fn("effect_samples", "child_ids", effect.child_ids);
+    }
+}
+
+#endif //HTPS_COLUMNS_H
@@ -0,0 +1,154 @@
+#include "engine.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace htps;
+
+namespace {
+#ifdef PYTHON_BINDINGS
+    /* Theorems can carry Python metadata which is released whenever the last reference is dropped, so the search
+     * thread must hold the GIL while touching the graph. */
+    class GILGuard {
+    private:
+        PyGILState_STATE state;
+    public:
+        GILGuard() : state(PyGILState_Ensure()) {}
+
+        ~GILGuard() {
+            PyGILState_Release(state);
+        }
+    };
+#else
+    class GILGuard {
+    };
+#endif
+
+    htps_params with_async_expansions(htps_params params) {
+        params.async_expansions = true;
+        return params;
+    }
+}
+
+HTPSEngine::HTPSEngine(TheoremPointer &root, const htps_params &params, size_t queue_capacity,
+                       size_t max_batches_in_flight) :
+        search(root, with_async_expansions(params)), max_batches_in_flight(max_batches_in_flight), expansions_queue(queue_capacity),
+        theorems_queue(queue_capacity), results_queue(1), worker(), running(false), stop_requested(false),
+        error() {
+    if (max_batches_in_flight == 0) {
+        throw std::invalid_argument("At least one batch has to be in flight");
+    }
+    if (max_batches_in_flight > queue_capacity) {
+        throw std::invalid_argument("Queue capacity must fit all batches in flight");
+    }
+}
+
+HTPSEngine::~HTPSEngine() {
+    stop();
+}
+
+void HTPSEngine::start() {
+    if (worker.joinable()) {
+        throw std::runtime_error("Engine has already been started!");
+    }
+    running = true;
+    worker = std::thread(&HTPSEngine::run, this);
+}
+
+void HTPSEngine::stop() {
+    stop_requested = true;
+    close_queues();
+    if (worker.joinable())
+        worker.join();
+}
+
+void HTPSEngine::close_queues() {
+    expansions_queue.close();
+    theorems_queue.close();
+    results_queue.close();
+}
+
+bool HTPSEngine::is_running() const {
+    return running;
+}
+
+std::optional<std::vector<TheoremPointer>> HTPSEngine::get_theorems() {
+    return theorems_queue.pop();
+}
+
+bool HTPSEngine::submit_expansions(std::vector<std::shared_ptr<env_expansion>> expansions) {
+    return expansions_queue.push(std::move(expansions));
+}
+
+std::optional<HTPSResult> HTPSEngine::get_result() {
+    auto result = results_queue.pop();
+    // The search thread exits right after sending the result
+    if (worker.joinable())
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+    return result;
+}
+
+void HTPSEngine::run() {
+    std::vector<TheoremPointer> theorems;
+    try {
+        // Theorems of each outstanding batch that have not been expanded yet
+        std::vector<TheoremSet> batches;
+        while (!stop_requested) {
+            // Select as many batches as allowed, these overlap with the expansion of the ones already in flight
+            while (batches.size() < max_batches_in_flight) {
+                {
+                    [[maybe_unused]] GILGuard guard;
+                    if (search.is_done())
+                        break;
+                    search.theorems_to_expand(theorems);
+                }
+                if (theorems.empty())
+                    break;
+                TheoremSet batch;
+                for (const auto &thm: theorems)
+                    batch.insert(thm);
+                batches.push_back(batch);
+                if (!theorems_queue.push(theorems))
+                    break;
+            }
+            // Nothing in flight means nothing selectable, i.e. the search is done
+            if (batches.empty() || stop_requested)
+                break;
+            // Moved out of the optional right away, GCC cannot follow its engaged flag across the loop
+            std::vector<std::shared_ptr<env_expansion>> expansions;
+            if (auto popped = expansions_queue.pop())
+                expansions = std::move(*popped);
+            else
+                break;
+            [[maybe_unused]] GILGuard guard;
+            for (const auto &expansion: expansions) {
+                auto batch = std::find_if(batches.begin(), batches.end(), [&expansion](const TheoremSet &b) {
+                    return b.contains(expansion->thm);
+                });
+                if (batch == batches.end()) {
+                    throw std::runtime_error("Received an expansion for a theorem that is not being expanded!");
+                }
+                batch->erase(expansion->thm);
+                if (batch->size() == 0)
+                    batches.erase(batch);
+            }
+            search.expand_and_backup(expansions);
+            expansions.clear();
+        }
+        if (!stop_requested) {
+            // No more theorems will be requested, the caller can stop waiting for them
+            theorems_queue.close();
+            [[maybe_unused]] GILGuard guard;
+            results_queue.push(search.get_result());
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    {
+        [[maybe_unused]] GILGuard guard;
+        theorems.clear();
+    }
+    running = false;
+    close_queues();
+}
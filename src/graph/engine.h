@@ -0,0 +1,70 @@
+#ifndef HTPS_ENGINE_H
+#define HTPS_ENGINE_H
+
+#include "htps.h"
+#include "../util/concurrency.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace htps {
+
+    /* Runs a single HTPS on a background thread, see docs/Processes.md.
+     * The search thread receives env expansions on the input queue, and provides theorems to expand as well as the
+     * final result on the output queues. It does not wait for the caller in lockstep: as soon as a batch of theorems is
+     * handed out, the next batch is selected while the environment still works on the previous one, up to
+     * max_batches_in_flight outstanding batches. Expansions can be returned in any grouping, each one is integrated into
+     * the graph as soon as it arrives. The search always runs with async_expansions enabled.
+     * */
+    class HTPSEngine {
+    private:
+        HTPS search;
+        size_t max_batches_in_flight;
+        BoundedQueue<std::vector<std::shared_ptr<env_expansion>>> expansions_queue; // input
+        BoundedQueue<std::vector<TheoremPointer>> theorems_queue; // output
+        BoundedQueue<HTPSResult> results_queue; // output
+        std::thread worker;
+        std::atomic<bool> running;
+        std::atomic<bool> stop_requested;
+        std::exception_ptr error;
+
+        void run();
+
+        void close_queues();
+
+    public:
+        HTPSEngine(TheoremPointer &root, const htps_params &params, size_t queue_capacity = 8,
+                   size_t max_batches_in_flight = 2);
+
+        HTPSEngine(const HTPSEngine &) = delete;
+
+        HTPSEngine &operator=(const HTPSEngine &) = delete;
+
+        ~HTPSEngine();
+
+        void start();
+
+        /* Stops the search thread and waits for it to exit. Pending queue items are dropped, no result is produced
+         * if the search did not finish before. */
+        void stop();
+
+        /* Blocks until the next batch of theorems is available. Returns an empty optional once the search will not
+         * ask for any more theorems. */
+        std::optional<std::vector<TheoremPointer>> get_theorems();
+
+        /* Hands expansions for previously requested theorems to the search thread.
+         * Blocks while the input queue is full and returns false if the engine does not accept expansions anymore. */
+        bool submit_expansions(std::vector<std::shared_ptr<env_expansion>> expansions);
+
+        /* Blocks until the search finished. Rethrows the exception that terminated the search thread, if any, and
+         * returns an empty optional if the engine was stopped before finishing. */
+        std::optional<HTPSResult> get_result();
+
+        bool is_running() const;
+    };
+}
+
+#endif //HTPS_ENGINE_H
@@ -17,6 +17,7 @@
 #include <limits>
 #include <optional>
 #include <deque>
+#include <tuple>
 #include <cassert>
 #include <queue>
 #include <memory>
@@ -233,6 +234,8 @@ namespace htps {
         std::vector<bool> tactic_expandable;
         std::vector<std::vector<TheoremPointer>> children_for_tactic;
         std::unordered_set<size_t> killed_tactics;
+        // Killed tactics whose kill depends on the root, see Graph::kill_tactic
+        std::unordered_set<size_t> circle_killed_tactics;
         std::unordered_set<size_t> solving_tactics;
         MinimumLengthMap minimum_proof_size;
         MinimumTacticMap minimum_tactics;
@@ -241,6 +244,7 @@ namespace htps {
         bool solved;
         bool is_solved_leaf;
         bool in_proof;
+        size_t version = 0; // Incremented by every change that can affect the policy or the value of the node
 
     public:
         size_t n_tactics() const {
@@ -251,6 +255,10 @@ namespace htps {
             return solving_tactics.size();
         }
 
+        size_t get_version() const {
+            return version;
+        }
+
         bool is_solved() const {
             return solved;
         }
@@ -269,6 +277,7 @@ namespace htps {
                 tactic_expandable(tactics.size(), true),
                 children_for_tactic(children_for_tactic),
                 killed_tactics(),
+                circle_killed_tactics(),
                 solving_tactics(),
                 minimum_proof_size(),
                 minimum_tactics(),
@@ -320,6 +329,7 @@ namespace htps {
                 return false;
             }
             killed_tactics.insert(i);
+            version++;
             return all_tactics_killed();
         }
 
@@ -327,6 +337,28 @@ namespace htps {
             return killed_tactics.find(tactic_id) != killed_tactics.end();
         }
 
+        void set_circle_killed(size_t tactic_id) {
+            assert(killed(tactic_id));
+            circle_killed_tactics.insert(tactic_id);
+        }
+
+        bool circle_killed(size_t tactic_id) const {
+            return circle_killed_tactics.find(tactic_id) != circle_killed_tactics.end();
+        }
+
+        const std::unordered_set<size_t> &get_circle_killed_tactics() const {
+            return circle_killed_tactics;
+        }
+
+        // Undoes the kill of a tactic, the expandable flags have to be propagated again afterwards
+        virtual void revive_tactic(size_t i) {
+            if (killed_tactics.erase(i) == 0) {
+                return;
+            }
+            circle_killed_tactics.erase(i);
+            version++;
+        }
+
         void reset_minimum_proof_stats() {
             minimum_proof_size = MinimumLengthMap();
             minimum_tactics = MinimumTacticMap();
@@ -378,10 +410,12 @@ namespace htps {
             for (size_t i = 0; i < tactics.size(); i++) {
                 tactic_expandable[i] = expandable;
             }
+            version++;
         }
 
         void set_expandable(size_t i, bool expandable) {
             tactic_expandable[i] = expandable;
+            version++;
         }
 
         bool expandable(size_t i) const {
@@ -399,6 +433,7 @@ namespace htps {
         // Returns true if this was the first tactic to solve the theorem
         bool solved_by(size_t i) {
             solving_tactics.insert(i);
+            version++;
             bool old_solved = solved;
             solved = true;
             return !old_solved;
@@ -488,6 +523,7 @@ namespace htps {
             }
             j["children_for_tactic"] = children_for_tactic_json;
             j["killed_tactics"] = killed_tactics;
+            j["circle_killed_tactics"] = circle_killed_tactics;
             j["solving_tactics"] = solving_tactics;
             j["tactic_expandable"] = tactic_expandable;
             j["minimum_proof_size"] = nlohmann::json(minimum_proof_size);
@@ -518,6 +554,7 @@ namespace htps {
             }
             n.children_for_tactic = children_for_tactic;
             n.killed_tactics = j["killed_tactics"].get<std::unordered_set<size_t>>();
+            n.circle_killed_tactics = j.value("circle_killed_tactics", std::unordered_set<size_t>());
             n.solving_tactics = j["solving_tactics"].get<std::unordered_set<size_t>>();
             n.tactic_expandable = j["tactic_expandable"].get<std::vector<bool>>();
             n.minimum_proof_size = MinimumLengthMap::from_json(j["minimum_proof_size"]);
@@ -1503,6 +1540,102 @@ namespace htps {
             return g;
         }
 
+        /* Makes new_root the root of the graph. Nodes that can not be reached from the new root through tactics that
+         * are alive are released, all other nodes are kept as they are. Solved flags and tactics killed for leading to
+         * a bad node do not depend on the root and stay valid. Circles were detected on paths from the old root, so
+         * circle kills (and the kills they caused) are undone first, a circle that still exists below the new root is
+         * found again by the next descents. Statistics relative to the root, i.e. proof membership and proof sizes,
+         * are reset.
+         * */
+        void move_root(const TheoremPointer &new_root) {
+            if (!permanent_ancestors.contains(new_root)) {
+                throw std::invalid_argument("New root is not part of the graph");
+            }
+            revive_circle_kills();
+            TheoremMap<std::shared_ptr<T>> kept;
+            TheoremSet seen;
+            std::deque<TheoremPointer> to_visit;
+            to_visit.push_back(new_root);
+            while (!to_visit.empty()) {
+                TheoremPointer current = to_visit.front();
+                to_visit.pop_front();
+                if (seen.contains(current)) {
+                    continue;
+                }
+                seen.insert(current);
+                if (!nodes.contains(current)) {
+                    continue;
+                }
+                const auto &node = nodes.at(current);
+                kept.insert(current, node);
+                const auto &children_for_tactic = node->get_children_for_tactic();
+                for (size_t i = 0; i < children_for_tactic.size(); i++) {
+                    if (node->killed(i)) {
+                        continue;
+                    }
+                    for (const auto &child: children_for_tactic[i]) {
+                        to_visit.push_back(child);
+                    }
+                }
+            }
+            // Keep the theorem object stored in the graph, it might carry metadata
+            root = kept.contains(new_root) ? kept.at(new_root)->get_theorem() : new_root;
+            nodes = std::move(kept);
+            rebuild_ancestors();
+            unexplored_theorems.clear();
+            initial_minimum_proof_size = MinimumLengthMap();
+            reset_minimum_proof_stats();
+        }
+
+        // Recomputes both ancestor maps from the children of all nodes
+        void rebuild_ancestors() {
+            ancestors = AncestorsMap();
+            permanent_ancestors = AncestorsMap();
+            ancestors.add_ancestor(root, nullptr, 0);
+            permanent_ancestors.add_ancestor(root, nullptr, 0);
+            for (const auto &[thm, node]: nodes) {
+                const auto &children_for_tactic = node->get_children_for_tactic();
+                for (size_t i = 0; i < children_for_tactic.size(); i++) {
+                    for (const auto &child: children_for_tactic[i]) {
+                        permanent_ancestors.add_ancestor(child, node->get_theorem(), i);
+                        if (!node->killed(i))
+                            ancestors.add_ancestor(child, node->get_theorem(), i);
+                    }
+                }
+            }
+        }
+
+        /* Revives all tactics killed for closing a circle or for leading to a node that only died due to such kills.
+         * Afterwards, tactics leading to nodes that are still bad are killed again. */
+        void revive_circle_kills() {
+            bool revived = false;
+            for (const auto &[thm, node]: nodes) {
+                std::vector<size_t> circle_killed(node->get_circle_killed_tactics().begin(),
+                                                  node->get_circle_killed_tactics().end());
+                for (size_t tactic_id: circle_killed) {
+                    node->revive_tactic(tactic_id);
+                    revived = true;
+                }
+            }
+            if (!revived) {
+                return;
+            }
+            rebuild_ancestors();
+            for (const auto &[thm, node]: nodes) {
+                for (size_t i = 0; i < node->n_tactics(); i++) {
+                    if (node->killed(i)) {
+                        continue;
+                    }
+                    const auto &children = node->get_children_for_tactic(i);
+                    if (std::any_of(children.begin(), children.end(), [this](const TheoremPointer &child) {
+                        return nodes.contains(child) && nodes.at(child)->is_bad();
+                    })) {
+                        kill_tactic(node, i);
+                    }
+                }
+            }
+        }
+
         void reset_minimum_proof_stats() {
             minimum_proof_size = initial_minimum_proof_size;
             for (auto &[_, node]: nodes) {
@@ -1572,12 +1705,15 @@ namespace htps {
             propagate_check_and_solved(newly_solved, to_check_solved);
         }
 
-        void kill_tactic(std::shared_ptr<T> node, size_t tactic_id) {
-            std::deque<std::pair<std::shared_ptr<T>, size_t>> to_kill;
+        /* Kills a tactic, and recursively the tactics leading to nodes that have no tactic left.
+         * A tactic killed for closing a circle depends on the path from the root, so it is marked as circle kill, and
+         * so are the kills caused by a node that died with circle kills among its tactics. */
+        void kill_tactic(std::shared_ptr<T> node, size_t tactic_id, bool circle = false) {
+            std::deque<std::tuple<std::shared_ptr<T>, size_t, bool>> to_kill;
             TheoremPointer thm;
-            to_kill.push_back({node, tactic_id});
+            to_kill.push_back({node, tactic_id, circle});
             while (!to_kill.empty()) {
-                auto [current, tid] = to_kill.front();
+                auto [current, tid, circle_kill] = to_kill.front();
                 to_kill.pop_front();
                 if (current->killed(tid)) {
                     continue;
@@ -1596,10 +1732,15 @@ namespace htps {
                 }
                 // If killing the tactics leads to all tactics killed, we need to kill all tactics leading to this node
                 // Since this node has become bad.
-                if (current->kill_tactic(tid)) {
+                bool dead = current->kill_tactic(tid);
+                if (circle_kill) {
+                    current->set_circle_killed(tid);
+                }
+                if (dead) {
+                    bool root_dependent = !current->get_circle_killed_tactics().empty();
                     for (const auto &[parent, parent_tid]: ancestors.get_ancestors(thm)) {
                         if (!parent.empty()) {
-                            to_kill.push_front({nodes.at(parent), parent_tid});
+                            to_kill.push_front({nodes.at(parent), parent_tid, root_dependent});
                         }
                     }
                 }
@@ -4,11 +4,17 @@
 
 #include "htps.h"
 #include "graph.h"
+#include "../util/binary.h"
 #include <memory>
 #include <vector>
 #include <numeric>
 #include <iostream>
 #include <optional>
+#include <atomic>
+#include <limits>
+#include <span>
+#include <typeinfo>
+#include <iterator>
 
 
 using namespace htps;
@@ -22,27 +28,17 @@ size_t htps::get_seed() {
     return s;
 }
 
-std::mt19937 htps::setup_gen() {
-    std::random_device rd;
-#ifdef VERBOSE_PRINTS
-    printf("Seed: %i", htps::seed);
-#endif
-    return std::mt19937(htps::seed);
-}
-
 size_t htps::seed = get_seed();
-std::mt19937 htps::gen = setup_gen();
-std::uniform_real_distribution<double> htps::dis = std::uniform_real_distribution<double>(0, 1);
 
-TheoremPointer HTPSSampleEffect::get_goal() const {
+const TheoremPointer &HTPSSampleEffect::get_goal() const {
     return goal;
 }
 
-std::shared_ptr<tactic> HTPSSampleEffect::get_tactic() const {
+const std::shared_ptr<tactic> &HTPSSampleEffect::get_tactic() const {
     return tac;
 }
 
-std::vector<TheoremPointer> HTPSSampleEffect::get_children() const {
+const std::vector<TheoremPointer> &HTPSSampleEffect::get_children() const {
     return children;
 }
 
@@ -314,6 +310,7 @@ Simulation Simulation::from_json(const nlohmann::json &j) {
     TheoremIncrementalMap<std::shared_ptr<tactic>> tacs = TheoremIncrementalMap<std::shared_ptr<tactic>>::from_json(j["tactics"]);
     s.tactics = tacs;
     s.depth = TheoremIncrementalMap<size_t>::from_json(j["depth"]);
+    // The keys are the hashes of the entries, not theorems
     TheoremIncrementalMap<std::vector<TheoremPointer>> children;
     for (const auto &[thm_str, children_vec]: j["children_for_theorem"].items()) {
         std::vector<TheoremPointer> children_vec_;
@@ -323,7 +320,7 @@ Simulation Simulation::from_json(const nlohmann::json &j) {
         for (const auto &child_str: pair.first) {
             children_vec_.emplace_back(child_str);
         }
-        children.insert_or_assign(thm_str, children_vec_, pair.second);
+        children.insert_or_assign(std::stoull(thm_str), children_vec_, pair.second);
     }
     s.children_for_theorem = children;
     TheoremIncrementalMap<TheoremPointer> parents;
@@ -332,10 +329,10 @@ Simulation Simulation::from_json(const nlohmann::json &j) {
         pair.first = parent_str["value"];
         pair.second = parent_str["previous"];
         if (parent_str.is_null()) {
-            parents.insert_or_assign(thm_str, nullptr, pair.second);
+            parents.insert_or_assign(std::stoull(thm_str), nullptr, pair.second);
             continue;
         }
-        parents.insert_or_assign(thm_str, pair.first, pair.second);
+        parents.insert_or_assign(std::stoull(thm_str), pair.first, pair.second);
     }
     s.parent_for_theorem = parents;
     if (j["values"].is_null()) {
@@ -362,7 +359,7 @@ Simulation Simulation::from_json(const nlohmann::json &j) {
             std::pair<nlohmann::json, std::size_t> pair;
             pair.first = thm_set["value"];
             pair.second = thm_set["previous"];
-            seen.insert_or_assign(thm_str, TheoremSet::from_json(pair.first), pair.second);
+            seen.insert_or_assign(std::stoull(thm_str), TheoremSet::from_json(pair.first), pair.second);
         }
         s.seen = seen;
     }
@@ -370,32 +367,23 @@ Simulation Simulation::from_json(const nlohmann::json &j) {
 }
 
 void Simulation::deduplicate(const TheoremPointer &ptr) {
-    for (const auto &[thm_str, thm]: theorems) {
-        if (*thm.first == *ptr) {
-            theorems.insert_or_assign(thm.first, ptr, thm.second);
-        }
-    }
-    for (auto &[thm_str, children]: children_for_theorem) {
-        for (size_t i = 0; i < children.first.size(); i++) {
-            auto &child = children.first[i];
-            if (*child == *ptr) {
-                children.first[i] = ptr;
-            }
+    // A single pass that replaces equal copies in place, sets only hold unique strings and need no update
+    auto replace = [&ptr](TheoremPointer &thm) {
+        if (thm && thm != ptr && *thm == *ptr)
+            thm = ptr;
+    };
+    for (auto &[hash_, thm]: theorems) {
+        replace(thm.first);
+    }
+    for (auto &[hash_, children]: children_for_theorem) {
+        for (auto &child: children.first) {
+            replace(child);
         }
     }
-    for (auto &[thm_str, parent]: parent_for_theorem) {
-        if (parent.first && *parent.first == *ptr) {
-            parent_for_theorem.insert_or_assign(parent.first, ptr, parent.second);
-        }
-    }
-    for (auto &[thm_str, seen_set]: seen) {
-        if (seen_set.first.contains(ptr)) {
-            seen_set.first.insert(ptr);
-        }
-    }
-    if (*root == *ptr) {
-        root = ptr;
+    for (auto &[hash_, parent]: parent_for_theorem) {
+        replace(parent.first);
     }
+    replace(root);
 }
 
 size_t Simulation::get_hash(const TheoremPointer &thm, const size_t &previous) const {
@@ -431,8 +419,9 @@ void HTPSNode::reset_HTPS_stats() {
     }
     // implies we will simply set logW to the first value we receive
     reset_mask = std::vector<bool>(tactics.size(), true);
-    counts = std::vector<size_t>(tactics.size(), 0);
-    virtual_counts = std::vector<size_t>(tactics.size(), 0);
+    counts = std::vector<count_t>(tactics.size(), 0);
+    virtual_counts = std::vector<count_t>(tactics.size(), 0);
+    version++;
 }
 
 bool HTPSNode::should_send(size_t count_threshold) const {
@@ -445,22 +434,30 @@ bool HTPSNode::should_send(size_t count_threshold) const {
     return count_sum >= count_threshold;
 }
 
-void HTPSNode::get_effect_samples(std::vector<HTPSSampleEffect> &samples, double subsampling_rate) const {
+void HTPSNode::get_effect_samples(std::vector<HTPSSampleEffect> &samples, double subsampling_rate, Rng &rng) const {
+    std::uniform_real_distribution<double> uniform(0, 1);
     for (const auto &effect: effects) {
-        if (dis(gen) > subsampling_rate)
+        if (subsampling_rate < 1 && uniform(rng) > subsampling_rate)
             continue;
         samples.emplace_back(thm, effect->tac, effect->children);
     }
 }
 
-std::vector<HTPSSampleEffect> HTPSNode::get_effect_samples(double subsampling_rate) const {
+std::vector<HTPSSampleEffect> HTPSNode::get_effect_samples() const {
     std::vector<HTPSSampleEffect> samples;
-    get_effect_samples(samples, subsampling_rate);
+    Rng unused;
+    get_effect_samples(samples, 1.0, unused);
     return samples;
 }
 
-std::optional<HTPSSampleCritic> HTPSNode::get_critic_sample(double subsampling_rate) const {
-    if (dis(gen) > subsampling_rate) {
+std::optional<HTPSSampleCritic> HTPSNode::get_critic_sample() const {
+    Rng unused;
+    return get_critic_sample(1.0, unused);
+}
+
+std::optional<HTPSSampleCritic> HTPSNode::get_critic_sample(double subsampling_rate, Rng &rng) const {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    if (subsampling_rate < 1 && uniform(rng) > subsampling_rate) {
         return std::nullopt;
     }
     // Compute visit count of the node by summing up all action counts
@@ -517,8 +514,7 @@ void HTPSNode::get_tactics_sample_regular(Metric metric, NodeMask node_mask,
                                           std::vector<double> &valid_targets) const {
     if (all_tactics_killed())
         return;
-    std::vector<double> targets;
-    compute_policy(targets);
+    const std::vector<double> &targets = get_policy();
     std::vector<size_t> selected_tactic_ids;
     if (n_solving_tactics() <= 0) {
         for (size_t i = 0; i < tactics.size(); i++) {
@@ -606,7 +602,8 @@ std::optional<HTPSSampleTactics> HTPSNode::get_tactics_sample(Metric metric, Nod
     }
     // Compute visit count of the node by summing up all action counts
     size_t visit_sum = std::accumulate(counts.begin(), counts.end(), static_cast<size_t>(0));
-    return HTPSSampleTactics(thm, valid_tactics, valid_targets, inproof, q_values, visit_sum);
+    return HTPSSampleTactics(thm, std::move(valid_tactics), std::move(valid_targets), inproof, std::move(q_values),
+                             visit_sum);
 }
 
 bool HTPSNode::kill_tactic(size_t tactic_id) {
@@ -619,44 +616,98 @@ bool HTPSNode::kill_tactic(size_t tactic_id) {
     return killed;
 }
 
-void HTPSNode::compute_policy(std::vector<double> &result, bool force_expansion) const {
-    std::vector<size_t> full_counts;
-    full_counts.reserve(tactics.size());
-    result.reserve(tactics.size());
-    for (size_t i = 0; i < tactics.size(); i++) {
-        full_counts.push_back(counts[i] + virtual_counts[i]);
+void HTPSNode::revive_tactic(size_t tactic_id) {
+    bool dead = all_tactics_killed();
+    Node::revive_tactic(tactic_id);
+    if (dead && !all_tactics_killed())
+        log_critic_value = old_critic_value;
+}
+
+template<QValueSolved q_value_solved_type>
+double HTPSNode::q_value_as(size_t tactic_id, size_t full_count) const {
+    double q = tactic_init_value;
+    if (full_count > 0) {
+        assert(!reset_mask[tactic_id] || counts[tactic_id] == 0);
+        q = std::exp(log_w[tactic_id]) / static_cast<double>(full_count);
+    }
+    if (!solving_tactics.contains(tactic_id))
+        return q;
+    if constexpr (q_value_solved_type == OneOverCounts) {
+        if (full_count > 0)
+            q = 1.0 / static_cast<double>(full_count);
+    } else if constexpr (q_value_solved_type == CountOverCounts) {
+        if (full_count > 0)
+            q = static_cast<double>(counts[tactic_id]) / static_cast<double>(full_count);
+    } else if constexpr (q_value_solved_type == One) {
+        q = 1.0;
+    } else if constexpr (q_value_solved_type == OneOverVirtualCounts) {
+        q = 1.0 / static_cast<double>(1 + get_virtual_count(tactic_id));
+    } else if constexpr (q_value_solved_type == OneOverCountsNoFPU) {
+        q = 1.0 / static_cast<double>(std::max(static_cast<size_t>(1), full_count));
+    } else {
+        static_assert(q_value_solved_type == CountOverCountsNoFPU);
+        q = static_cast<double>(std::max(static_cast<size_t>(1), static_cast<size_t>(counts[tactic_id]))) /
+            static_cast<double>(std::max(static_cast<size_t>(1), full_count));
+    }
+    return q;
+}
+
+double HTPSNode::q_value(size_t tactic_id, size_t full_count) const {
+    switch (q_value_solved) {
+        case OneOverCounts:
+            return q_value_as<OneOverCounts>(tactic_id, full_count);
+        case CountOverCounts:
+            return q_value_as<CountOverCounts>(tactic_id, full_count);
+        case One:
+            return q_value_as<One>(tactic_id, full_count);
+        case OneOverVirtualCounts:
+            return q_value_as<OneOverVirtualCounts>(tactic_id, full_count);
+        case OneOverCountsNoFPU:
+            return q_value_as<OneOverCountsNoFPU>(tactic_id, full_count);
+        case CountOverCountsNoFPU:
+            return q_value_as<CountOverCountsNoFPU>(tactic_id, full_count);
+        default:
+            throw std::runtime_error("Invalid q value solved parameter");
     }
-    std::vector<double> q_values(tactics.size(), tactic_init_value);
+}
+
+void HTPSNode::set_widening(double constant, double exponent) {
+    widening_constant = constant;
+    widening_exponent = exponent;
+    version++;
+    prior_order.clear();
+    if (constant <= 0)
+        return;
+    prior_order.resize(tactics.size());
+    std::iota(prior_order.begin(), prior_order.end(), 0);
+    std::stable_sort(prior_order.begin(), prior_order.end(), [this](size_t a, size_t b) {
+        return priors[a] > priors[b];
+    });
+}
+
+size_t HTPSNode::active_tactic_count() const {
+    if (widening_constant <= 0)
+        return tactics.size();
+    size_t visits = 0;
     for (size_t i = 0; i < tactics.size(); i++) {
-        if (full_counts[i] > 0) {
-            assert(!reset_mask[i] || counts[i] == 0);
-            q_values[i] = std::exp(log_w[i]) / static_cast<double>(full_counts[i]);
-        }
-    }
-    for (const auto &tac: solving_range()) {
-        switch (q_value_solved) {
-            case OneOverCounts:
-                if (full_counts[tac] > 0)
-                    q_values[tac] = 1.0 / static_cast<double>(full_counts[tac]);
-                break;
-            case CountOverCounts:
-                if (full_counts[tac] > 0)
-                    q_values[tac] = static_cast<double>(counts[tac]) / static_cast<double>(full_counts[tac]);
-                break;
-            case One:
-                q_values[tac] = 1.0;
-                break;
-            case OneOverVirtualCounts:
-                q_values[tac] = 1.0 / static_cast<double>(1 + virtual_counts[tac]);
-            case OneOverCountsNoFPU:
-                q_values[tac] = 1.0 / static_cast<double>(std::max(static_cast<size_t>(1), full_counts[tac]));
-            case CountOverCountsNoFPU:
-                q_values[tac] = static_cast<double>(std::max(static_cast<size_t>(1), counts[tac])) /
-                                static_cast<double>(std::max(static_cast<size_t>(1), full_counts[tac]));
-            default:
-                throw std::runtime_error("Invalid q value solved parameter");
-        }
+        visits += counts[i] + get_virtual_count(i);
     }
+    double admitted = std::ceil(widening_constant * std::pow(static_cast<double>(visits + 1), widening_exponent));
+    if (admitted >= static_cast<double>(tactics.size()))
+        return tactics.size();
+    return std::max(static_cast<size_t>(1), static_cast<size_t>(admitted));
+}
+
+PolicyScratch &PolicyScratch::local() {
+    thread_local PolicyScratch scratch;
+    return scratch;
+}
+
+/* Shared by the generic and the specialized policy computation. q_value_of(tactic_id, full_count) gives the q value of
+ * a tactic, evaluate(q_values, priors, counts, result) the policy over the given tactics. */
+template<typename QValueFn, typename EvaluateFn>
+void HTPSNode::compute_policy_with(std::vector<double> &result, PolicyScratch &scratch, bool force_expansion,
+                                   QValueFn q_value_of, EvaluateFn evaluate) const {
     // Check that at least one valid tactic is expandable before we apply this
     bool expandable_only = false;
     if (force_expansion) {
@@ -667,6 +718,19 @@ void HTPSNode::compute_policy(std::vector<double> &result, bool force_expansion)
             }
         }
     }
+    if (widening_constant > 0) {
+        compute_widened_policy(result, expandable_only, scratch, q_value_of, evaluate);
+        return;
+    }
+
+    std::vector<size_t> &full_counts = scratch.counts;
+    std::vector<double> &q_values = scratch.q_values;
+    full_counts.resize(tactics.size());
+    q_values.resize(tactics.size());
+    for (size_t i = 0; i < tactics.size(); i++) {
+        full_counts[i] = counts[i] + get_virtual_count(i);
+        q_values[i] = q_value_of(i, full_counts[i]);
+    }
 
     for (std::size_t i = 0; i < tactics.size(); i++) {
         if (killed(i) || (expandable_only && !tactic_expandable[i])) {
@@ -674,14 +738,105 @@ void HTPSNode::compute_policy(std::vector<double> &result, bool force_expansion)
             full_counts[i] = 0;
         }
     }
-    double max_q = *std::max_element(q_values.begin(), q_values.end());
-    assert(max_q > MIN_FLOAT);
-    policy->get_policy(q_values, priors, full_counts, result);
+    assert(*std::max_element(q_values.begin(), q_values.end()) > MIN_FLOAT);
+    result.resize(tactics.size());
+    evaluate(q_values, prior_values(scratch), full_counts, result);
     for (const auto &tac: killed_tactics) {
         assert(result[tac] <= 1e-9); // Check that killed tactics have zero probability
     }
 }
 
+/* Only the admitted tactics are evaluated, so the cost of the policy does not grow with the number of tactics that
+ * are never visited. Tactics that cannot be chosen do not take up a slot, otherwise a node whose best tactics are
+ * killed would have nothing to choose from. */
+template<typename QValueFn, typename EvaluateFn>
+void HTPSNode::compute_widened_policy(std::vector<double> &result, bool expandable_only, PolicyScratch &scratch,
+                                      QValueFn q_value_of, EvaluateFn evaluate) const {
+    size_t active = active_tactic_count();
+    std::vector<size_t> &selected = scratch.selected;
+    std::vector<double> &q_values = scratch.q_values;
+    std::vector<double> &active_priors = scratch.priors;
+    std::vector<size_t> &full_counts = scratch.counts;
+    std::vector<double> &active_result = scratch.active_policy;
+    // The number of admitted tactics grows with the visits, sized for all tactics the buffers only grow once
+    for (auto *buffer: {&q_values, &active_priors, &active_result})
+        buffer->reserve(tactics.size());
+    selected.reserve(tactics.size());
+    full_counts.reserve(tactics.size());
+    selected.clear();
+    for (size_t i: prior_order) {
+        if (selected.size() == active)
+            break;
+        if (killed(i) || (expandable_only && !tactic_expandable[i]))
+            continue;
+        selected.push_back(i);
+    }
+    assert(!selected.empty());
+    q_values.resize(selected.size());
+    active_priors.resize(selected.size());
+    full_counts.resize(selected.size());
+    double prior_sum = 0.0;
+    for (size_t j = 0; j < selected.size(); j++) {
+        size_t i = selected[j];
+        full_counts[j] = counts[i] + get_virtual_count(i);
+        q_values[j] = q_value_of(i, full_counts[j]);
+        active_priors[j] = priors[i];
+        prior_sum += priors[i];
+    }
+    // The policy sees the admitted tactics as a full tactic set
+    if (prior_sum > 0) {
+        for (auto &prior: active_priors)
+            prior /= prior_sum;
+    }
+    active_result.resize(selected.size());
+    evaluate(q_values, active_priors, full_counts, active_result);
+    result.assign(tactics.size(), 0.0);
+    for (size_t j = 0; j < selected.size(); j++) {
+        result[selected[j]] = active_result[j];
+    }
+}
+
+std::span<const double> HTPSNode::prior_values(PolicyScratch &scratch) const {
+#ifdef HTPS_FLOAT_STATS
+    scratch.priors.assign(priors.begin(), priors.end());
+    return scratch.priors;
+#else
+    (void) scratch;
+    return priors;
+#endif
+}
+
+void HTPSNode::compute_policy(std::vector<double> &result, PolicyScratch &scratch, bool force_expansion) const {
+    compute_policy_with(result, scratch, force_expansion,
+                        [this](size_t tactic_id, size_t full_count) { return q_value(tactic_id, full_count); },
+                        [this](std::span<const double> q_values, std::span<const double> pi_values,
+                               std::span<const size_t> full_counts, std::span<double> result) {
+                            policy->get_policy(q_values, pi_values, full_counts, result);
+                        });
+}
+
+template<PolicyType policy_type, QValueSolved q_value_solved_type>
+void HTPSNode::compute_policy_as(std::vector<double> &result, PolicyScratch &scratch, bool force_expansion) const {
+    assert(specialized_for(policy_type, q_value_solved_type));
+    compute_policy_with(result, scratch, force_expansion,
+                        [this](size_t tactic_id, size_t full_count) {
+                            return q_value_as<q_value_solved_type>(tactic_id, full_count);
+                        },
+                        [this](std::span<const double> q_values, std::span<const double> pi_values,
+                               std::span<const size_t> full_counts, std::span<double> result) {
+                            policy->evaluate<policy_type>(q_values, pi_values, full_counts, result);
+                        });
+}
+
+bool HTPSNode::specialized_for(PolicyType policy_type, QValueSolved q_value_solved_type) const {
+    return q_value_solved == q_value_solved_type && typeid(*policy) == typeid(Policy) &&
+           policy->get_type() == policy_type;
+}
+
+void HTPSNode::compute_policy(std::vector<double> &result, bool force_expansion) const {
+    compute_policy(result, PolicyScratch::local(), force_expansion);
+}
+
 std::vector<double> HTPSNode::compute_policy(bool force_expansion) const {
     std::vector<double> result;
     compute_policy(result, force_expansion);
@@ -690,18 +845,56 @@ std::vector<double> HTPSNode::compute_policy(bool force_expansion) const {
 
 void HTPSNode::update(size_t tactic_id, double backup_value) {
     counts[tactic_id]++;
-    // Compute logsumexp of these two values. We simplify the computation by assuming logw is the larger of the two
-    // We can make that simplification because the equations hold for arbitrary constants c, therefore also for the smaller value
-    // Also, note that by shifting by logw, it is exp(logw - logw) = 1
+    version++;
+    // Compute logsumexp of these two values in double precision, only the result is stored as stat_t
     if (reset_mask[tactic_id]) {
-        log_w[tactic_id] = backup_value;
+        log_w[tactic_id] = static_cast<stat_t>(backup_value);
         reset_mask[tactic_id] = false;
     } else {
-        log_w[tactic_id] += std::log(1 + std::exp(backup_value - log_w[tactic_id]));
+        log_w[tactic_id] = static_cast<stat_t>(log_add_exp(log_w[tactic_id], backup_value));
+    }
+}
+
+void HTPSNode::update_batch(size_t tactic_id, const std::vector<double> &backup_values) {
+    if (backup_values.empty())
+        return;
+    counts[tactic_id] += static_cast<count_t>(backup_values.size());
+    version++;
+    // Shift by the largest value, so that every exponent is at most 0
+    bool include_old = !reset_mask[tactic_id];
+    double old_value = log_w[tactic_id];
+    double max_value = *std::max_element(backup_values.begin(), backup_values.end());
+    if (include_old)
+        max_value = std::max(max_value, old_value);
+    reset_mask[tactic_id] = false;
+    if (max_value == MIN_FLOAT) {
+        log_w[tactic_id] = MIN_FLOAT;
+        return;
+    }
+    double sum = include_old ? std::exp(old_value - max_value) : 0.0;
+    for (double value: backup_values) {
+        sum += std::exp(value - max_value);
     }
+    log_w[tactic_id] = static_cast<stat_t>(max_value + std::log(sum));
+}
+
+const std::vector<double> &HTPSNode::get_policy() const {
+    if (cached_policy_version != version) {
+        compute_policy(cached_policy, PolicyScratch::local());
+        cached_policy_version = version;
+    }
+    return cached_policy;
 }
 
 double HTPSNode::get_value() const {
+    if (cached_value_version != version) {
+        cached_value = compute_value();
+        cached_value_version = version;
+    }
+    return cached_value;
+}
+
+double HTPSNode::compute_value() const {
     if (solved)
         return 0.0;
     if (is_terminal())
@@ -712,21 +905,27 @@ double HTPSNode::get_value() const {
         return std::min(0.0, log_critic_value);
     }
 
-    std::vector<double> policy_values;
-    compute_policy(policy_values);
+    const std::vector<double> &policy_values = get_policy();
     size_t max_id = std::distance(policy_values.begin(),
                                   std::max_element(policy_values.begin(), policy_values.end()));
     if (counts[max_id] == 0) {
         assert (log_critic_value <= 0.0);
         return std::min(0.0, log_critic_value);
     }
-    double result = log_w[max_id] - std::log(counts[max_id]);
+    double result = log_w[max_id] - std::log(static_cast<double>(counts[max_id]));
     assert(result <= 0.0);
     return std::min(0.0, result);
 }
 
 void HTPSNode::add_virtual_count(size_t tactic_id, size_t count) {
-    virtual_counts[tactic_id] += count;
+    std::atomic_ref<count_t>(virtual_counts[tactic_id]).fetch_add(static_cast<count_t>(count),
+                                                                  std::memory_order_relaxed);
+    std::atomic_ref<size_t>(version).fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t HTPSNode::get_virtual_count(size_t tactic_id) const {
+    // atomic_ref needs a non-const object, the load itself does not modify anything
+    return std::atomic_ref<count_t>(const_cast<count_t &>(virtual_counts[tactic_id])).load(std::memory_order_relaxed);
 }
 
 bool HTPSNode::_validate() const {
@@ -761,16 +960,22 @@ bool HTPSNode::_validate() const {
 }
 
 bool HTPSNode::has_virtual_count(size_t tactic_id) const {
-    return virtual_counts[tactic_id] > 0;
+    return get_virtual_count(tactic_id) > 0;
 }
 
 void HTPSNode::subtract_virtual_count(size_t tactic_id, size_t count) {
-    assert(virtual_counts[tactic_id] >= count);
-    virtual_counts[tactic_id] -= count;
+    [[maybe_unused]] size_t previous = std::atomic_ref<count_t>(virtual_counts[tactic_id]).fetch_sub(
+            static_cast<count_t>(count), std::memory_order_relaxed);
+    assert(previous >= count);
+    std::atomic_ref<size_t>(version).fetch_add(1, std::memory_order_relaxed);
 }
 
 bool HTPSNode::has_virtual_count() const {
-    return std::any_of(virtual_counts.begin(), virtual_counts.end(), [](size_t count) { return count > 0; });
+    for (size_t i = 0; i < virtual_counts.size(); i++) {
+        if (has_virtual_count(i))
+            return true;
+    }
+    return false;
 }
 
 HTPSNode HTPSNode::from_json(const nlohmann::json &j) {
@@ -789,6 +994,7 @@ HTPSNode HTPSNode::from_json(const nlohmann::json &j) {
     }
     children_for_tactic = children_for_tactic;
     std::unordered_set<size_t> killed_tactics = j["killed_tactics"].get<std::unordered_set<size_t>>();
+    auto circle_killed_tactics = j.value("circle_killed_tactics", std::unordered_set<size_t>());
     std::unordered_set<size_t> solving_tactics = j["solving_tactics"].get<std::unordered_set<size_t>>();
     std::vector<bool> tactic_expandable = j["tactic_expandable"].get<std::vector<bool>>();
     auto minimum_proof_size = MinimumLengthMap::from_json(j["minimum_proof_size"]);
@@ -826,7 +1032,9 @@ HTPSNode HTPSNode::from_json(const nlohmann::json &j) {
     bool error = j["error"];
 
     HTPSNode node = {thm, tactics, children_for_tactic, policy, priors, exploration, log_critic_value, q_value_solved, tactic_init_value, effects, error};
+    node.set_widening(j.value("widening_constant", 0.0), j.value("widening_exponent", 0.0));
     node.killed_tactics = killed_tactics;
+    node.circle_killed_tactics = circle_killed_tactics;
     node.solving_tactics = solving_tactics;
     node.tactic_expandable = tactic_expandable;
     node.minimum_proof_size = minimum_proof_size;
@@ -847,6 +1055,7 @@ HTPSNode::operator nlohmann::json() const {
     j["tactics"] = nlohmann::json(tactics);
     j["children_for_tactic"] = nlohmann::json(children_for_tactic);
     j["killed_tactics"] = killed_tactics;
+    j["circle_killed_tactics"] = circle_killed_tactics;
     j["solving_tactics"] = solving_tactics;
     j["tactic_expandable"] = tactic_expandable;
     j["minimum_proof_size"] = nlohmann::json(minimum_proof_size);
@@ -868,6 +1077,8 @@ HTPSNode::operator nlohmann::json() const {
     j["virtual_counts"] = virtual_counts;
     j["reset_mask"] = reset_mask;
     j["error"] = error;
+    j["widening_constant"] = widening_constant;
+    j["widening_exponent"] = widening_exponent;
     j["effects"] = effects;
     return j;
 }
@@ -898,15 +1109,15 @@ bool HTPS::is_done() const {
 void
 HTPS::get_train_samples(std::vector<HTPSSampleEffect> &samples_effects, std::vector<HTPSSampleCritic> &samples_critic,
                         std::vector<HTPSSampleTactics> &samples_tactics) const {
-    std::vector<HTPSSampleCritic> critic_solved;
-    std::vector<HTPSSampleCritic> critic_unsolved;
-    // Will be less than the number of nodes, but we don't know how many
-    critic_solved.reserve(nodes.size());
-    critic_unsolved.reserve(nodes.size());
-    samples_critic.reserve(nodes.size());
-    samples_tactics.reserve(nodes.size());
-    samples_effects.reserve(nodes.size());
-    std::vector<HTPSSampleEffect> node_samples;
+    // A substream of its own, so that the samples do not depend on the batches selected afterwards
+    Rng sample_rng = rng.substream(std::numeric_limits<uint64_t>::max());
+    collect_train_samples(samples_effects, samples_critic, samples_tactics, sample_rng, false, true);
+}
+
+void HTPS::collect_train_samples(std::vector<HTPSSampleEffect> &samples_effects,
+                                 std::vector<HTPSSampleCritic> &samples_critic,
+                                 std::vector<HTPSSampleTactics> &samples_tactics, const Rng &sample_rng,
+                                 bool incremental, bool final) const {
     NodeMask node_mask = params.node_mask;
     if (node_mask == MinimalProofSolving) {
         if (is_proven())
@@ -914,61 +1125,275 @@ HTPS::get_train_samples(std::vector<HTPSSampleEffect> &samples_effects, std::vec
         else
             node_mask = Solving;
     }
-
-    for (const auto &[thm, node]: nodes) {
-        node->get_effect_samples(node_samples, params.effect_subsampling_rate);
-        samples_effects.insert(samples_effects.end(), node_samples.begin(), node_samples.end());
-        node_samples.clear();
-        auto critic_sample = node->get_critic_sample(params.critic_subsampling_rate);
-        if (critic_sample) {
-            if (node->is_solved()) {
-                critic_solved.push_back(critic_sample.value());
-            } else {
-                critic_unsolved.push_back(critic_sample.value());
+    bool proof_mask = params.node_mask == Proof || params.node_mask == MinimalProof ||
+                      params.node_mask == MinimalProofSolving;
+
+    std::vector<HTPSNode *> node_list;
+    node_list.reserve(nodes.size());
+    for (const auto &[thm, node]: nodes)
+        node_list.push_back(node.get());
+    struct SampleChunk {
+        std::vector<HTPSSampleEffect> effects;
+        std::vector<HTPSSampleCritic> critic_solved;
+        std::vector<HTPSSampleCritic> critic_unsolved;
+        std::vector<HTPSSampleTactics> tactics;
+    };
+    std::vector<SampleChunk> chunks((node_list.size() + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE);
+
+    // Every node belongs to a single chunk, so the workers never touch the same node
+    for_each_chunk(node_list.size(), [&](size_t chunk) {
+        Rng chunk_rng = sample_rng.substream(chunk);
+        auto &out = chunks[chunk];
+        size_t end = std::min(node_list.size(), (chunk + 1) * SAMPLE_CHUNK_SIZE);
+        for (size_t i = chunk * SAMPLE_CHUNK_SIZE; i < end; i++) {
+            HTPSNode *node = node_list[i];
+            auto &state = node->get_harvest_state();
+            size_t version = node->get_version();
+            if (!incremental || !state.effects) {
+                node->get_effect_samples(out.effects, params.effect_subsampling_rate, chunk_rng);
+                if (incremental)
+                    state.effects = true;
+            }
+            bool ready = final || (node->should_send(params.count_threshold) && !node->has_virtual_count());
+            if (ready && (!incremental || state.critic_version != version)) {
+                auto critic_sample = node->get_critic_sample(params.critic_subsampling_rate, chunk_rng);
+                if (critic_sample) {
+                    if (node->is_solved()) {
+                        out.critic_solved.push_back(std::move(critic_sample.value()));
+                    } else {
+                        out.critic_unsolved.push_back(std::move(critic_sample.value()));
+                    }
+                }
+                if (incremental)
+                    state.critic_version = version;
+            }
+            // Tactic samples taken before the proof was built say NotInProof, so the nodes in the proof are taken again
+            bool relabel = final && (node->is_in_proof() || node->is_in_minimum_proof(params.metric));
+            if (ready && (final || !proof_mask) && (!incremental || state.tactics_version != version || relabel)) {
+                auto tactic_sample = node->get_tactics_sample(params.metric, node_mask, params.only_learn_best_tactics,
+                                                             params.tactic_p_threshold, params.count_threshold,
+                                                             params.tactic_sample_q_conditioning);
+                if (tactic_sample) {
+                    out.tactics.push_back(std::move(tactic_sample.value()));
+                }
+                if (incremental)
+                    state.tactics_version = version;
             }
         }
-        auto tactic_sample = node->get_tactics_sample(params.metric, node_mask, params.only_learn_best_tactics,
-                                                     params.tactic_p_threshold, params.count_threshold,
-                                                     params.tactic_sample_q_conditioning);
-        if (tactic_sample) {
-            samples_tactics.push_back(tactic_sample.value());
-        }
+    });
+
+    // Solved critic samples come first
+    size_t n_effects = samples_effects.size(), n_critic = samples_critic.size(), n_tactics = samples_tactics.size();
+    for (const auto &chunk: chunks) {
+        n_effects += chunk.effects.size();
+        n_critic += chunk.critic_solved.size() + chunk.critic_unsolved.size();
+        n_tactics += chunk.tactics.size();
     }
-    samples_critic = std::move(critic_solved);
-    samples_critic.insert(samples_critic.end(), critic_unsolved.begin(), critic_unsolved.end());
-    samples_critic.shrink_to_fit();
-    samples_tactics.shrink_to_fit();
-    samples_effects.shrink_to_fit();
+    samples_effects.reserve(n_effects);
+    samples_critic.reserve(n_critic);
+    samples_tactics.reserve(n_tactics);
+    for (auto &chunk: chunks) {
+        std::move(chunk.effects.begin(), chunk.effects.end(), std::back_inserter(samples_effects));
+        std::move(chunk.critic_solved.begin(), chunk.critic_solved.end(), std::back_inserter(samples_critic));
+        std::move(chunk.tactics.begin(), chunk.tactics.end(), std::back_inserter(samples_tactics));
+    }
+    for (auto &chunk: chunks)
+        std::move(chunk.critic_unsolved.begin(), chunk.critic_unsolved.end(), std::back_inserter(samples_critic));
 }
 
 void HTPS::get_proof_samples(std::vector<HTPSSampleTactics> &proof_samples_tactics) const {
     if (!is_proven())
         return;
-    // Upper bound on the number of samples
-    proof_samples_tactics.reserve(nodes.size());
-    for (const auto &[thm, node]: nodes) {
-        auto tactic_sample = node->get_tactics_sample(params.metric, MinimalProof, params.only_learn_best_tactics,
-                                                     params.tactic_p_threshold, params.count_threshold,
-                                                     params.tactic_sample_q_conditioning);
-        if (tactic_sample) {
-            proof_samples_tactics.push_back(tactic_sample.value());
+    std::vector<HTPSNode *> node_list;
+    node_list.reserve(nodes.size());
+    for (const auto &[thm, node]: nodes)
+        node_list.push_back(node.get());
+    std::vector<std::vector<HTPSSampleTactics>> chunks((node_list.size() + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE);
+    for_each_chunk(node_list.size(), [&](size_t chunk) {
+        size_t end = std::min(node_list.size(), (chunk + 1) * SAMPLE_CHUNK_SIZE);
+        for (size_t i = chunk * SAMPLE_CHUNK_SIZE; i < end; i++) {
+            auto tactic_sample = node_list[i]->get_tactics_sample(params.metric, MinimalProof,
+                                                                  params.only_learn_best_tactics,
+                                                                  params.tactic_p_threshold, params.count_threshold,
+                                                                  params.tactic_sample_q_conditioning);
+            if (tactic_sample) {
+                chunks[chunk].push_back(std::move(tactic_sample.value()));
+            }
         }
+    });
+    size_t total = proof_samples_tactics.size();
+    for (const auto &chunk: chunks)
+        total += chunk.size();
+    proof_samples_tactics.reserve(total);
+    for (auto &chunk: chunks)
+        std::move(chunk.begin(), chunk.end(), std::back_inserter(proof_samples_tactics));
+}
+
+ThreadPool &HTPS::get_thread_pool() const {
+    if (!thread_pool || thread_pool->size() != params.num_threads)
+        thread_pool = std::make_shared<ThreadPool>(params.num_threads);
+    return *thread_pool;
+}
+
+void HTPS::for_each_chunk(size_t count, const std::function<void(size_t)> &fn) const {
+    size_t chunks = (count + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE;
+    if (params.num_threads > 1 && chunks > 1) {
+        get_thread_pool().parallel_for(chunks, [&fn](size_t chunk, size_t) { fn(chunk); });
+        return;
     }
-    proof_samples_tactics.shrink_to_fit();
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+        fn(chunk);
 }
 
 Simulation HTPS::find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
                                        std::vector<std::pair<TheoremPointer, size_t>> &to_expand) {
-    Simulation sim = Simulation(root);
+    return find_leaves_to_expand(terminal, to_expand, rng);
+}
+
+Simulation HTPS::find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
+                                       std::vector<std::pair<TheoremPointer, size_t>> &to_expand, Rng &rng) {
+    Simulation sim;
+    if (_find_leaves_to_expand(sim, terminal, to_expand, rng, nullptr) == DescentStatus::Restart)
+        throw FailedTacticException();
+    return sim;
+}
+
+size_t HTPS::select_tactic(std::vector<double> &policy, Rng &rng) const {
+#ifdef VERBOSE_PRINTS
+    printf("Temperature %lf\n", params.policy_temperature);
+#endif
+    if (params.policy_temperature == 0) {
+        return std::distance(policy.begin(), std::max_element(policy.begin(), policy.end()));
+    }
+    return sample_tactic(policy, params.policy_temperature, rng);
+}
+
+size_t htps::sample_tactic(std::span<double> policy, double temperature, Rng &rng) {
+    // Normal softmax with temperature, i.e. exp(p / temperature)
+    // But take logarithm of policy first, as done in evariste
+    // The softmax of log(p) / temperature is proportional to p^(1 / temperature), so the weights need neither logarithm
+    // nor normalization, and for temperature 1 they are the policy itself.
+#ifdef VERBOSE_PRINTS
+    printf("Policy: ");
+    for (auto &p: policy) {
+        printf("%lf ", p);
+    }
+    printf("\n");
+#endif
+    if (policy.size() < 2)
+        return 0;
+    double inverse_temperature = 1.0 / temperature;
+    double total = 0;
+    size_t most_likely = 0;
+    double highest = MIN_FLOAT;
+    for (size_t i = 0; i < policy.size(); i++) {
+        double &p = policy[i];
+        if (p > highest) {
+            most_likely = i;
+            highest = p;
+        }
+        // Tactics that cannot be chosen have probability 0 or MIN_FLOAT
+        if (!(p > 0))
+            p = 0;
+        else if (inverse_temperature != 1.0)
+            p = std::exp(std::log(p) * inverse_temperature);
+        total += p;
+    }
+    // All weights underflow for very low temperatures, which approaches picking the most likely tactic
+    if (total == 0)
+        return most_likely;
+    // Inverse transform sampling on the unnormalized weights, which stops at the sampled tactic
+    double sample = std::generate_canonical<double, std::numeric_limits<double>::digits>(rng) * total;
+    double cumulative = 0;
+    size_t last = 0;
+    for (size_t i = 0; i < policy.size(); i++) {
+        if (policy[i] == 0)
+            continue;
+        cumulative += policy[i];
+        last = i;
+        if (cumulative > sample)
+            return i;
+    }
+    // Rounding can leave the sample just above the last partial sum
+    return last;
+}
+
+size_t HTPS::select_tactic_generic(const HTPSNode &node, PolicyScratch &scratch, Rng &rng) const {
+    node.compute_policy(scratch.policy, scratch, true);
+    return select_tactic(scratch.policy, rng);
+}
+
+template<PolicyType policy_type, QValueSolved q_value_solved_type, bool greedy>
+size_t HTPS::select_tactic_as(const HTPSNode &node, PolicyScratch &scratch, Rng &rng) const {
+    if (!node.specialized_for(policy_type, q_value_solved_type))
+        return select_tactic_generic(node, scratch, rng);
+    node.compute_policy_as<policy_type, q_value_solved_type>(scratch.policy, scratch, true);
+    if constexpr (greedy)
+        return std::distance(scratch.policy.begin(), std::max_element(scratch.policy.begin(), scratch.policy.end()));
+    else
+        return sample_tactic(scratch.policy, params.policy_temperature, rng);
+}
+
+template<PolicyType policy_type, QValueSolved q_value_solved_type>
+HTPS::SelectionKernel HTPS::selection_kernel_for(bool greedy) {
+    if (greedy)
+        return &HTPS::select_tactic_as<policy_type, q_value_solved_type, true>;
+    return &HTPS::select_tactic_as<policy_type, q_value_solved_type, false>;
+}
+
+void HTPS::choose_selection_kernel() {
+    selection_kernel = &HTPS::select_tactic_generic;
+    if (!policy || typeid(*policy) != typeid(Policy))
+        return;
+    bool greedy = params.policy_temperature == 0;
+    auto for_policy = [&]<PolicyType policy_type>() -> SelectionKernel {
+        switch (params.q_value_solved) {
+            case OneOverCounts:
+                return selection_kernel_for<policy_type, OneOverCounts>(greedy);
+            case CountOverCounts:
+                return selection_kernel_for<policy_type, CountOverCounts>(greedy);
+            case One:
+                return selection_kernel_for<policy_type, One>(greedy);
+            case OneOverVirtualCounts:
+                return selection_kernel_for<policy_type, OneOverVirtualCounts>(greedy);
+            case OneOverCountsNoFPU:
+                return selection_kernel_for<policy_type, OneOverCountsNoFPU>(greedy);
+            case CountOverCountsNoFPU:
+                return selection_kernel_for<policy_type, CountOverCountsNoFPU>(greedy);
+            default:
+                return &HTPS::select_tactic_generic;
+        }
+    };
+    switch (policy->get_type()) {
+        case AlphaZero:
+            selection_kernel = for_policy.template operator()<AlphaZero>();
+            break;
+        case RPO:
+            selection_kernel = for_policy.template operator()<RPO>();
+            break;
+        default:
+            break;
+    }
+}
+
+/* Descends from the root, selecting one tactic per node until reaching leaves.
+ * If deferred is given, the graph is left untouched, so that several descents can run at once. The virtual loss is
+ * collected in deferred instead of being added, and a circle ends the descent with DescentStatus::Circle instead of
+ * killing the tactic.
+ * */
+HTPS::DescentStatus HTPS::_find_leaves_to_expand(Simulation &sim, std::vector<TheoremPointer> &terminal,
+                                                 std::vector<std::pair<TheoremPointer, size_t>> &to_expand,
+                                                 Rng &rng, std::vector<DeferredVirtualLoss> *deferred) {
+    sim = Simulation(root);
     std::deque<std::pair<TheoremPointer, size_t>> to_process;
-    std::vector<double> node_policy;
+    // Per-thread buffers, parallel descents each run on their own thread
+    PolicyScratch &scratch = PolicyScratch::local();
     to_process.emplace_back(root, 0);
 
     while (!to_process.empty()) {
 #ifdef VERBOSE_PRINTS
         printf("To process\n");
 #endif
-        node_policy.clear();
         auto current_elem = to_process.front();
         TheoremPointer current = current_elem.first;
         size_t previous = current_elem.second;
@@ -996,7 +1421,8 @@ Simulation HTPS::find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
 #endif
             assert(!HTPS_node->all_tactics_killed());
             assert(HTPS_node->is_solved_leaf_node() || is_leaf_node);
-            sim.set_value(current, HTPS_node->get_value(), previous);
+            // Not get_value, the cache must not be filled while other descents read the node
+            sim.set_value(current, HTPS_node->compute_value(), previous);
             sim.set_solved(current, true, previous);
             terminal.push_back(current);
 #ifdef VERBOSE_PRINTS
@@ -1015,42 +1441,28 @@ Simulation HTPS::find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
             sim.erase_theorem_set(current, previous);
             continue;
         }
-        // Select subsequent tactic
-        HTPS_node->compute_policy(node_policy, true);
+        // Select subsequent tactic. A tactic closing a circle is killed, and the selection is repeated at the same
+        // node. Only once all tactics of the node are killed, the whole descent has to restart.
         size_t tactic_id;
-#ifdef VERBOSE_PRINTS
-        printf("Temperature %lf\n", params.policy_temperature);
-#endif
-        if (params.policy_temperature == 0) {
-            tactic_id = std::distance(node_policy.begin(), std::max_element(node_policy.begin(), node_policy.end()));
-        } else {
-            // Normal softmax with temperature, i.e. exp(p / temperature)
-            // But take logarithm of policy first, as done in evariste
-            for (size_t i = 0; i < node_policy.size(); i++) {
-                if (node_policy[i] > MIN_FLOAT)
-                    node_policy[i] = std::log(node_policy[i]);
-                else
-                    node_policy[i] = MIN_FLOAT;
-            }
-            double p_sum = 0;
-            for (auto &p: node_policy) {
-                p = std::exp(p / params.policy_temperature);
-                p_sum += p;
-            }
-            for (auto &p: node_policy) {
-                p = p / p_sum;
-            }
-#ifdef VERBOSE_PRINTS
-            printf("Policy: ");
-            for (auto &p: node_policy) {
-                printf("%lf ", p);
+        while (true) {
+            tactic_id = (this->*selection_kernel)(*HTPS_node, scratch, rng);
+            assert(!HTPS_node->killed(tactic_id));
+            const auto &children = HTPS_node->get_children_for_tactic(tactic_id);
+            TheoremSet &seen = sim.get_theorem_set(current, previous);
+            if (std::none_of(children.begin(), children.end(),
+                             [&seen](const auto &thm) { return seen.contains(thm); }))
+                break;
+            // No virtual loss was added yet, there is nothing to clean up
+            if (deferred)
+                return DescentStatus::Circle;
+            kill_tactic(HTPS_node, tactic_id, true);
+            if (HTPS_node->all_tactics_killed()) {
+                find_unexplored_and_propagate_expandable();
+                // Killing the last tactic also killed the tactics leading here, i.e. parts of this simulation
+                cleanup(sim);
+                return DescentStatus::Restart;
             }
-            printf("\n");
-#endif
-            std::discrete_distribution<size_t> dist(node_policy.begin(), node_policy.end());
-            tactic_id = dist(gen);
         }
-        assert(!HTPS_node->killed(tactic_id));
         auto tactic_ptr = HTPS_node->get_tactic(tactic_id);
 #ifdef VERBOSE_PRINTS
         printf("Setting tactic %zu\n", tactic_id);
@@ -1058,16 +1470,12 @@ Simulation HTPS::find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
         sim.set_tactic(current, tactic_ptr, previous);
         sim.set_tactic_id(current, tactic_id, previous);
         auto children = HTPS_node->get_children_for_tactic(tactic_id);
-        TheoremSet &seen = sim.get_theorem_set(current, previous);
-        // If any child has been seen, we have a circle, i.e. kill the tactic
-        if (std::any_of(children.begin(), children.end(), [seen](const auto &thm) { return seen.contains(thm); })) {
-            kill_tactic(HTPS_node, tactic_id);
-            cleanup(sim);
-            find_unexplored_and_propagate_expandable();
-            throw FailedTacticException();
+        if (deferred) {
+            deferred->push_back({HTPS_node, tactic_id, current, previous});
+        } else {
+            HTPS_node->add_virtual_count(tactic_id, params.virtual_loss);
+            sim.set_virtual_count_added(current, true, previous);
         }
-        HTPS_node->add_virtual_count(tactic_id, params.virtual_loss);
-        sim.set_virtual_count_added(current, true, previous);
         for (const auto &child: children) {
             size_t parent_hash = sim.get_hash(current, previous);
             sim.add_theorem(child, current, parent_hash, sim.get_depth(current, previous) + 1);
@@ -1085,7 +1493,7 @@ Simulation HTPS::find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
     assert(std::all_of(to_expand.begin(), to_expand.end(),
                        [this](const auto &thm) { return !this->nodes.contains(thm.first); }));
     assert(sim.leave_count() == all_leaves.size());
-    return sim;
+    return DescentStatus::Found;
 }
 
 
@@ -1154,6 +1562,9 @@ void HTPS::expand(std::vector<std::shared_ptr<env_expansion>> &expansions) {
         receive_expansion(expansion->thm, expansion->log_critic, false);
         nodes.push_back(current);
     }
+    for (auto &node: nodes) {
+        node.set_widening(params.widening_constant, params.widening_exponent);
+    }
     add_nodes(nodes);
     expansion_count += nodes.size();
 }
@@ -1170,9 +1581,21 @@ void HTPS::cleanup(Simulation &to_clean) {
     }
 }
 
+void HTPS::add_pending_backup(PendingBackups &pending, const std::shared_ptr<HTPSNode> &node, size_t tactic_id,
+                              std::optional<double> value, size_t virtual_loss) {
+    auto &entry = pending[{node.get(), tactic_id}];
+    if (!entry.node)
+        entry.node = node;
+    if (value)
+        entry.values.push_back(*value);
+    entry.virtual_loss += virtual_loss;
+}
+
 void HTPS::backup() {
     bool only_value;
     long i = 0;
+    // Simulations of a batch share most of their upper paths, so their updates are combined per (node, tactic)
+    PendingBackups pending;
     while (i < simulations.size()) {
         auto simulation = simulations[i];
         if (!simulation->should_backup()) {
@@ -1187,12 +1610,18 @@ void HTPS::backup() {
             else
                 backedup_hashes.insert(hashed);
         }
-        backup_leaves(simulation, only_value);
+        backup_leaves(simulation, only_value, pending);
         simulations.erase(simulations.begin() + i);
     }
+    for (auto &[key, entry]: pending) {
+        size_t tactic_id = key.second;
+        if (entry.virtual_loss > 0)
+            entry.node->subtract_virtual_count(tactic_id, entry.virtual_loss);
+        entry.node->update_batch(tactic_id, entry.values);
+    }
 }
 
-void HTPS::backup_leaves(std::shared_ptr<Simulation> &sim, bool only_value) {
+void HTPS::backup_leaves(std::shared_ptr<Simulation> &sim, bool only_value, PendingBackups &pending) {
     auto leaves = sim->leaves();
     bool updated_root = false;
     std::queue<std::pair<TheoremPointer, size_t>> to_process;
@@ -1202,7 +1631,7 @@ void HTPS::backup_leaves(std::shared_ptr<Simulation> &sim, bool only_value) {
         size_t hash_ = sim->get_hash(leaf, previous_hash_);
         std::shared_ptr<HTPSNode> current = nodes.at(leaf);
         if (sim->get_virtual_count_added(hash_)) {
-            current->subtract_virtual_count(sim->get_tactic_id(hash_), params.virtual_loss);
+            add_pending_backup(pending, current, sim->get_tactic_id(hash_), std::nullopt, params.virtual_loss);
         }
         assert(sim->get_value(hash_) <= 0); // log
         auto [parent, parent_hash] = sim->parent_hash(hash_);
@@ -1242,12 +1671,10 @@ void HTPS::backup_leaves(std::shared_ptr<Simulation> &sim, bool only_value) {
 #endif
         auto [parent, parent_hash] = sim->parent_hash(cur.second);
         sim->set_value(cur.first, sum_log, parent_hash);
-        if (sim->get_virtual_count_added(cur.second)) {
-            current_node->subtract_virtual_count(sim->get_tactic_id(cur.second), params.virtual_loss);
-        }
-        if (!only_value) {
-            current_node->update(sim->get_tactic_id(cur.second), sum_log);
-        }
+        size_t virtual_loss = sim->get_virtual_count_added(cur.second) ? params.virtual_loss : 0;
+        std::optional<double> value = only_value ? std::nullopt : std::optional<double>(sum_log);
+        if (virtual_loss > 0 || value)
+            add_pending_backup(pending, current_node, sim->get_tactic_id(cur.second), value, virtual_loss);
         if (!parent) {
             updated_root = true;
             continue;
@@ -1267,52 +1694,112 @@ void HTPS::batch_to_expand(std::vector<TheoremPointer> &theorems) {
     propagate_needed = false;
     TheoremMap<TheoremPointer> result;
     theorems.clear();
-    std::vector<TheoremPointer> single_to_expand;
 
-    for (size_t i = 0; i < params.succ_expansions; i++) {
-        single_to_expand.clear();
-        std::vector<TheoremPointer> terminal;
-        std::vector<std::pair<TheoremPointer, size_t>> to_expand;
-        Simulation sim;
-        while (!dead_root()) {
-            try {
-#ifdef VERBOSE_PRINTS
-                printf("Finding leaves to expand\n");
-#endif
-                sim = find_leaves_to_expand(terminal, to_expand);
-                break;
-            } catch (FailedTacticException &e) {
-                terminal.clear();
-                to_expand.clear();
-                continue;
-            }
+    size_t descents = params.succ_expansions;
+    if (params.time_budget_ms > 0) {
+        if (!time_budget)
+            time_budget.emplace(params.time_budget_ms);
+        descents = time_budget->batch_size(descents);
+        if (descents == 0) {
+            // Not even a single descent is expected to be expanded before the deadline
+            if (!is_expanding())
+                done = true;
+            return;
         }
-        if (dead_root())
+    }
+
+    Rng batch_rng(rng());
+    for (size_t first = 0; first < descents; first += DESCENT_WAVE_SIZE) {
+        if (!select_wave(result, first, std::min(DESCENT_WAVE_SIZE, descents - first), batch_rng))
             break;
+    }
+
+    if (time_budget)
+        time_budget->record_batch(descents, result.size());
+    if (result.empty()) {
+        // With expansions still in flight, their results can open up new leaves
+        if (!is_expanding())
+            done = true;
+        return;
+    }
+    // TODO: maybe we need the n_expansions here to decide whether we are done
+    for (const auto &[unique_str, thm]: result) {
+        theorems.push_back(thm);
+    }
+}
 
-        if (to_expand.empty()) {
+/* The descents of a wave first run against the graph as it was at the start of the wave, concurrently if
+ * params.num_threads > 1. Their virtual loss is then added and their simulations are registered in the order of the
+ * descents. A descent that ran into a circle is repeated at its turn, as it has to kill tactics. Killing changes the
+ * graph the remaining descents of the wave were selected on, so they are repeated as well. Hence, the leaves only
+ * depend on the seed, never on the number of threads.
+ * */
+bool HTPS::select_wave(TheoremMap<TheoremPointer> &result, size_t first, size_t count, const Rng &batch_rng) {
+    if (dead_root())
+        return false;
+    std::vector<WaveDescent> wave(count);
+    auto descend = [&](size_t i) {
+        Rng descent_rng = batch_rng.substream(first + i);
+        WaveDescent &descent = wave[i];
+        descent.status = _find_leaves_to_expand(descent.sim, descent.terminal, descent.to_expand, descent_rng,
+                                                &descent.virtual_losses);
+    };
+    if (params.num_threads > 1 && count > 1)
+        get_thread_pool().parallel_for(count, [&](size_t i, size_t) { descend(i); });
+    else
+        for (size_t i = 0; i < count; i++)
+            descend(i);
+
+    bool graph_changed = false;
+    std::vector<TheoremPointer> single_to_expand;
+    for (size_t i = 0; i < count; i++) {
+        WaveDescent &descent = wave[i];
+        if (graph_changed || descent.status == DescentStatus::Circle) {
+            graph_changed = true;
+            if (!redescend(descent, first + i, batch_rng))
+                return false;
+        } else {
+            for (const auto &[node, tactic_id, thm, previous]: descent.virtual_losses) {
+                node->add_virtual_count(tactic_id, params.virtual_loss);
+                descent.sim.set_virtual_count_added(thm, true, previous);
+            }
+        }
+
+        if (descent.to_expand.empty()) {
 #ifdef VERBOSE_PRINTS
             printf("To expand is empty!");
 #endif
             assert (!propagate_needed);
             propagate_needed = true;
             find_unexplored_and_propagate_expandable();
-            cleanup(sim);
-            break;
+            cleanup(descent.sim);
+            return false;
         }
-        _single_to_expand(single_to_expand, sim, to_expand);
+        _single_to_expand(single_to_expand, descent.sim, descent.to_expand);
         for (const auto &thm: single_to_expand) {
             result.insert(thm, thm);
         }
     }
-    if (result.empty()) {
-        done = true;
-        return;
-    }
-    // TODO: maybe we need the n_expansions here to decide whether we are done
-    for (const auto &[unique_str, thm]: result) {
-        theorems.push_back(thm);
+    return true;
+}
+
+bool HTPS::redescend(WaveDescent &descent, size_t index, const Rng &batch_rng) {
+    // The same substream as the first attempt, so the descent is identical up to the first change of the graph
+    Rng descent_rng = batch_rng.substream(index);
+    descent.terminal.clear();
+    descent.to_expand.clear();
+    descent.virtual_losses.clear();
+    while (!dead_root()) {
+#ifdef VERBOSE_PRINTS
+        printf("Finding leaves to expand\n");
+#endif
+        if (_find_leaves_to_expand(descent.sim, descent.terminal, descent.to_expand, descent_rng, nullptr) ==
+            DescentStatus::Found)
+            return true;
+        descent.terminal.clear();
+        descent.to_expand.clear();
     }
+    return false;
 }
 
 void HTPS::_single_to_expand(std::vector<TheoremPointer> &theorems, Simulation &sim,
@@ -1326,12 +1813,13 @@ void HTPS::_single_to_expand(std::vector<TheoremPointer> &theorems, Simulation &
 #endif
     simulations.push_back(sim_ptr);
     for (const auto &[leaf, hash_]: leaves_to_expand) {
+        // The same leaf can be reached through several paths, each of them needs the value once it is expanded
+        if (simulations_for_theorem.contains(leaf))
+            simulations_for_theorem.at(leaf).emplace_back(sim_ptr, hash_);
+        else
+            simulations_for_theorem.insert(leaf, std::vector<std::pair<std::shared_ptr<Simulation>, size_t>>{{sim_ptr, hash_}});
         if (!seen.contains(leaf)) {
             seen.insert(leaf);
-            if (simulations_for_theorem.contains(leaf))
-                simulations_for_theorem.at(leaf).emplace_back(sim_ptr, hash_);
-            else
-                simulations_for_theorem.insert(leaf, std::vector<std::pair<std::shared_ptr<Simulation>, size_t>>{{sim_ptr, hash_}});
             sim_ptr->increment_expansions();
         }
         if (!currently_expanding.contains(leaf)) {
@@ -1348,30 +1836,73 @@ std::vector<TheoremPointer> HTPS::batch_to_expand() {
 }
 
 void HTPS::expand_and_backup(std::vector<std::shared_ptr<env_expansion>> &expansions) {
+    if (time_budget)
+        time_budget->record_expansions(expansions);
+    if (!expansion_cache && cached_expansions.empty()) {
+        integrate_expansions(expansions);
+        return;
+    }
+    if (expansion_cache) {
+        for (const auto &expansion: expansions) {
+            expansion_cache->insert(expansion);
+        }
+    }
+    std::vector<std::shared_ptr<env_expansion>> combined(expansions);
+    combined.insert(combined.end(), cached_expansions.begin(), cached_expansions.end());
+    cached_expansions.clear();
+    integrate_expansions(combined);
+}
+
+void HTPS::integrate_expansions(std::vector<std::shared_ptr<env_expansion>> &expansions) {
     expand(expansions);
     backup();
 
-    assert(std::none_of(nodes.begin(), nodes.end(), [](const auto &node) {
+    // Only once every simulation is backed up, expansions may arrive in several parts
+    assert(!simulations.empty() || std::none_of(nodes.begin(), nodes.end(), [](const auto &node) {
         return node.second->has_virtual_count();
     }));
-    if (is_proven() && !initial_minimum_proof_size.has_value()) {
-        build_in_proof();
-        get_node_proof_sizes_and_depths();
-        for (size_t i = 0; i < METRIC_COUNT; i++) {
-            initial_minimum_proof_size.set(static_cast<Metric>(i),
-                                           nodes.at(root)->minimum_length(static_cast<Metric>(i)));
-            assert(initial_minimum_proof_size.has_value(static_cast<Metric>(i)));
-            assert(nodes.at(root)->is_in_minimum_proof(static_cast<Metric>(i)));
-        }
-        reset_minimum_proof_stats();
-    }
+    if (is_proven() && !initial_minimum_proof_size.has_value())
+        set_initial_minimum_proof_size();
     if (is_proven()) {
         done = done || params.early_stopping;
     }
     assert(nodes.size() == expansion_count); // not sure whether this is correct
     done = done || (expansion_count >= params.num_expansions);
-//    if (!done)
-//        HTPS_move();
+    if (time_budget) {
+        if (!is_expanding())
+            time_budget->end_round();
+        done = done || time_budget->expired();
+    }
+}
+
+void HTPS::set_initial_minimum_proof_size() {
+    build_in_proof();
+    get_node_proof_sizes_and_depths();
+    for (size_t i = 0; i < METRIC_COUNT; i++) {
+        initial_minimum_proof_size.set(static_cast<Metric>(i),
+                                       nodes.at(root)->minimum_length(static_cast<Metric>(i)));
+        assert(initial_minimum_proof_size.has_value(static_cast<Metric>(i)));
+        assert(nodes.at(root)->is_in_minimum_proof(static_cast<Metric>(i)));
+    }
+    reset_minimum_proof_stats();
+}
+
+void HTPS::move_root(TheoremPointer &new_root) {
+    if (is_expanding()) {
+        throw std::runtime_error("Currently expanding is not empty, give results first!");
+    }
+    Graph::move_root(new_root);
+    expansion_count = nodes.size();
+    // Hashes include the root, none of the old simulations can occur again
+    backedup_hashes.clear();
+    propagate_needed = true;
+    find_unexplored_and_propagate_expandable();
+    done = false;
+    if (is_proven()) {
+        set_initial_minimum_proof_size();
+        done = params.early_stopping;
+    }
+    done = done || (expansion_count >= params.num_expansions);
 }
 
 bool HTPS::is_expanding() const {
@@ -1379,10 +1910,39 @@ bool HTPS::is_expanding() const {
 }
 
 void HTPS::theorems_to_expand(std::vector<TheoremPointer> &theorems) {
-    if (is_expanding()) {
+    if (is_expanding() && !params.async_expansions) {
         throw std::runtime_error("Currently expanding is not empty, give results first!");
     }
-    return batch_to_expand(theorems);
+    batch_to_expand(theorems);
+    if (!expansion_cache)
+        return;
+    answer_from_cache(theorems);
+    // As long as whole batches are answered from the cache, the caller does not need to be involved
+    while (theorems.empty() && !cached_expansions.empty()) {
+        std::vector<std::shared_ptr<env_expansion>> hits;
+        hits.swap(cached_expansions);
+        integrate_expansions(hits);
+        if (done)
+            return;
+        batch_to_expand(theorems);
+        answer_from_cache(theorems);
+    }
+}
+
+void HTPS::answer_from_cache(std::vector<TheoremPointer> &theorems) {
+    auto misses = theorems.begin();
+    for (auto &thm: theorems) {
+        auto hit = expansion_cache->lookup(thm);
+        if (hit)
+            cached_expansions.push_back(hit);
+        else
+            *misses++ = thm;
+    }
+    theorems.erase(misses, theorems.end());
+}
+
+void HTPS::set_expansion_cache(const std::shared_ptr<ExpansionCache> &cache) {
+    expansion_cache = cache;
 }
 
 std::vector<TheoremPointer> HTPS::theorems_to_expand() {
@@ -1391,7 +1951,19 @@ std::vector<TheoremPointer> HTPS::theorems_to_expand() {
     return theorems;
 }
 
+void HTPS::discard_expansions() {
+    for (const auto &simulation: simulations) {
+        cleanup(*simulation);
+    }
+    simulations.clear();
+    simulations_for_theorem = TheoremMap<std::vector<std::pair<std::shared_ptr<Simulation>, size_t>>>();
+    currently_expanding.clear();
+    cached_expansions.clear();
+}
+
 HTPSResult HTPS::get_result() {
+    if (params.async_expansions)
+        discard_expansions();
     check_solved_consistency();
     for (const auto &[thm, node]: nodes) {
         assert(!node->has_virtual_count());
@@ -1408,10 +1980,28 @@ HTPSResult HTPS::get_result() {
     std::vector<HTPSSampleEffect> samples_effects;
     std::vector<HTPSSampleCritic> samples_critic;
     std::vector<HTPSSampleTactics> samples_tactics;
-    get_train_samples(samples_effects, samples_critic, samples_tactics);
+    if (harvest_count > 0) {
+        Rng sample_rng = rng.substream(std::numeric_limits<uint64_t>::max() - harvest_count);
+        collect_train_samples(samples_effects, samples_critic, samples_tactics, sample_rng, true, true);
+    } else {
+        get_train_samples(samples_effects, samples_critic, samples_tactics);
+    }
     std::vector<HTPSSampleTactics> proof_samples_tactics;
     get_proof_samples(proof_samples_tactics);
-    return {samples_critic, samples_tactics, samples_effects, params.metric, proof_samples_tactics, root, p};
+    return {std::move(samples_critic), std::move(samples_tactics), std::move(samples_effects), params.metric,
+            std::move(proof_samples_tactics), root, std::move(p)};
+}
+
+HTPSResult HTPS::harvest() {
+    std::vector<HTPSSampleEffect> samples_effects;
+    std::vector<HTPSSampleCritic> samples_critic;
+    std::vector<HTPSSampleTactics> samples_tactics;
+    // Every harvest draws from a substream of its own, the first one from the same as get_train_samples
+    Rng sample_rng = rng.substream(std::numeric_limits<uint64_t>::max() - harvest_count);
+    collect_train_samples(samples_effects, samples_critic, samples_tactics, sample_rng, true, false);
+    harvest_count++;
+    return {std::move(samples_critic), std::move(samples_tactics), std::move(samples_effects), params.metric, {}, root,
+            std::nullopt};
 }
 
 void HTPS::set_root(TheoremPointer &thm) {
@@ -1425,8 +2015,19 @@ void HTPS::set_root(TheoremPointer &thm) {
 }
 
 void HTPS::set_params(const htps_params &new_params) {
+    if (new_params.time_budget_ms != params.time_budget_ms)
+        time_budget.reset();
     params = new_params;
     policy = std::make_shared<Policy>(params.policy_type, params.exploration);
+    choose_selection_kernel();
+    for (auto &[thm, node]: nodes) {
+        node->set_widening(params.widening_constant, params.widening_exponent);
+    }
+}
+
+void HTPS::set_seed(uint64_t seed) {
+    search_seed = seed;
+    rng.seed(seed);
 }
 
 size_t HTPS::num_expansions() const {
@@ -1449,45 +2050,45 @@ HTPS HTPS::from_json(const nlohmann::json &j) {
     htps.initial_minimum_proof_size = MinimumLengthMap::from_json(j["initial_minimum_proof_size"]);
     htps.policy = j["policy"];
     htps.params = htps_params::from_json(j["params"]);
+    htps.choose_selection_kernel();
     htps.expansion_count = j["expansion_count"];
     htps.simulations = std::vector<std::shared_ptr<Simulation>>();
-    for (const auto &sim: j["simulations"]) {
-        htps.simulations.push_back(sim);
-    }
-    for (auto &sim: htps.simulations) {
+    std::unordered_map<size_t, std::shared_ptr<Simulation>> simulations_by_id;
+    for (const auto &sim_json: j["simulations"]) {
+        std::shared_ptr<Simulation> sim = sim_json;
         sim->deduplicate(htps.root);
+        if (sim_json.contains("id"))
+            simulations_by_id.emplace(sim_json["id"].get<size_t>(), sim);
+        htps.simulations.push_back(sim);
     }
     TheoremMap<std::vector<std::pair<std::shared_ptr<Simulation>, size_t>>> simulations_for_theorem;
-    if (j["simulations_for_theorem"].is_null())
-        simulations_for_theorem = TheoremMap<std::vector<std::pair<std::shared_ptr<Simulation>, size_t>>>();
-    else {
-        // Can only map a single simulation to simulations for theorem once
-        std::vector<bool> sims_used(htps.simulations.size(), false);
+    if (!j["simulations_for_theorem"].is_null()) {
+        // Entries are [simulation id, leaf hash], so that they share the simulation restored above
         for (const auto &[thm_str, sim]: j["simulations_for_theorem"].items()) {
             std::vector<std::pair<std::shared_ptr<Simulation>, size_t>> sims;
             for (const auto &s: sim) {
-                // Find the simulation in simulations, use that one
-                std::shared_ptr<Simulation> current_sim = s[0];
-                size_t hash_ = s[1];
-                for (size_t i = 0; i < htps.simulations.size(); i++) {
-                    if (!sims_used[i] && *htps.simulations[i] == *current_sim) {
-                        current_sim = htps.simulations[i];
-                        sims_used[i] = true;
-                        break;
-                    }
-                }
-                sims.emplace_back(current_sim, hash_);
+                auto it = simulations_by_id.find(s[0].get<size_t>());
+                if (it == simulations_by_id.end())
+                    throw std::runtime_error("Unknown simulation id in simulations_for_theorem");
+                sims.emplace_back(it->second, s[1].get<size_t>());
             }
-            simulations_for_theorem.insert(static_cast<std::string>(thm_str), sims);
+            simulations_for_theorem.insert(static_cast<std::string>(thm_str), std::move(sims));
         }
     }
-    htps.simulations_for_theorem = simulations_for_theorem;
+    htps.simulations_for_theorem = std::move(simulations_for_theorem);
     htps.backedup_hashes = j["backedup_hashes"].get<std::unordered_set<size_t>>();
     htps.currently_expanding = TheoremSet::from_json(j["currently_expanding"]);
+    if (j.contains("cached_expansions")) {
+        for (const auto &expansion: j["cached_expansions"]) {
+            htps.cached_expansions.push_back(std::make_shared<env_expansion>(env_expansion::from_json(expansion)));
+        }
+    }
     htps.propagate_needed = j["propagate_needed"];
     htps.done = j["done"];
-    htps::seed = j["seed"];
-    htps::gen = setup_gen();
+    htps.search_seed = j["seed"];
+    htps.rng.seed(htps.search_seed);
+    if (j.contains("rng"))
+        htps.rng.set_state(j["rng"].get<std::array<uint64_t, 4>>());
     return htps;
 }
 
@@ -1515,64 +2116,114 @@ HTPS::operator nlohmann::json() const {
     j["policy"] = nlohmann::json(*policy);
     j["params"] = nlohmann::json(params);
     j["expansion_count"] = expansion_count;
+    // Each simulation gets an id, which simulations_for_theorem uses to refer to it
+    std::unordered_map<const Simulation *, size_t> simulation_ids;
     std::vector<nlohmann::json> simulations_explicit;
     for (const auto &sim: simulations) {
-        simulations_explicit.push_back((*sim).operator nlohmann::json());
+        auto sim_json = (*sim).operator nlohmann::json();
+        sim_json["id"] = simulations_explicit.size();
+        simulation_ids.emplace(sim.get(), simulations_explicit.size());
+        simulations_explicit.push_back(std::move(sim_json));
     }
     j["simulations"] = simulations_explicit;
     nlohmann::json simulations_for_theorem_json;
     for (const auto &[thm, sims]: simulations_for_theorem) {
         std::vector<nlohmann::json> sims_explicit;
-        for (const auto &sim: sims) {
-            nlohmann::json inner = nlohmann::json::array();
-            inner.push_back(sim.first->operator nlohmann::json());
-            inner.push_back(sim.second);
+        for (const auto &[sim, hash_]: sims) {
+            // Simulations waiting for an expansion are always pending
+            auto it = simulation_ids.find(sim.get());
+            if (it == simulation_ids.end())
+                throw std::runtime_error("Simulation waiting for an expansion is not pending");
+            sims_explicit.push_back(nlohmann::json::array({it->second, hash_}));
         }
         simulations_for_theorem_json[thm] = sims_explicit;
     }
     j["simulations_for_theorem"] = simulations_for_theorem_json;
     j["backedup_hashes"] = backedup_hashes;
     j["currently_expanding"] = nlohmann::json(currently_expanding);
+    std::vector<nlohmann::json> cached_explicit;
+    for (const auto &expansion: cached_expansions) {
+        cached_explicit.push_back(nlohmann::json(*expansion));
+    }
+    j["cached_expansions"] = cached_explicit;
     j["propagate_needed"] = propagate_needed;
     j["done"] = done;
-    j["seed"] = htps::seed;
+    j["seed"] = search_seed;
+    j["rng"] = rng.get_state();
     return j;
 }
 
+std::string HTPS::get_binary() const {
+    return snapshot::encode(nlohmann::json(*this));
+}
+
+HTPS HTPS::from_binary(std::string_view data) {
+    return from_json(snapshot::decode(data));
+}
+
+void HTPS::save_binary(const std::string &path) const {
+    auto data = get_binary();
+    BinaryFileWriter writer(path);
+    writer.write(data.data(), data.size());
+    writer.close();
+}
+
+HTPS HTPS::load_binary(const std::string &path) {
+    MappedFile file(path);
+    return from_binary({file.data(), file.size()});
+}
+
 htps::htps_params HTPS::get_params() const {
     return params;
 }
 
 
-std::optional<proof> HTPSResult::get_proof() const {
+const std::optional<proof> &HTPSResult::get_proof() const {
     return p;
 }
 
-TheoremPointer HTPSResult::get_goal() const {
+const TheoremPointer &HTPSResult::get_goal() const {
     return goal;
 }
 
-std::tuple<std::vector<HTPSSampleCritic>, std::vector<HTPSSampleTactics>, std::vector<HTPSSampleEffect>, Metric, std::vector<HTPSSampleTactics>>
+std::tuple<const std::vector<HTPSSampleCritic> &, const std::vector<HTPSSampleTactics> &,
+        const std::vector<HTPSSampleEffect> &, Metric, const std::vector<HTPSSampleTactics> &>
 HTPSResult::get_samples() const {
     return {samples_critic, samples_tactic, samples_effect, metric, proof_samples_tactics};
 }
 
-std::vector<HTPSSampleTactics> HTPSResult::get_proof_samples() const {
+const std::vector<HTPSSampleTactics> &HTPSResult::get_proof_samples() const {
     return proof_samples_tactics;
 }
 
-std::vector<HTPSSampleCritic> HTPSResult::get_critic_samples() const {
+const std::vector<HTPSSampleCritic> &HTPSResult::get_critic_samples() const {
     return samples_critic;
 }
 
-std::vector<HTPSSampleTactics> HTPSResult::get_tactic_samples() const {
+const std::vector<HTPSSampleTactics> &HTPSResult::get_tactic_samples() const {
     return samples_tactic;
 }
 
-std::vector<HTPSSampleEffect> HTPSResult::get_effect_samples() const {
+const std::vector<HTPSSampleEffect> &HTPSResult::get_effect_samples() const {
     return samples_effect;
 }
 
+std::vector<HTPSSampleTactics> HTPSResult::take_proof_samples() {
+    return std::exchange(proof_samples_tactics, {});
+}
+
+std::vector<HTPSSampleCritic> HTPSResult::take_critic_samples() {
+    return std::exchange(samples_critic, {});
+}
+
+std::vector<HTPSSampleTactics> HTPSResult::take_tactic_samples() {
+    return std::exchange(samples_tactic, {});
+}
+
+std::vector<HTPSSampleEffect> HTPSResult::take_effect_samples() {
+    return std::exchange(samples_effect, {});
+}
+
 Metric HTPSResult::get_metric() const {
     return metric;
 }
@@ -1601,6 +2252,11 @@ htps_params::operator nlohmann::json() const {
     j["tactic_sample_q_conditioning"] = tactic_sample_q_conditioning;
     j["depth_penalty"] = depth_penalty;
     j["metric"] = metric;
+    j["num_threads"] = num_threads;
+    j["async_expansions"] = async_expansions;
+    j["time_budget_ms"] = time_budget_ms;
+    j["widening_constant"] = widening_constant;
+    j["widening_exponent"] = widening_exponent;
     return j;
 }
 
@@ -1628,5 +2284,11 @@ htps_params htps_params::from_json(const nlohmann::json &j) {
     params.tactic_sample_q_conditioning = j["tactic_sample_q_conditioning"];
     params.depth_penalty = j["depth_penalty"];
     params.metric = j["metric"];
+    // Optional, searches serialized before this parameter existed select sequentially
+    params.num_threads = j.value("num_threads", static_cast<size_t>(1));
+    params.async_expansions = j.value("async_expansions", false);
+    params.time_budget_ms = j.value("time_budget_ms", 0ul);
+    params.widening_constant = j.value("widening_constant", 0.0);
+    params.widening_exponent = j.value("widening_exponent", 0.5);
     return params;
 }
\ No newline at end of file
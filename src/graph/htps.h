@@ -12,6 +12,11 @@
 #include "base.h"
 #include "../model/policy.h"
 #include "../env/core.h"
+#include "../env/cache.h"
+#include "../util/concurrency.h"
+#include "../util/random.h"
+#include "budget.h"
+#include "snapshot.h"
 #include <memory>
 #include <utility>
 #include <vector>
@@ -19,14 +24,18 @@
 #include <cassert>
 #include <algorithm>
 #include <random>
+#include <map>
+#include <optional>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <string_view>
 
 namespace htps {
 
     size_t get_seed();
-    std::mt19937 setup_gen();
 
-    extern std::mt19937 gen;
-    extern std::uniform_real_distribution<double> dis;
+    // Seed of new searches, taken from the SEED environment variable if it is set. See HTPS::set_seed
     extern size_t seed;
 
     class HTPSSampleEffect {
@@ -42,13 +51,13 @@ namespace htps {
 
         HTPSSampleEffect() = default;
 
-        TheoremPointer get_goal() const;
+        const TheoremPointer &get_goal() const;
 
-        std::shared_ptr<tactic> get_tactic() const;
+        const std::shared_ptr<tactic> &get_tactic() const;
 
         void set_children(std::vector<TheoremPointer> &children) const;
 
-        std::vector<TheoremPointer> get_children() const;
+        const std::vector<TheoremPointer> &get_children() const;
     };
 
     class HTPSSampleCritic {
@@ -71,7 +80,7 @@ namespace htps {
 
         HTPSSampleCritic() = default;
 
-        TheoremPointer get_goal() const {
+        const TheoremPointer &get_goal() const {
             return goal;
         }
 
@@ -113,30 +122,30 @@ namespace htps {
         size_t visit_count;
 
     public:
-        HTPSSampleTactics(TheoremPointer goal, const std::vector<std::shared_ptr<tactic>> &tactics,
-                          const std::vector<double> &target_pi, enum InProof inproof,
-                          const std::vector<double> &q_estimates,
+        HTPSSampleTactics(TheoremPointer goal, std::vector<std::shared_ptr<tactic>> tactics,
+                          std::vector<double> target_pi, enum InProof inproof,
+                          std::vector<double> q_estimates,
                           size_t visit_count) :
-                goal(std::move(goal)), tactics(tactics), target_pi(target_pi), inproof(inproof),
-                q_estimates(q_estimates),
+                goal(std::move(goal)), tactics(std::move(tactics)), target_pi(std::move(target_pi)), inproof(inproof),
+                q_estimates(std::move(q_estimates)),
                 visit_count(visit_count) {
-            assert(target_pi.size() == tactics.size());
-            assert(q_estimates.size() == tactics.size() || q_estimates.empty());
+            assert(this->target_pi.size() == this->tactics.size());
+            assert(this->q_estimates.size() == this->tactics.size() || this->q_estimates.empty());
             assert(inproof != InProofCount);
-            assert(!tactics.empty());
+            assert(!this->tactics.empty());
         }
 
         HTPSSampleTactics() = default;
 
-        TheoremPointer get_goal() const {
+        const TheoremPointer &get_goal() const {
             return goal;
         }
 
-        std::vector<std::shared_ptr<tactic>> get_tactics() const {
+        const std::vector<std::shared_ptr<tactic>> &get_tactics() const {
             return tactics;
         }
 
-        std::vector<double> get_target_pi() const {
+        const std::vector<double> &get_target_pi() const {
             return target_pi;
         }
 
@@ -144,7 +153,7 @@ namespace htps {
             return inproof;
         }
 
-        std::vector<double> get_q_estimates() const {
+        const std::vector<double> &get_q_estimates() const {
             return q_estimates;
         }
 
@@ -202,6 +211,11 @@ namespace htps {
         // If the root is not proven, we do not explore already solved nodes
         bool early_stopping_solved_if_root_not_proven;
         size_t virtual_loss; // The number of virtual count added for each visit
+        size_t num_threads; // Number of threads selecting leaves in a batch. 0 or 1 select sequentially
+        bool async_expansions; // Allow selecting new theorems while expansions of previous batches are outstanding
+        size_t time_budget_ms; // Wall-clock budget of the search in milliseconds, 0 disables it. See TimeBudget
+        double widening_constant; // Progressive widening, a node admits ceil(c * (visits + 1)^alpha) tactics. 0 disables it
+        double widening_exponent; // alpha of progressive widening
 
         operator nlohmann::json() const;
 
@@ -337,6 +351,7 @@ namespace htps {
 
         static Simulation from_json(const nlohmann::json &j);
 
+        // Replaces the copies of ptr in the simulation by ptr itself, e.g. to share the root after loading
         void deduplicate(const TheoremPointer &ptr);
     };
 }
@@ -371,21 +386,98 @@ struct std::hash<htps::Simulation> {
 
 
 namespace htps {
+#ifdef HTPS_FLOAT_STATS
+    /* Per-tactic statistics of HTPSNode in single precision, which halves their memory in large searches.
+     * Backups are still accumulated in double precision, only the stored results are rounded. Counts are limited to
+     * 2^32 - 1 visits per tactic. Compare both modes with ./bench float_stats.
+     * */
+    using stat_t = float;
+    using count_t = uint32_t;
+#else
+    using stat_t = double;
+    using count_t = size_t;
+#endif
+
+    /* log(exp(a) + exp(b)), shifted by the larger of the two so that the exponent never overflows.
+     * Exact if either of them is MIN_FLOAT. */
+    inline double log_add_exp(double a, double b) {
+        double high = std::max(a, b);
+        if (high == MIN_FLOAT)
+            return MIN_FLOAT;
+        return high + std::log1p(std::exp(std::min(a, b) - high));
+    }
+
+    /* Samples a tactic with probability proportional to exp(log(policy) / temperature), drawing a single random number.
+     * The policy is overwritten with the unnormalized weights, nothing is allocated. */
+    size_t sample_tactic(std::span<double> policy, double temperature, Rng &rng);
+
+    /* Buffers for computing the policy of a node. They are reused between nodes, so once they have grown to the largest
+     * number of tactics, computing policies no longer allocates. Every thread has its own, see local().
+     * */
+    struct PolicyScratch {
+        std::vector<double> q_values;
+        std::vector<double> priors;
+        std::vector<size_t> counts;
+        std::vector<size_t> selected; // Tactics admitted by progressive widening
+        std::vector<double> active_policy; // Policy over the admitted tactics
+        std::vector<double> policy; // Result of the selection in HTPS::_find_leaves_to_expand
+
+        static PolicyScratch &local();
+    };
+
+    /* What HTPS::harvest has emitted for a node: whether its effects were, and the versions of the node its critic and
+     * tactic samples were taken at. */
+    struct HarvestState {
+        static constexpr size_t NOT_HARVESTED = std::numeric_limits<size_t>::max();
+        bool effects = false;
+        size_t critic_version = NOT_HARVESTED;
+        size_t tactics_version = NOT_HARVESTED;
+    };
+
     class HTPSNode : public Node {
     private:
         double old_critic_value{};
         double log_critic_value{};
-        std::vector<double> priors;
+        std::vector<stat_t> priors;
         QValueSolved q_value_solved;
         std::vector<std::shared_ptr<env_effect>> effects;
         std::shared_ptr<Policy> policy;
         double exploration{};
         double tactic_init_value = 0.0;
-        std::vector<double> log_w; // Total action value
-        std::vector<size_t> counts; // Total action count
-        std::vector<size_t> virtual_counts;
+        std::vector<stat_t> log_w; // Total action value
+        std::vector<count_t> counts; // Total action count
+        std::vector<count_t> virtual_counts; // Only accessed atomically, since parallel descents add virtual loss concurrently
         std::vector<bool> reset_mask; // Indicates whether logW should be reset, i.e. new values override old ones
         bool error = false;
+        double widening_constant = 0.0;
+        double widening_exponent = 0.0;
+        std::vector<size_t> prior_order; // Tactic ids by decreasing prior, only filled with progressive widening
+        /* The policy without force_expansion and the value, valid as long as version equals the version they were
+         * computed at. The selection runs concurrently on the same nodes and never fills them, only single-threaded
+         * readers like get_value and the sample extraction do. */
+        static constexpr size_t NOT_CACHED = std::numeric_limits<size_t>::max();
+        mutable std::vector<double> cached_policy;
+        mutable size_t cached_policy_version = NOT_CACHED;
+        mutable double cached_value = 0.0;
+        mutable size_t cached_value_version = NOT_CACHED;
+        HarvestState harvest_state; // Not copied, a copied node starts without statistics
+
+        // The priors as doubles, converted into the scratch buffer if they are stored in single precision
+        std::span<const double> prior_values(PolicyScratch &scratch) const;
+
+        // Q value of a tactic given its visit count including virtual counts
+        double q_value(size_t tactic_id, size_t full_count) const;
+
+        template<QValueSolved q_value_solved_type>
+        double q_value_as(size_t tactic_id, size_t full_count) const;
+
+        template<typename QValueFn, typename EvaluateFn>
+        void compute_policy_with(std::vector<double> &result, PolicyScratch &scratch, bool force_expansion,
+                                 QValueFn q_value_of, EvaluateFn evaluate) const;
+
+        template<typename QValueFn, typename EvaluateFn>
+        void compute_widened_policy(std::vector<double> &result, bool expandable_only, PolicyScratch &scratch,
+                                    QValueFn q_value_of, EvaluateFn evaluate) const;
 
         void get_tactics_sample_q_conditioning(size_t count_threshold,
                                                std::vector<std::shared_ptr<tactic>> &valid_tactics,
@@ -407,7 +499,8 @@ namespace htps {
                  const double tactic_init_value,
                  const std::vector<std::shared_ptr<env_effect>> &effects, const bool error = false) :
                 Node(thm, tactics, children_for_tactic), old_critic_value(0.0), log_critic_value(log_critic_value),
-                priors(priors), q_value_solved(q_value_solved), effects(effects), policy(policy), exploration(exploration),
+                priors(priors.begin(), priors.end()), q_value_solved(q_value_solved), effects(effects), policy(policy),
+                exploration(exploration),
                 tactic_init_value(tactic_init_value), log_w(tactics.size()), counts(), virtual_counts(),
                 reset_mask(tactics.size()), error(error) {
             assert(_validate());
@@ -426,7 +519,10 @@ namespace htps {
                   tactic_init_value(node.tactic_init_value),
                   log_w(node.log_w),
                   reset_mask(node.reset_mask),
-                  error(node.error) {
+                  error(node.error),
+                  widening_constant(node.widening_constant),
+                  widening_exponent(node.widening_exponent),
+                  prior_order(node.prior_order) {
             assert(_validate());
             reset_HTPS_stats();
         }
@@ -437,11 +533,14 @@ namespace htps {
 
         bool should_send(size_t count_threshold) const;
 
-        void get_effect_samples(std::vector<HTPSSampleEffect> &samples, double subsampling_rate = 1.0) const;
+        // Keeps each effect with probability subsampling_rate, drawing from rng unless the rate is 1
+        void get_effect_samples(std::vector<HTPSSampleEffect> &samples, double subsampling_rate, Rng &rng) const;
 
-        std::vector<HTPSSampleEffect> get_effect_samples(double subsampling_rate = 1.0) const;
+        std::vector<HTPSSampleEffect> get_effect_samples() const;
+
+        std::optional<HTPSSampleCritic> get_critic_sample(double subsampling_rate, Rng &rng) const;
 
-        std::optional<HTPSSampleCritic> get_critic_sample(double subsampling_rate = 1.0) const;
+        std::optional<HTPSSampleCritic> get_critic_sample() const;
 
         std::optional<HTPSSampleTactics>
         get_tactics_sample(Metric metric, NodeMask node_mask, bool only_learn_best_tactics, double p_threshold = 0.0,
@@ -449,20 +548,57 @@ namespace htps {
 
         bool kill_tactic(size_t tactic_id) override;
 
+        void revive_tactic(size_t tactic_id) override;
+
+        /* Enables progressive widening if constant is positive: the policy only covers the ceil(constant *
+         * (visits + 1)^exponent) tactics with the highest priors among the ones that can be chosen, where visits
+         * include virtual counts. All other tactics have probability 0. */
+        void set_widening(double constant, double exponent);
+
+        HarvestState &get_harvest_state() {
+            return harvest_state;
+        }
+
+        // Number of tactics admitted by progressive widening, all tactics if it is disabled
+        size_t active_tactic_count() const;
+
+        void compute_policy(std::vector<double> &result, PolicyScratch &scratch, bool force_expansion = false) const;
+
         void compute_policy(std::vector<double> &result, bool force_expansion = false) const;
 
+        /* compute_policy with the policy type and q_value_solved fixed at compile time, so neither is dispatched on
+         * inside the loops over the tactics. Only valid if specialized_for returns true for the same arguments. */
+        template<PolicyType policy_type, QValueSolved q_value_solved_type>
+        void compute_policy_as(std::vector<double> &result, PolicyScratch &scratch, bool force_expansion) const;
+
+        // Whether the node uses a plain Policy of the given type and the given q_value_solved
+        bool specialized_for(PolicyType policy_type, QValueSolved q_value_solved_type) const;
+
         std::vector<double> compute_policy(bool force_expansion = false) const;
 
+        // compute_policy without force_expansion, only recomputed once the node changed
+        const std::vector<double> &get_policy() const;
+
         void update(size_t tactic_id, double backup_value);
 
+        /* Applies several backups of the same tactic at once, combining them with a single log-sum-exp.
+         * */
+        void update_batch(size_t tactic_id, const std::vector<double> &backup_values);
+
         /* Get the logarithmic value of the node.
          * */
         double get_value() const;
 
+        /* get_value without filling the value cache. For solved and terminal nodes it takes constant time and touches no
+         * cache at all, so the concurrent selection can call it. */
+        double compute_value() const;
+
         void add_virtual_count(size_t tactic_id, size_t count);
 
         void subtract_virtual_count(size_t tactic_id, size_t count);
 
+        size_t get_virtual_count(size_t tactic_id) const;
+
         bool has_virtual_count(size_t tactic_id) const;
 
         bool has_virtual_count() const;
@@ -489,33 +625,45 @@ namespace htps {
         TheoremPointer goal;
         std::optional<struct proof> p;
     public:
-        HTPSResult(std::vector<HTPSSampleCritic> &samples_critic, std::vector<HTPSSampleTactics> &samples_tactic,
-                   std::vector<HTPSSampleEffect> &samples_effect, Metric metric,
-                   std::vector<HTPSSampleTactics> &proof_samples_tactics, TheoremPointer &goal,
-                   std::optional<struct proof> &p) :
-                samples_critic(samples_critic), samples_tactic(samples_tactic), samples_effect(samples_effect),
-                metric(metric), proof_samples_tactics(proof_samples_tactics), goal(goal),
-                p(p) {}
+        // Pass the samples with std::move to avoid copying them
+        HTPSResult(std::vector<HTPSSampleCritic> samples_critic, std::vector<HTPSSampleTactics> samples_tactic,
+                   std::vector<HTPSSampleEffect> samples_effect, Metric metric,
+                   std::vector<HTPSSampleTactics> proof_samples_tactics, TheoremPointer goal,
+                   std::optional<struct proof> p) :
+                samples_critic(std::move(samples_critic)), samples_tactic(std::move(samples_tactic)),
+                samples_effect(std::move(samples_effect)), metric(metric),
+                proof_samples_tactics(std::move(proof_samples_tactics)), goal(std::move(goal)), p(std::move(p)) {}
 
         HTPSResult() = default;
 
-        std::optional<struct proof> get_proof() const;
+        const std::optional<struct proof> &get_proof() const;
 
-        TheoremPointer get_goal() const;
+        const TheoremPointer &get_goal() const;
 
         Metric get_metric() const;
 
-        std::tuple<std::vector<HTPSSampleCritic>, std::vector<HTPSSampleTactics>, std::vector<HTPSSampleEffect>, Metric, std::vector<HTPSSampleTactics>>
+        /* The getters return views into the result, which stay valid as long as the result is alive and the samples
+         * have not been taken. */
+        std::tuple<const std::vector<HTPSSampleCritic> &, const std::vector<HTPSSampleTactics> &,
+                const std::vector<HTPSSampleEffect> &, Metric, const std::vector<HTPSSampleTactics> &>
         get_samples() const;
 
-        std::vector<HTPSSampleTactics> get_proof_samples() const;
+        const std::vector<HTPSSampleTactics> &get_proof_samples() const;
 
-        std::vector<HTPSSampleCritic> get_critic_samples() const;
+        const std::vector<HTPSSampleCritic> &get_critic_samples() const;
 
-        std::vector<HTPSSampleTactics> get_tactic_samples() const;
+        const std::vector<HTPSSampleTactics> &get_tactic_samples() const;
 
-        std::vector<HTPSSampleEffect> get_effect_samples() const;
+        const std::vector<HTPSSampleEffect> &get_effect_samples() const;
+
+        // Move the samples out of the result without copying them, the result is left without them
+        std::vector<HTPSSampleTactics> take_proof_samples();
+
+        std::vector<HTPSSampleCritic> take_critic_samples();
+
+        std::vector<HTPSSampleTactics> take_tactic_samples();
 
+        std::vector<HTPSSampleEffect> take_effect_samples();
 
     };
 
@@ -523,7 +671,8 @@ namespace htps {
  * @class FailedTacticException
  * @brief Custom exception class for handling failed tactics.
  *
- * This exception is thrown whenever a tactic would introduce a circle.
+ * Thrown by find_leaves_to_expand if the descent reached a node whose tactics all introduce a circle. Batches are
+ * selected without it, see HTPS::DescentStatus.
  */
     class FailedTacticException : public std::exception {
     public:
@@ -549,9 +698,104 @@ namespace htps {
         TheoremSet currently_expanding; // Theorems that are currently being expanded
         bool propagate_needed; // Whether propagation is required. Is set to true whenever find_to_expand fails
         bool done;
+        std::shared_ptr<ExpansionCache> expansion_cache; // Optional, shared with other searches
+        std::vector<std::shared_ptr<env_expansion>> cached_expansions; // Cache hits held back until the misses of their batch are returned
+        std::optional<TimeBudget> time_budget; // Created with the first batch if params.time_budget_ms is set
+
+        /* Every batch draws a generator from rng, and each descent of the batch uses the substream for its index, so the
+         * random numbers of a descent do not depend on the thread it runs on. */
+        uint64_t search_seed;
+        Rng rng;
+        mutable std::shared_ptr<ThreadPool> thread_pool; // Lazily created once params.num_threads > 1
+
+        /* Outcome of a single descent. Restart means the descent ran into a node whose tactics all close circles.
+         * Circle is only returned by descents that defer their changes, instead of killing the tactic. */
+        enum class DescentStatus {
+            Found,
+            Restart,
+            Circle
+        };
+
+        // Virtual loss chosen by a descent, added to the graph once the descent is committed
+        struct DeferredVirtualLoss {
+            std::shared_ptr<HTPSNode> node;
+            size_t tactic_id;
+            TheoremPointer thm;
+            size_t previous;
+        };
+
+        struct WaveDescent {
+            Simulation sim;
+            std::vector<TheoremPointer> terminal;
+            std::vector<std::pair<TheoremPointer, size_t>> to_expand;
+            std::vector<DeferredVirtualLoss> virtual_losses;
+            DescentStatus status = DescentStatus::Found;
+        };
 
         void _single_to_expand(std::vector<TheoremPointer> &theorems, Simulation &sim, std::vector<std::pair<TheoremPointer, std::size_t>> &leaves_to_expand);
 
+        /* Computes the policy of a node and picks a tactic from it. Chosen by choose_selection_kernel whenever the
+         * policy or the params change, see select_tactic_as. */
+        using SelectionKernel = size_t (HTPS::*)(const HTPSNode &, PolicyScratch &, Rng &) const;
+        SelectionKernel selection_kernel = &HTPS::select_tactic_generic;
+
+        // Picks a tactic given the policy of a node, the policy is overwritten in the process
+        size_t select_tactic(std::vector<double> &policy, Rng &rng) const;
+
+
+        size_t select_tactic_generic(const HTPSNode &node, PolicyScratch &scratch, Rng &rng) const;
+
+        /* Selection with the policy type, q_value_solved and whether the policy temperature is 0 fixed at compile time.
+         * Falls back to select_tactic_generic for nodes that were created with other settings, e.g. before set_params
+         * changed them. */
+        template<PolicyType policy_type, QValueSolved q_value_solved_type, bool greedy>
+        size_t select_tactic_as(const HTPSNode &node, PolicyScratch &scratch, Rng &rng) const;
+
+        template<PolicyType policy_type, QValueSolved q_value_solved_type>
+        static SelectionKernel selection_kernel_for(bool greedy);
+
+        /* Uses the specialized selection if the policy is a plain Policy, and the generic one with its virtual
+         * get_policy otherwise. */
+        void choose_selection_kernel();
+
+        DescentStatus _find_leaves_to_expand(Simulation &sim, std::vector<TheoremPointer> &terminal,
+                                             std::vector<std::pair<TheoremPointer, size_t>> &to_expand,
+                                             Rng &rng, std::vector<DeferredVirtualLoss> *deferred);
+
+        size_t harvest_count = 0; // Calls to harvest, the samples are only tracked per node once it has been called
+
+        /* Appends the training samples of the nodes. If incremental, only the samples that harvest has not emitted yet are
+         * collected, i.e. the effects of new nodes and the critic and tactic samples of nodes that changed since they
+         * were taken. Unless final, nodes below count_threshold or with virtual counts are left out, and so are tactic
+         * samples whose node mask depends on the proof, which is only built by get_result.
+         * The nodes are processed in chunks, each drawing from its own substream of sample_rng and writing to its own
+         * buffers, which are concatenated in the order of the chunks. */
+        void collect_train_samples(std::vector<HTPSSampleEffect> &samples_effects,
+                                   std::vector<HTPSSampleCritic> &samples_critic,
+                                   std::vector<HTPSSampleTactics> &samples_tactics, const Rng &sample_rng,
+                                   bool incremental, bool final) const;
+
+        // Creates the thread pool with params.num_threads workers, or recreates it if the number changed
+        ThreadPool &get_thread_pool() const;
+
+        // Nodes per chunk of the sample extraction, fixed so that the samples do not depend on the number of threads
+        static constexpr size_t SAMPLE_CHUNK_SIZE = 256;
+
+        /* Calls fn(chunk) for every chunk of SAMPLE_CHUNK_SIZE consecutive indices below count, on the thread pool if
+         * params.num_threads > 1. */
+        void for_each_chunk(size_t count, const std::function<void(size_t)> &fn) const;
+
+        /* Descents per wave of a batch, fixed so that the selected leaves do not depend on the number of threads.
+         * Descents only see the virtual loss of the waves before their own. */
+        static constexpr size_t DESCENT_WAVE_SIZE = 8;
+
+        /* Runs the descents first, ..., first + count - 1 of a batch. Returns false once the batch has to stop, i.e.
+         * the root is dead or a descent only reached terminal leaves. */
+        bool select_wave(TheoremMap<TheoremPointer> &result, size_t first, size_t count, const Rng &batch_rng);
+
+        // Repeats a descent against the current graph, killing tactics on the way. Returns false if the root died
+        bool redescend(WaveDescent &descent, size_t index, const Rng &batch_rng);
+
     protected:
         bool is_leaf(const std::shared_ptr<HTPSNode> &node) const;
 
@@ -563,9 +807,22 @@ namespace htps {
 
         void expand(std::vector<std::shared_ptr<env_expansion>> &expansions);
 
+        // Contributions of all simulations of a backup to a single (node, tactic) pair
+        struct PendingBackup {
+            std::shared_ptr<HTPSNode> node;
+            std::vector<double> values;
+            size_t virtual_loss = 0;
+        };
+        using PendingBackups = std::map<std::pair<const HTPSNode *, size_t>, PendingBackup>;
+
+        static void add_pending_backup(PendingBackups &pending, const std::shared_ptr<HTPSNode> &node, size_t tactic_id,
+                                       std::optional<double> value, size_t virtual_loss);
+
         void backup();
 
-        void backup_leaves(std::shared_ptr<Simulation> &sim, bool only_value);
+        /* Computes the values of a finished simulation. Node statistics are not touched, the updates are collected in
+         * pending and applied by backup once all finished simulations have been processed. */
+        void backup_leaves(std::shared_ptr<Simulation> &sim, bool only_value, PendingBackups &pending);
 
         std::vector<TheoremPointer> batch_to_expand();
 
@@ -573,27 +830,54 @@ namespace htps {
 
         void cleanup(Simulation &to_clean);
 
+        // Stores the proof sizes at the time the root is first proven
+        void set_initial_minimum_proof_size();
+
+        void integrate_expansions(std::vector<std::shared_ptr<env_expansion>> &expansions);
+
+        // Moves the theorems that are in the cache from theorems to cached_expansions
+        void answer_from_cache(std::vector<TheoremPointer> &theorems);
+
     public:
         HTPS(TheoremPointer &root, const htps_params &params, std::shared_ptr<Policy> &policy) :
                 Graph<HTPSNode, PrioritizedNode>(root), policy(policy), params(params), expansion_count(0),
                 train_samples_effects(), train_samples_critic(), train_samples_tactics(), backedup_hashes(),
-                currently_expanding(), propagate_needed(true), done(false) {};
+                currently_expanding(), propagate_needed(true), done(false), search_seed(htps::seed), rng(htps::seed) {
+            choose_selection_kernel();
+        };
 
         HTPS(TheoremPointer &root, const htps_params &params) :
             Graph<HTPSNode, PrioritizedNode>(root), params(params), expansion_count(0),
                 train_samples_effects(), train_samples_critic(), train_samples_tactics(), backedup_hashes(),
-                currently_expanding(), propagate_needed(true), done(false) {
+                currently_expanding(), propagate_needed(true), done(false), search_seed(htps::seed), rng(htps::seed) {
             policy = std::make_shared<Policy>(params.policy_type, params.exploration);
+            choose_selection_kernel();
         }
 
         HTPS() : Graph<HTPSNode, PrioritizedNode>(), params(), expansion_count(0),
                 train_samples_effects(), train_samples_critic(), train_samples_tactics(), backedup_hashes(),
-                currently_expanding(), propagate_needed(true), done(false) {};
+                currently_expanding(), propagate_needed(true), done(false), search_seed(htps::seed), rng(htps::seed) {};
 
         void set_root(TheoremPointer &thm);
 
+        /* Re-roots the search on a descendant of the current root, e.g. to continue on a subgoal.
+         * All nodes reachable from the new root are kept together with their statistics, the remaining ones are
+         * released. Kept nodes count towards num_expansions, the budget can be raised with set_params.
+         * Must not be called while expansions are outstanding. */
+        void move_root(TheoremPointer &new_root);
+
         void set_params(const htps_params &new_params);
 
+        /* Restarts the random numbers of the search from the given seed. Searches start from htps::seed, and the same
+         * seed gives the same random numbers for every descent regardless of params.num_threads. */
+        void set_seed(uint64_t seed);
+
+        /* Attaches a cache that answers theorems_to_expand for goals expanded before, by this or any other search
+         * sharing the cache. Only the misses are handed to the caller, the hits are integrated together with the
+         * expansions returned for them. Every expansion received afterwards is added to the cache.
+         * Passing nullptr detaches the cache. */
+        void set_expansion_cache(const std::shared_ptr<ExpansionCache> &cache);
+
 
 
         void get_train_samples(std::vector<HTPSSampleEffect> &samples_effects,
@@ -610,8 +894,15 @@ namespace htps {
 
         bool is_expanding() const;
 
+        /* Drops all outstanding expansions together with the simulations waiting for them, removing their virtual
+         * counts. Expansions for the dropped theorems are rejected afterwards. */
+        void discard_expansions();
+
         Simulation find_leaves_to_expand(std::vector<TheoremPointer> &terminal, std::vector<std::pair<TheoremPointer, size_t>> &to_expand);
 
+        Simulation find_leaves_to_expand(std::vector<TheoremPointer> &terminal,
+                                         std::vector<std::pair<TheoremPointer, size_t>> &to_expand, Rng &rng);
+
         void expand_and_backup(std::vector<std::shared_ptr<env_expansion>> &expansions);
 
         std::vector<TheoremPointer> theorems_to_expand();
@@ -620,10 +911,31 @@ namespace htps {
 
         HTPSResult get_result();
 
+        /* Returns the training samples that became available since the last harvest while the search is running, so
+         * that they can be processed before the search ends: the effects of newly expanded nodes, and the critic and
+         * tactic samples of nodes that reached count_threshold and changed since their samples were last taken. Once
+         * harvest has been called, get_result only returns the samples that changed since the last harvest, and only
+         * builds samples for those nodes. A sample supersedes the samples harvested before for the same goal, e.g. the final
+         * tactic sample of a node in the proof replaces the one taken before the proof was known.
+         * The harvest state is not part of the JSON representation. */
+        HTPSResult harvest();
+
         static HTPS from_json(const nlohmann::json &j);
 
         explicit operator nlohmann::json() const;
 
+        /* The JSON state of the search as a compact, versioned binary snapshot (see snapshot.h), in which each
+         * theorem string is stored once. from_binary restores the same search as from_json. */
+        std::string get_binary() const;
+
+        static HTPS from_binary(std::string_view data);
+
+        // Writes the binary snapshot to a file
+        void save_binary(const std::string &path) const;
+
+        // Restores a search from a file written by save_binary, decoding directly from a memory mapping of the file
+        static HTPS load_binary(const std::string &path);
+
         htps::htps_params get_params() const;
 
         size_t num_expansions() const;
@@ -0,0 +1,138 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+using namespace htps;
+
+HTPSScheduler::HTPSScheduler(size_t max_batch_size) : searches(), order(), requested_by(), results(),
+                                                      max_batch_size(max_batch_size), next_id(0),
+                                                      expansion_cache() {
+    if (max_batch_size == 0) {
+        throw std::invalid_argument("Batch size must be positive");
+    }
+}
+
+size_t HTPSScheduler::add_search(TheoremPointer &root, const htps_params &params, int priority) {
+    size_t id = next_id++;
+    auto search = std::make_unique<HTPS>(root, params);
+    if (expansion_cache)
+        search->set_expansion_cache(expansion_cache);
+    searches.emplace(id, ScheduledSearch{std::move(search), priority});
+    order.push_back(id);
+    return id;
+}
+
+// Searches with outstanding expansions can only be retired if these can be discarded
+bool HTPSScheduler::is_finished(const HTPS &search) {
+    return search.is_done() && (!search.is_expanding() || search.get_params().async_expansions);
+}
+
+void HTPSScheduler::retire(size_t id) {
+    results.emplace_back(id, searches.at(id).search->get_result());
+    searches.erase(id);
+    order.erase(std::find(order.begin(), order.end(), id));
+}
+
+void HTPSScheduler::set_expansion_cache(const std::shared_ptr<ExpansionCache> &cache) {
+    expansion_cache = cache;
+    for (auto &[id, scheduled]: searches) {
+        scheduled.search->set_expansion_cache(cache);
+    }
+}
+
+std::vector<TheoremPointer> HTPSScheduler::theorems_to_expand() {
+    std::vector<TheoremPointer> theorems;
+    theorems_to_expand(theorems);
+    return theorems;
+}
+
+void HTPSScheduler::theorems_to_expand(std::vector<TheoremPointer> &theorems) {
+    theorems.clear();
+    std::vector<size_t> candidates(order.begin(), order.end());
+    // Stable, so that searches of equal priority keep their round-robin order
+    std::stable_sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) {
+        return searches.at(a).priority > searches.at(b).priority;
+    });
+    std::vector<size_t> contributed;
+    std::vector<size_t> finished;
+    std::vector<TheoremPointer> batch;
+    for (size_t id: candidates) {
+        if (theorems.size() >= max_batch_size)
+            break;
+        HTPS &search = *searches.at(id).search;
+        if (is_finished(search)) {
+            finished.push_back(id);
+            continue;
+        }
+        if (search.is_done() || (search.is_expanding() && !search.get_params().async_expansions))
+            continue;
+        search.theorems_to_expand(batch);
+        if (batch.empty()) {
+            if (is_finished(search))
+                finished.push_back(id);
+            continue;
+        }
+        contributed.push_back(id);
+        for (const auto &thm: batch) {
+            // Theorems already handed out, for this or another search, are expanded only once
+            if (requested_by.contains(thm)) {
+                requested_by.at(thm).push_back(id);
+                continue;
+            }
+            requested_by.insert(thm, std::vector<size_t>{id});
+            theorems.push_back(thm);
+        }
+    }
+    for (size_t id: contributed) {
+        order.erase(std::find(order.begin(), order.end(), id));
+        order.push_back(id);
+    }
+    for (size_t id: finished) {
+        retire(id);
+    }
+}
+
+void HTPSScheduler::expand_and_backup(std::vector<std::shared_ptr<env_expansion>> &expansions) {
+    TheoremSet seen;
+    for (const auto &expansion: expansions) {
+        if (!requested_by.contains(expansion->thm) || seen.contains(expansion->thm)) {
+            throw std::runtime_error("Received an expansion for a theorem that is not being expanded!");
+        }
+        seen.insert(expansion->thm);
+    }
+    // Ordered, so that searches are always updated in the same order
+    std::map<size_t, std::vector<std::shared_ptr<env_expansion>>> routed;
+    for (const auto &expansion: expansions) {
+        for (size_t id: requested_by.at(expansion->thm)) {
+            // The search might have been retired in the meantime
+            if (searches.contains(id))
+                routed[id].push_back(expansion);
+        }
+        requested_by.erase(expansion->thm);
+    }
+    for (auto &[id, search_expansions]: routed) {
+        HTPS &search = *searches.at(id).search;
+        search.expand_and_backup(search_expansions);
+        if (is_finished(search))
+            retire(id);
+    }
+}
+
+std::vector<std::pair<size_t, HTPSResult>> HTPSScheduler::take_results() {
+    std::vector<std::pair<size_t, HTPSResult>> taken;
+    taken.swap(results);
+    return taken;
+}
+
+size_t HTPSScheduler::num_searches() const {
+    return searches.size();
+}
+
+bool HTPSScheduler::is_done() const {
+    return searches.empty();
+}
+
+bool HTPSScheduler::is_expanding() const {
+    return requested_by.size() > 0;
+}
@@ -0,0 +1,69 @@
+#ifndef HTPS_SCHEDULER_H
+#define HTPS_SCHEDULER_H
+
+#include "htps.h"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace htps {
+
+    /* Pools the batches of many independent searches into combined batches for a single expander.
+     * Every call to theorems_to_expand asks the searches that are not waiting for expansions for their next batch,
+     * until the combined batch holds at least max_batch_size theorems. Searches with a higher priority are asked first,
+     * searches with equal priority are asked in round-robin order, so that a full batch does not starve the searches
+     * at the end of the list. A theorem requested by several searches is only handed out once, its expansion is routed
+     * back to every search waiting for it.
+     * Searches are retired as soon as they are done, their results can be collected with take_results.
+     * */
+    class HTPSScheduler {
+    private:
+        struct ScheduledSearch {
+            std::unique_ptr<HTPS> search;
+            int priority;
+        };
+
+        std::unordered_map<size_t, ScheduledSearch> searches;
+        std::deque<size_t> order; // Round-robin order, searches that contributed to the last batch are at the back
+        TheoremMap<std::vector<size_t>> requested_by; // Searches waiting for the expansion of a handed out theorem
+        std::vector<std::pair<size_t, HTPSResult>> results; // Results of retired searches, not yet taken
+        size_t max_batch_size;
+        size_t next_id;
+        std::shared_ptr<ExpansionCache> expansion_cache; // Attached to every search
+
+        static bool is_finished(const HTPS &search);
+
+        void retire(size_t id);
+
+    public:
+        explicit HTPSScheduler(size_t max_batch_size = 32);
+
+        /* Adds a new search for the given root and returns its id, which identifies the search in take_results. */
+        size_t add_search(TheoremPointer &root, const htps_params &params, int priority = 0);
+
+        /* Attaches the cache to all current and future searches, see HTPS::set_expansion_cache. */
+        void set_expansion_cache(const std::shared_ptr<ExpansionCache> &cache);
+
+        std::vector<TheoremPointer> theorems_to_expand();
+
+        void theorems_to_expand(std::vector<TheoremPointer> &theorems);
+
+        /* Routes the expansions to the searches that requested them. Expansions can be returned in any grouping, but
+         * only for theorems handed out by theorems_to_expand that have not been expanded yet. */
+        void expand_and_backup(std::vector<std::shared_ptr<env_expansion>> &expansions);
+
+        /* Returns the results of all searches retired since the last call, together with their ids. */
+        std::vector<std::pair<size_t, HTPSResult>> take_results();
+
+        size_t num_searches() const;
+
+        bool is_done() const;
+
+        bool is_expanding() const;
+    };
+}
+
+#endif //HTPS_SCHEDULER_H
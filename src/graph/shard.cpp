@@ -0,0 +1,162 @@
+#include "shard.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace htps;
+
+ShardWriter::ShardWriter(const std::string &path) : mutex(), file(path), goals(), tactics(), records(), closed(false) {
+    file.write(shard::MAGIC, shard::MAGIC_SIZE);
+}
+
+ShardWriter::~ShardWriter() {
+    try {
+        close();
+    } catch (const std::exception &) {}
+}
+
+void ShardWriter::append(const HTPSResult &result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+        throw std::runtime_error("Shard " + file.get_path() + " is already closed");
+    }
+    SampleColumns columns(result, goals, tactics);
+    RecordIndex index{goals.intern(result.get_goal()->unique_string), result.get_metric(),
+                      result.get_proof().has_value(), {}};
+    for_each_column(columns, [this, &index](const char *, const char *, const auto &column) {
+        file.pad(shard::ALIGNMENT);
+        index.columns.emplace_back(file.tell(), column.size());
+        file.write(column.data(), column.size() * sizeof(column[0]));
+    });
+    records.push_back(std::move(index));
+}
+
+void ShardWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed)
+        return;
+    closed = true;
+    file.pad(shard::ALIGNMENT);
+    uint64_t footer = file.tell();
+    std::vector<ShardColumn> schema;
+    for_each_column(SampleColumns(), [&schema](const char *group, const char *name, const auto &column) {
+        schema.push_back({column_type<typename std::decay_t<decltype(column)>::value_type>(), group, name});
+    });
+    file.write_value<uint64_t>(schema.size());
+    for (const auto &column: schema) {
+        file.write_value<uint64_t>(static_cast<uint64_t>(column.type));
+        file.write_string(column.group);
+        file.write_string(column.name);
+    }
+    for (const auto *table: {&goals, &tactics}) {
+        file.write_value<uint64_t>(table->strings.size());
+        for (const auto &s: table->strings)
+            file.write_string(s);
+    }
+    file.write_value<uint64_t>(records.size());
+    for (const auto &record: records) {
+        file.write_value<uint64_t>(record.goal_id);
+        file.write_value<uint64_t>(record.metric);
+        file.write_value<uint64_t>(record.proven);
+        for (const auto &[offset, count]: record.columns) {
+            file.write_value<uint64_t>(offset);
+            file.write_value<uint64_t>(count);
+        }
+    }
+    file.write_value<uint64_t>(footer);
+    file.write(shard::FOOTER_MAGIC, shard::MAGIC_SIZE);
+    file.close();
+}
+
+size_t ShardWriter::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return records.size();
+}
+
+ShardReader::ShardReader(const std::string &path) : file(path), schema(), goals(), tactics(), records() {
+    const char *data = file.data();
+    size_t size = file.size();
+    size_t trailer = sizeof(uint64_t) + shard::MAGIC_SIZE;
+    if (size < shard::MAGIC_SIZE + trailer || std::memcmp(data, shard::MAGIC, shard::MAGIC_SIZE) != 0) {
+        throw std::runtime_error(path + " is not a shard");
+    }
+    if (std::memcmp(data + size - shard::MAGIC_SIZE, shard::FOOTER_MAGIC, shard::MAGIC_SIZE) != 0) {
+        throw std::runtime_error(path + " has no footer, it was not closed");
+    }
+    BinaryReader reader(data, size - shard::MAGIC_SIZE, size - trailer);
+    BinaryReader footer(data, size - trailer, reader.read<uint64_t>());
+
+    auto n_columns = footer.read<uint64_t>();
+    for (size_t i = 0; i < n_columns; i++) {
+        auto type = footer.read<uint64_t>();
+        if (type > static_cast<uint64_t>(ColumnType::Float64))
+            throw std::runtime_error(path + " has a column of unknown type");
+        auto group = footer.read_string();
+        auto name = footer.read_string();
+        schema.push_back({static_cast<ColumnType>(type), std::string(group), std::string(name)});
+    }
+    for (auto *table: {&goals, &tactics}) {
+        auto n_strings = footer.read<uint64_t>();
+        for (size_t i = 0; i < n_strings; i++)
+            table->emplace_back(footer.read_string());
+    }
+    auto n_records = footer.read<uint64_t>();
+    for (size_t i = 0; i < n_records; i++) {
+        Record record{};
+        record.goal_id = static_cast<uint32_t>(footer.read<uint64_t>());
+        auto metric = footer.read<uint64_t>();
+        if (record.goal_id >= goals.size() || metric >= METRIC_COUNT)
+            throw std::runtime_error(path + " has an invalid record");
+        record.metric = static_cast<Metric>(metric);
+        record.proven = footer.read<uint64_t>() != 0;
+        for (const auto &column: schema) {
+            auto offset = footer.read<uint64_t>();
+            auto count = footer.read<uint64_t>();
+            size_t item_size = column_type_size(column.type);
+            if (offset % shard::ALIGNMENT != 0 || offset > size || count > (size - offset) / item_size)
+                throw std::runtime_error(path + " has a column outside of the file");
+            record.columns.emplace_back(data + offset, count);
+        }
+        records.push_back(std::move(record));
+    }
+}
+
+const ShardReader::Record &ShardReader::record(size_t index) const {
+    if (index >= records.size())
+        throw std::out_of_range("Record index out of range");
+    return records[index];
+}
+
+size_t ShardReader::size() const {
+    return records.size();
+}
+
+const std::vector<ShardColumn> &ShardReader::get_schema() const {
+    return schema;
+}
+
+const std::vector<std::string> &ShardReader::get_goals() const {
+    return goals;
+}
+
+const std::vector<std::string> &ShardReader::get_tactics() const {
+    return tactics;
+}
+
+uint32_t ShardReader::get_goal_id(size_t index) const {
+    return record(index).goal_id;
+}
+
+Metric ShardReader::get_metric(size_t index) const {
+    return record(index).metric;
+}
+
+bool ShardReader::is_proven(size_t index) const {
+    return record(index).proven;
+}
+
+std::pair<const void *, size_t> ShardReader::column_data(size_t index, size_t column) const {
+    const auto &columns = record(index).columns;
+    if (column >= columns.size())
+        throw std::out_of_range("Column index out of range");
+    return columns[column];
+}
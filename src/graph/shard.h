@@ -0,0 +1,125 @@
+#ifndef HTPS_SHARD_H
+#define HTPS_SHARD_H
+
+#include "columns.h"
+#include "../util/binary.h"
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace htps {
+
+    /* Training shards store the samples of many results in one binary file, in the columnar layout of SampleColumns.
+     * The goals and tactics of all results of a shard share one string table. All values are in native byte order and
+     * every column starts at a multiple of 8 bytes, so the columns can be used in place from a memory mapping.
+     *   "HTPSSHD1"
+     *   records: the columns of one result each, in the order of for_each_column
+     *   footer: the column schema (type, group and name of every column), the goal and tactic string tables, and per
+     *           record the id of its goal, its metric, whether it was proven, and offset and length of every column
+     *   [uint64 offset of the footer]["HTPSSHDF"]
+     * */
+    namespace shard {
+        constexpr char MAGIC[] = "HTPSSHD1";
+        constexpr char FOOTER_MAGIC[] = "HTPSSHDF";
+        constexpr size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+        constexpr size_t ALIGNMENT = 8;
+    }
+
+    /* Appends results to a new shard. Records are written as they are appended, only the string tables and the index
+     * stay in memory until close writes the footer. Without close, the shard cannot be read.
+     * Safe to use from several threads. */
+    class ShardWriter {
+    private:
+        struct RecordIndex {
+            uint32_t goal_id;
+            Metric metric;
+            bool proven;
+            std::vector<std::pair<uint64_t, uint64_t>> columns; // Offset in bytes and number of elements
+        };
+
+        mutable std::mutex mutex;
+        BinaryFileWriter file;
+        StringTable goals;
+        StringTable tactics;
+        std::vector<RecordIndex> records;
+        bool closed;
+
+    public:
+        // Creates the file, or truncates it if it exists
+        explicit ShardWriter(const std::string &path);
+
+        // Closes the shard, errors are lost, call close to see them
+        ~ShardWriter();
+
+        void append(const HTPSResult &result);
+
+        // Writes the footer. Afterwards, nothing can be appended
+        void close();
+
+        // Number of records
+        size_t size() const;
+    };
+
+    struct ShardColumn {
+        ColumnType type;
+        std::string group;
+        std::string name;
+    };
+
+    // Memory maps a shard, the columns point into the mapping
+    class ShardReader {
+    private:
+        struct Record {
+            uint32_t goal_id;
+            Metric metric;
+            bool proven;
+            std::vector<std::pair<const void *, size_t>> columns;
+        };
+
+        MappedFile file;
+        std::vector<ShardColumn> schema;
+        std::vector<std::string> goals;
+        std::vector<std::string> tactics;
+        std::vector<Record> records;
+
+        const Record &record(size_t index) const;
+
+    public:
+        explicit ShardReader(const std::string &path);
+
+        size_t size() const;
+
+        const std::vector<ShardColumn> &get_schema() const;
+
+        const std::vector<std::string> &get_goals() const;
+
+        const std::vector<std::string> &get_tactics() const;
+
+        // Id of the goal the search of the record started from
+        uint32_t get_goal_id(size_t index) const;
+
+        Metric get_metric(size_t index) const;
+
+        bool is_proven(size_t index) const;
+
+        // Start and number of elements of a column of a record, the column is the index into the schema
+        std::pair<const void *, size_t> column_data(size_t index, size_t column) const;
+
+        template<typename T>
+        std::span<const T> column(size_t index, const std::string &group, const std::string &name) const {
+            for (size_t i = 0; i < schema.size(); i++) {
+                if (schema[i].group != group || schema[i].name != name)
+                    continue;
+                if (schema[i].type != column_type<T>())
+                    throw std::invalid_argument("Column " + group + "." + name + " has a different type");
+                auto [data, count] = column_data(index, i);
+                return {static_cast<const T *>(data), count};
+            }
+            throw std::invalid_argument("No column " + group + "." + name);
+        }
+    };
+}
+
+#endif //HTPS_SHARD_H
@@ -0,0 +1,247 @@
+#include "snapshot.h"
+#include "../util/binary.h"
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+using namespace htps;
+
+namespace {
+    enum class Tag : uint8_t {
+        Null, False, True, Unsigned, Negative, Float, String, Array, Object, Reference
+    };
+
+    // Arrays and objects encoded in fewer bytes are written inline, a reference would not be much shorter
+    constexpr size_t MIN_SHARED_SIZE = 8;
+
+    void write_varint(std::string &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    uint64_t read_varint(BinaryReader &reader) {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            auto byte = reader.read<uint8_t>();
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        throw std::runtime_error("Invalid varint in snapshot");
+    }
+
+    void write_tag(std::string &out, Tag tag) {
+        out.push_back(static_cast<char>(tag));
+    }
+
+    class Encoder {
+    private:
+        std::unordered_map<std::string, uint64_t> string_ids;
+        std::vector<const std::string *> strings;
+        std::unordered_map<std::string, uint64_t> value_ids;
+        std::vector<const std::string *> values;
+
+        uint64_t intern(std::unordered_map<std::string, uint64_t> &ids, std::vector<const std::string *> &table,
+                        std::string &&s) {
+            auto [it, inserted] = ids.try_emplace(std::move(s), table.size());
+            if (inserted)
+                table.push_back(&it->first);
+            return it->second;
+        }
+
+        void encode_compound(const nlohmann::json &j, std::string &out) {
+            std::string body;
+            if (j.is_array()) {
+                write_tag(body, Tag::Array);
+                write_varint(body, j.size());
+                for (const auto &element: j)
+                    encode(element, body);
+            } else {
+                write_tag(body, Tag::Object);
+                write_varint(body, j.size());
+                for (const auto &[key, value]: j.items()) {
+                    write_varint(body, intern(string_ids, strings, std::string(key)));
+                    encode(value, body);
+                }
+            }
+            if (body.size() < MIN_SHARED_SIZE) {
+                out += body;
+                return;
+            }
+            write_tag(out, Tag::Reference);
+            write_varint(out, intern(value_ids, values, std::move(body)));
+        }
+
+    public:
+        void encode(const nlohmann::json &j, std::string &out) {
+            switch (j.type()) {
+                case nlohmann::json::value_t::null:
+                    write_tag(out, Tag::Null);
+                    break;
+                case nlohmann::json::value_t::boolean:
+                    write_tag(out, j.get<bool>() ? Tag::True : Tag::False);
+                    break;
+                case nlohmann::json::value_t::number_unsigned:
+                    write_tag(out, Tag::Unsigned);
+                    write_varint(out, j.get<uint64_t>());
+                    break;
+                case nlohmann::json::value_t::number_integer: {
+                    auto value = j.get<int64_t>();
+                    if (value >= 0) {
+                        write_tag(out, Tag::Unsigned);
+                        write_varint(out, static_cast<uint64_t>(value));
+                    } else {
+                        write_tag(out, Tag::Negative);
+                        // -(value + 1) does not overflow for the smallest int64
+                        write_varint(out, static_cast<uint64_t>(-(value + 1)));
+                    }
+                    break;
+                }
+                case nlohmann::json::value_t::number_float: {
+                    write_tag(out, Tag::Float);
+                    auto value = j.get<double>();
+                    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+                    break;
+                }
+                case nlohmann::json::value_t::string:
+                    write_tag(out, Tag::String);
+                    write_varint(out, intern(string_ids, strings, j.get<std::string>()));
+                    break;
+                case nlohmann::json::value_t::array:
+                case nlohmann::json::value_t::object:
+                    encode_compound(j, out);
+                    break;
+                default:
+                    throw std::runtime_error("Snapshots can not contain binary JSON values");
+            }
+        }
+
+        void write_tables(std::string &out) const {
+            write_varint(out, strings.size());
+            for (const auto *s: strings) {
+                write_varint(out, s->size());
+                out += *s;
+            }
+            write_varint(out, values.size());
+            for (const auto *v: values) {
+                write_varint(out, v->size());
+                out += *v;
+            }
+        }
+    };
+
+    class Decoder {
+    private:
+        std::vector<std::string_view> strings;
+        std::vector<nlohmann::json> values;
+
+        std::string_view read_entry(BinaryReader &reader) {
+            auto size = static_cast<size_t>(read_varint(reader));
+            return {reader.read_bytes(size), size};
+        }
+
+        const std::string_view &get_string(uint64_t id) const {
+            if (id >= strings.size())
+                throw std::runtime_error("Invalid string id in snapshot");
+            return strings[id];
+        }
+
+    public:
+        void read_tables(BinaryReader &reader) {
+            auto string_count = read_varint(reader);
+            for (uint64_t i = 0; i < string_count; i++)
+                strings.push_back(read_entry(reader));
+            // Values only reference earlier values, so they can be decoded in order
+            auto value_count = read_varint(reader);
+            for (uint64_t i = 0; i < value_count; i++) {
+                auto entry = read_entry(reader);
+                BinaryReader entry_reader(entry.data(), entry.size());
+                values.push_back(decode(entry_reader));
+                if (entry_reader.tell() != entry.size())
+                    throw std::runtime_error("Trailing bytes in snapshot value");
+            }
+        }
+
+        nlohmann::json decode(BinaryReader &reader) {
+            auto tag = static_cast<Tag>(reader.read<uint8_t>());
+            switch (tag) {
+                case Tag::Null:
+                    return nullptr;
+                case Tag::False:
+                    return false;
+                case Tag::True:
+                    return true;
+                case Tag::Unsigned:
+                    return read_varint(reader);
+                case Tag::Negative: {
+                    auto magnitude = read_varint(reader);
+                    if (magnitude > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+                        throw std::runtime_error("Invalid integer in snapshot");
+                    return -static_cast<int64_t>(magnitude) - 1;
+                }
+                case Tag::Float:
+                    return reader.read<double>();
+                case Tag::String:
+                    return std::string(get_string(read_varint(reader)));
+                case Tag::Array: {
+                    auto size = read_varint(reader);
+                    auto j = nlohmann::json::array();
+                    for (uint64_t i = 0; i < size; i++)
+                        j.push_back(decode(reader));
+                    return j;
+                }
+                case Tag::Object: {
+                    auto size = read_varint(reader);
+                    auto j = nlohmann::json::object();
+                    for (uint64_t i = 0; i < size; i++) {
+                        std::string key(get_string(read_varint(reader)));
+                        j[key] = decode(reader);
+                    }
+                    return j;
+                }
+                case Tag::Reference: {
+                    // While reading the tables, only the values decoded so far exist
+                    auto id = read_varint(reader);
+                    if (id >= values.size())
+                        throw std::runtime_error("Invalid value id in snapshot");
+                    return values[id];
+                }
+                default:
+                    throw std::runtime_error("Invalid tag in snapshot");
+            }
+        }
+    };
+}
+
+std::string snapshot::encode(const nlohmann::json &j) {
+    Encoder encoder;
+    std::string root;
+    encoder.encode(j, root);
+
+    std::string out(MAGIC, MAGIC_SIZE);
+    uint32_t header[2] = {VERSION, 0};
+    out.append(reinterpret_cast<const char *>(header), sizeof(header));
+    encoder.write_tables(out);
+    out += root;
+    return out;
+}
+
+nlohmann::json snapshot::decode(std::string_view data) {
+    BinaryReader reader(data.data(), data.size());
+    if (std::string_view(reader.read_bytes(MAGIC_SIZE), MAGIC_SIZE) != std::string_view(MAGIC, MAGIC_SIZE))
+        throw std::runtime_error("Not an HTPS snapshot");
+    auto version = reader.read<uint32_t>();
+    if (version == 0 || version > VERSION)
+        throw std::runtime_error("Unsupported snapshot version " + std::to_string(version));
+    reader.read<uint32_t>();
+
+    Decoder decoder;
+    decoder.read_tables(reader);
+    auto j = decoder.decode(reader);
+    if (reader.tell() != data.size())
+        throw std::runtime_error("Trailing bytes in snapshot");
+    return j;
+}
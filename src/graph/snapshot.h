@@ -0,0 +1,33 @@
+#ifndef HTPS_SNAPSHOT_H
+#define HTPS_SNAPSHOT_H
+
+#include "../json.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace htps {
+
+    /* Compact binary form of the JSON state of a search, see HTPS::get_binary.
+     *
+     * Layout: ["HTPSSNAP"][uint32 version][uint32 reserved], the string table, the value table and the root value.
+     * Every string (object keys included) is stored once in the string table and referenced by its id. Arrays and
+     * objects are encoded bottom-up, and those that are not tiny are stored once in the value table and referenced by
+     * id as well, so a theorem repeated in nodes, ancestors and simulations takes its space only once. A value only
+     * references values with a smaller id. Counts, lengths and ids are LEB128 varints, floats are stored as native
+     * doubles.
+     * */
+    namespace snapshot {
+        constexpr char MAGIC[] = "HTPSSNAP";
+        constexpr size_t MAGIC_SIZE = 8;
+        // Increase when the encoding changes, readers reject snapshots of a newer version
+        constexpr uint32_t VERSION = 1;
+
+        std::string encode(const nlohmann::json &j);
+
+        // Throws std::runtime_error if the data is not a valid snapshot
+        nlohmann::json decode(std::string_view data);
+    }
+}
+
+#endif //HTPS_SNAPSHOT_H
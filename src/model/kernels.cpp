@@ -0,0 +1,369 @@
+#include "kernels.h"
+#include "policy.h"
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HTPS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace htps;
+
+namespace {
+    size_t alpha_zero_scores_scalar(const double *q, const double *pi, const size_t *counts, size_t n,
+                                    double exploration, double sqrt_count_sum, double *scores, double &score_sum) {
+        size_t valid_count = 0;
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (pi[i] > MIN_FLOAT && q[i] > MIN_FLOAT) {
+                scores[i] = q[i] + exploration * pi[i] * sqrt_count_sum / (1 + static_cast<double>(counts[i]));
+                valid_count++;
+                sum += scores[i];
+            } else {
+                scores[i] = MIN_FLOAT;
+            }
+        }
+        score_sum = sum;
+        return valid_count;
+    }
+
+    size_t masked_copy_scalar(const double *values, size_t n, double *out, double &sum) {
+        size_t valid_count = 0;
+        double total = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (values[i] > MIN_FLOAT) {
+                out[i] = values[i];
+                total += values[i];
+                valid_count++;
+            } else {
+                out[i] = MIN_FLOAT;
+            }
+        }
+        sum = total;
+        return valid_count;
+    }
+
+    void normalize_scalar(double *values, size_t n, double sum) {
+        for (size_t i = 0; i < n; i++) {
+            if (values[i] > MIN_FLOAT)
+                values[i] = values[i] / sum;
+        }
+    }
+
+    double rpo_difference_sum_scalar(const double *q, const double *scaled_pi, size_t n, double alpha,
+                                     double &derivative_sum, bool &zero_difference) {
+        double sum = 0, derivative = 0;
+        zero_difference = false;
+        for (size_t i = 0; i < n; i++) {
+            double diff = alpha - q[i];
+            zero_difference |= diff == 0;
+            double inverse = 1 / diff;
+            double term = scaled_pi[i] * inverse;
+            sum += term;
+            derivative += term * inverse;
+        }
+        derivative_sum = derivative;
+        return sum;
+    }
+
+    double rpo_weights_scalar(const double *q, const double *scaled_pi, size_t n, double alpha, double epsilon,
+                              double *weights) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (q[i] > MIN_FLOAT) {
+                weights[i] = scaled_pi[i] / std::max(alpha - q[i], epsilon);
+                sum += weights[i];
+            } else {
+                weights[i] = MIN_FLOAT;
+            }
+        }
+        return sum;
+    }
+
+    constexpr PolicyKernels SCALAR_KERNELS = {InstructionSet::Scalar, alpha_zero_scores_scalar, masked_copy_scalar,
+                                              normalize_scalar, rpo_difference_sum_scalar, rpo_weights_scalar};
+
+#ifdef HTPS_X86_KERNELS
+    // Exact for integers below 2^52: placing them in the mantissa of 2^52 and subtracting 2^52 again
+    constexpr long long DOUBLE_MAGIC_BITS = 0x4330000000000000;
+    constexpr double DOUBLE_MAGIC = 4503599627370496.0;
+
+    /* AVX2 kernels process 4 doubles at once, the remaining entries are handled by the scalar kernels. */
+
+    __attribute__((target("avx2"))) double horizontal_sum(__m256d v) {
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, v);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+
+    __attribute__((target("avx2"))) __m256d load_counts(const size_t *counts) {
+        __m256i bits = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(counts)),
+                                       _mm256_set1_epi64x(DOUBLE_MAGIC_BITS));
+        return _mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(DOUBLE_MAGIC));
+    }
+
+    __attribute__((target("avx2")))
+    size_t alpha_zero_scores_avx2(const double *q, const double *pi, const size_t *counts, size_t n,
+                                  double exploration, double sqrt_count_sum, double *scores, double &score_sum) {
+        const __m256d invalid = _mm256_set1_pd(MIN_FLOAT);
+        const __m256d exploration_v = _mm256_set1_pd(exploration);
+        const __m256d sqrt_v = _mm256_set1_pd(sqrt_count_sum);
+        const __m256d one = _mm256_set1_pd(1.0);
+        __m256d sum = _mm256_setzero_pd();
+        size_t valid_count = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d q_v = _mm256_loadu_pd(q + i);
+            __m256d pi_v = _mm256_loadu_pd(pi + i);
+            __m256d valid = _mm256_and_pd(_mm256_cmp_pd(q_v, invalid, _CMP_GT_OQ),
+                                          _mm256_cmp_pd(pi_v, invalid, _CMP_GT_OQ));
+            __m256d bonus = _mm256_mul_pd(_mm256_mul_pd(exploration_v, pi_v), sqrt_v);
+            __m256d score = _mm256_add_pd(q_v, _mm256_div_pd(bonus, _mm256_add_pd(one, load_counts(counts + i))));
+            sum = _mm256_add_pd(sum, _mm256_and_pd(valid, score));
+            _mm256_storeu_pd(scores + i, _mm256_blendv_pd(invalid, score, valid));
+            valid_count += __builtin_popcount(_mm256_movemask_pd(valid));
+        }
+        double tail_sum;
+        valid_count += alpha_zero_scores_scalar(q + i, pi + i, counts + i, n - i, exploration, sqrt_count_sum,
+                                                scores + i, tail_sum);
+        score_sum = horizontal_sum(sum) + tail_sum;
+        return valid_count;
+    }
+
+    __attribute__((target("avx2")))
+    size_t masked_copy_avx2(const double *values, size_t n, double *out, double &sum) {
+        const __m256d invalid = _mm256_set1_pd(MIN_FLOAT);
+        __m256d total = _mm256_setzero_pd();
+        size_t valid_count = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d v = _mm256_loadu_pd(values + i);
+            __m256d valid = _mm256_cmp_pd(v, invalid, _CMP_GT_OQ);
+            total = _mm256_add_pd(total, _mm256_and_pd(valid, v));
+            _mm256_storeu_pd(out + i, _mm256_blendv_pd(invalid, v, valid));
+            valid_count += __builtin_popcount(_mm256_movemask_pd(valid));
+        }
+        double tail_sum;
+        valid_count += masked_copy_scalar(values + i, n - i, out + i, tail_sum);
+        sum = horizontal_sum(total) + tail_sum;
+        return valid_count;
+    }
+
+    __attribute__((target("avx2")))
+    void normalize_avx2(double *values, size_t n, double sum) {
+        const __m256d invalid = _mm256_set1_pd(MIN_FLOAT);
+        const __m256d sum_v = _mm256_set1_pd(sum);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d v = _mm256_loadu_pd(values + i);
+            __m256d valid = _mm256_cmp_pd(v, invalid, _CMP_GT_OQ);
+            _mm256_storeu_pd(values + i, _mm256_blendv_pd(invalid, _mm256_div_pd(v, sum_v), valid));
+        }
+        normalize_scalar(values + i, n - i, sum);
+    }
+
+    __attribute__((target("avx2")))
+    double rpo_difference_sum_avx2(const double *q, const double *scaled_pi, size_t n, double alpha,
+                                   double &derivative_sum, bool &zero_difference) {
+        const __m256d alpha_v = _mm256_set1_pd(alpha);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1.0);
+        __m256d sum = _mm256_setzero_pd();
+        __m256d derivative = _mm256_setzero_pd();
+        __m256d zeros = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d diff = _mm256_sub_pd(alpha_v, _mm256_loadu_pd(q + i));
+            zeros = _mm256_or_pd(zeros, _mm256_cmp_pd(diff, zero, _CMP_EQ_OQ));
+            __m256d inverse = _mm256_div_pd(one, diff);
+            __m256d term = _mm256_mul_pd(_mm256_loadu_pd(scaled_pi + i), inverse);
+            sum = _mm256_add_pd(sum, term);
+            derivative = _mm256_add_pd(derivative, _mm256_mul_pd(term, inverse));
+        }
+        bool tail_zero;
+        double tail_derivative;
+        double tail_sum = rpo_difference_sum_scalar(q + i, scaled_pi + i, n - i, alpha, tail_derivative, tail_zero);
+        zero_difference = tail_zero || _mm256_movemask_pd(zeros) != 0;
+        derivative_sum = horizontal_sum(derivative) + tail_derivative;
+        return horizontal_sum(sum) + tail_sum;
+    }
+
+    __attribute__((target("avx2")))
+    double rpo_weights_avx2(const double *q, const double *scaled_pi, size_t n, double alpha, double epsilon,
+                            double *weights) {
+        const __m256d invalid = _mm256_set1_pd(MIN_FLOAT);
+        const __m256d alpha_v = _mm256_set1_pd(alpha);
+        const __m256d epsilon_v = _mm256_set1_pd(epsilon);
+        __m256d sum = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d q_v = _mm256_loadu_pd(q + i);
+            __m256d valid = _mm256_cmp_pd(q_v, invalid, _CMP_GT_OQ);
+            __m256d weight = _mm256_div_pd(_mm256_loadu_pd(scaled_pi + i),
+                                           _mm256_max_pd(_mm256_sub_pd(alpha_v, q_v), epsilon_v));
+            sum = _mm256_add_pd(sum, _mm256_and_pd(valid, weight));
+            _mm256_storeu_pd(weights + i, _mm256_blendv_pd(invalid, weight, valid));
+        }
+        double tail_sum = rpo_weights_scalar(q + i, scaled_pi + i, n - i, alpha, epsilon, weights + i);
+        return horizontal_sum(sum) + tail_sum;
+    }
+
+    constexpr PolicyKernels AVX2_KERNELS = {InstructionSet::AVX2, alpha_zero_scores_avx2, masked_copy_avx2,
+                                            normalize_avx2, rpo_difference_sum_avx2, rpo_weights_avx2};
+
+    /* AVX-512 kernels process 8 doubles at once, the remaining entries are handled with masked loads and stores. */
+
+    /* Reduces via the AVX2 sum of both halves. _mm512_reduce_add_pd and the unmasked extracts start from an undefined
+     * register, which GCC reports as maybe-uninitialized. */
+    __attribute__((target("avx512f"))) double horizontal_sum(__m512d v) {
+        return horizontal_sum(_mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 0),
+                                            _mm512_maskz_extractf64x4_pd(0xF, v, 1)));
+    }
+
+    __attribute__((target("avx512f"))) __mmask8 tail_mask(size_t remaining) {
+        return remaining >= 8 ? static_cast<__mmask8>(0xFF) : static_cast<__mmask8>((1u << remaining) - 1);
+    }
+
+    __attribute__((target("avx512f")))
+    size_t alpha_zero_scores_avx512(const double *q, const double *pi, const size_t *counts, size_t n,
+                                    double exploration, double sqrt_count_sum, double *scores, double &score_sum) {
+        const __m512d invalid = _mm512_set1_pd(MIN_FLOAT);
+        const __m512d exploration_v = _mm512_set1_pd(exploration);
+        const __m512d sqrt_v = _mm512_set1_pd(sqrt_count_sum);
+        const __m512d one = _mm512_set1_pd(1.0);
+        const __m512i magic_bits = _mm512_set1_epi64(DOUBLE_MAGIC_BITS);
+        const __m512d magic = _mm512_set1_pd(DOUBLE_MAGIC);
+        __m512d sum = _mm512_setzero_pd();
+        size_t valid_count = 0;
+        for (size_t i = 0; i < n; i += 8) {
+            __mmask8 lanes = tail_mask(n - i);
+            __m512d q_v = _mm512_maskz_loadu_pd(lanes, q + i);
+            __m512d pi_v = _mm512_maskz_loadu_pd(lanes, pi + i);
+            __m512i count_bits = _mm512_or_si512(_mm512_maskz_loadu_epi64(lanes, counts + i), magic_bits);
+            __m512d counts_v = _mm512_sub_pd(_mm512_castsi512_pd(count_bits), magic);
+            __mmask8 valid = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(q_v, invalid, _CMP_GT_OQ), pi_v, invalid,
+                                                     _CMP_GT_OQ) & lanes;
+            __m512d bonus = _mm512_mul_pd(_mm512_mul_pd(exploration_v, pi_v), sqrt_v);
+            __m512d score = _mm512_add_pd(q_v, _mm512_div_pd(bonus, _mm512_add_pd(one, counts_v)));
+            sum = _mm512_mask_add_pd(sum, valid, sum, score);
+            _mm512_mask_storeu_pd(scores + i, lanes, _mm512_mask_blend_pd(valid, invalid, score));
+            valid_count += __builtin_popcount(static_cast<unsigned>(valid));
+        }
+        score_sum = horizontal_sum(sum);
+        return valid_count;
+    }
+
+    __attribute__((target("avx512f")))
+    size_t masked_copy_avx512(const double *values, size_t n, double *out, double &sum) {
+        const __m512d invalid = _mm512_set1_pd(MIN_FLOAT);
+        __m512d total = _mm512_setzero_pd();
+        size_t valid_count = 0;
+        for (size_t i = 0; i < n; i += 8) {
+            __mmask8 lanes = tail_mask(n - i);
+            __m512d v = _mm512_maskz_loadu_pd(lanes, values + i);
+            __mmask8 valid = _mm512_cmp_pd_mask(v, invalid, _CMP_GT_OQ) & lanes;
+            total = _mm512_mask_add_pd(total, valid, total, v);
+            _mm512_mask_storeu_pd(out + i, lanes, _mm512_mask_blend_pd(valid, invalid, v));
+            valid_count += __builtin_popcount(static_cast<unsigned>(valid));
+        }
+        sum = horizontal_sum(total);
+        return valid_count;
+    }
+
+    __attribute__((target("avx512f")))
+    void normalize_avx512(double *values, size_t n, double sum) {
+        const __m512d invalid = _mm512_set1_pd(MIN_FLOAT);
+        const __m512d sum_v = _mm512_set1_pd(sum);
+        for (size_t i = 0; i < n; i += 8) {
+            __mmask8 lanes = tail_mask(n - i);
+            __m512d v = _mm512_maskz_loadu_pd(lanes, values + i);
+            __mmask8 valid = _mm512_cmp_pd_mask(v, invalid, _CMP_GT_OQ) & lanes;
+            _mm512_mask_storeu_pd(values + i, valid, _mm512_div_pd(v, sum_v));
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    double rpo_difference_sum_avx512(const double *q, const double *scaled_pi, size_t n, double alpha,
+                                     double &derivative_sum, bool &zero_difference) {
+        const __m512d alpha_v = _mm512_set1_pd(alpha);
+        const __m512d zero = _mm512_setzero_pd();
+        const __m512d one = _mm512_set1_pd(1.0);
+        __m512d sum = _mm512_setzero_pd();
+        __m512d derivative = _mm512_setzero_pd();
+        __mmask8 zeros = 0;
+        for (size_t i = 0; i < n; i += 8) {
+            __mmask8 lanes = tail_mask(n - i);
+            __m512d diff = _mm512_sub_pd(alpha_v, _mm512_maskz_loadu_pd(lanes, q + i));
+            zeros |= _mm512_mask_cmp_pd_mask(lanes, diff, zero, _CMP_EQ_OQ);
+            __m512d inverse = _mm512_div_pd(one, diff);
+            __m512d term = _mm512_mul_pd(_mm512_maskz_loadu_pd(lanes, scaled_pi + i), inverse);
+            sum = _mm512_mask_add_pd(sum, lanes, sum, term);
+            derivative = _mm512_mask_add_pd(derivative, lanes, derivative, _mm512_mul_pd(term, inverse));
+        }
+        zero_difference = zeros != 0;
+        derivative_sum = horizontal_sum(derivative);
+        return horizontal_sum(sum);
+    }
+
+    __attribute__((target("avx512f")))
+    double rpo_weights_avx512(const double *q, const double *scaled_pi, size_t n, double alpha, double epsilon,
+                              double *weights) {
+        const __m512d invalid = _mm512_set1_pd(MIN_FLOAT);
+        const __m512d alpha_v = _mm512_set1_pd(alpha);
+        const __m512d epsilon_v = _mm512_set1_pd(epsilon);
+        __m512d sum = _mm512_setzero_pd();
+        for (size_t i = 0; i < n; i += 8) {
+            __mmask8 lanes = tail_mask(n - i);
+            __m512d q_v = _mm512_maskz_loadu_pd(lanes, q + i);
+            __mmask8 valid = _mm512_cmp_pd_mask(q_v, invalid, _CMP_GT_OQ) & lanes;
+            __m512d difference = _mm512_mask_max_pd(epsilon_v, lanes, _mm512_sub_pd(alpha_v, q_v), epsilon_v);
+            __m512d weight = _mm512_div_pd(_mm512_maskz_loadu_pd(lanes, scaled_pi + i), difference);
+            sum = _mm512_mask_add_pd(sum, valid, sum, weight);
+            _mm512_mask_storeu_pd(weights + i, lanes, _mm512_mask_blend_pd(valid, invalid, weight));
+        }
+        return horizontal_sum(sum);
+    }
+
+    constexpr PolicyKernels AVX512_KERNELS = {InstructionSet::AVX512, alpha_zero_scores_avx512, masked_copy_avx512,
+                                              normalize_avx512, rpo_difference_sum_avx512, rpo_weights_avx512};
+#endif
+}
+
+const PolicyKernels *htps::policy_kernels(InstructionSet instruction_set) {
+    switch (instruction_set) {
+        case InstructionSet::Scalar:
+            return &SCALAR_KERNELS;
+#ifdef HTPS_X86_KERNELS
+        case InstructionSet::AVX2:
+            return __builtin_cpu_supports("avx2") ? &AVX2_KERNELS : nullptr;
+        case InstructionSet::AVX512:
+            return __builtin_cpu_supports("avx512f") ? &AVX512_KERNELS : nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const PolicyKernels &htps::policy_kernels() {
+    static const PolicyKernels *selected = [] {
+        for (auto instruction_set: {InstructionSet::AVX512, InstructionSet::AVX2}) {
+            if (auto kernels = policy_kernels(instruction_set))
+                return kernels;
+        }
+        return &SCALAR_KERNELS;
+    }();
+    return *selected;
+}
+
+const char *htps::to_string(InstructionSet instruction_set) {
+    switch (instruction_set) {
+        case InstructionSet::Scalar:
+            return "scalar";
+        case InstructionSet::AVX2:
+            return "avx2";
+        case InstructionSet::AVX512:
+            return "avx512";
+        default:
+            return "unknown";
+    }
+}
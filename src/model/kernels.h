@@ -0,0 +1,55 @@
+#ifndef HTPS_KERNELS_H
+#define HTPS_KERNELS_H
+
+#include <cstddef>
+
+namespace htps {
+
+    enum class InstructionSet {
+        Scalar, AVX2, AVX512
+    };
+
+    /* Element-wise loops of the tree policies over contiguous arrays of all tactics of a node.
+     * Entries equal to MIN_FLOAT mark invalid tactics (e.g. killed ones). The kernels writing an output skip them in
+     * their sums and write MIN_FLOAT for them, rpo_difference_sum does not mask them, see there.
+     * Outputs may alias inputs of the same length, none of the kernels allocates.
+     * Counts are converted to doubles exactly as long as they are below 2^52.
+     * The vectorized kernels evaluate the same expressions as the scalar ones, only sums are accumulated in a
+     * different order.
+     * */
+    struct PolicyKernels {
+        InstructionSet instruction_set;
+
+        /* scores[i] = q[i] + exploration * pi[i] * sqrt_count_sum / (1 + counts[i]) if q[i] and pi[i] are valid.
+         * Returns the number of valid entries, score_sum is set to the sum of their scores. */
+        size_t (*alpha_zero_scores)(const double *q, const double *pi, const size_t *counts, size_t n,
+                                    double exploration, double sqrt_count_sum, double *scores, double &score_sum);
+
+        /* out[i] = values[i] if values[i] is valid. Returns the number of valid entries, sum is set to their sum. */
+        size_t (*masked_copy)(const double *values, size_t n, double *out, double &sum);
+
+        // values[i] = values[i] / sum for valid entries
+        void (*normalize)(double *values, size_t n, double sum);
+
+        /* Returns the sum of scaled_pi[i] / (alpha - q[i]), derivative_sum is set to the sum of
+         * scaled_pi[i] / (alpha - q[i])^2, the negated derivative with respect to alpha.
+         * zero_difference is set if alpha equals any q[i]. Invalid q[i] are not masked, they contribute 0 to both sums
+         * only because MIN_FLOAT is -inf, which requires a finite alpha and finite scaled_pi. */
+        double (*rpo_difference_sum)(const double *q, const double *scaled_pi, size_t n, double alpha,
+                                     double &derivative_sum, bool &zero_difference);
+
+        /* weights[i] = scaled_pi[i] / max(alpha - q[i], epsilon) if q[i] is valid. Returns the sum of valid weights. */
+        double (*rpo_weights)(const double *q, const double *scaled_pi, size_t n, double alpha, double epsilon,
+                              double *weights);
+    };
+
+    /* The kernels for the widest instruction set supported by the CPU, selected on first use. */
+    const PolicyKernels &policy_kernels();
+
+    /* The kernels for a specific instruction set, nullptr if the CPU or the build does not support it. */
+    const PolicyKernels *policy_kernels(InstructionSet instruction_set);
+
+    const char *to_string(InstructionSet instruction_set);
+}
+
+#endif //HTPS_KERNELS_H
@@ -3,6 +3,7 @@
 //
 
 #include "policy.h"
+#include "kernels.h"
 #include <vector>
 #include <stdexcept>
 #include <array>
@@ -13,15 +14,13 @@
 
 using namespace htps;
 
-constexpr size_t MAX_DEPTH = 50;
+constexpr size_t MAX_ITERATIONS = 50; // Enough for plain bisection to reach the tolerance
 constexpr double TOLERANCE = 1e-3;
 constexpr double EPSILON = 1e-10;
 
-void Policy::get_policy(const std::vector<double> &q_values, const std::vector<double> &pi_values,
-                        const std::vector<size_t> &counts, std::vector<double> &result) const {
+bool Policy::trivial_policy(std::span<const double> q_values, std::span<double> result) {
+    assert (q_values.size() == result.size());
     size_t valid_count = 0;
-    result.clear();
-    result.insert(result.begin(), q_values.size(), 0);
     std::array<size_t, 2> valid_indices{0, 0};
     for (size_t i = 0; i < q_values.size(); i++) {
         if (q_values[i] > MIN_FLOAT) {
@@ -38,26 +37,14 @@ void Policy::get_policy(const std::vector<double> &q_values, const std::vector<d
     if (valid_count == 1) {
         std::fill(result.begin(), result.end(), MIN_FLOAT);
         result[valid_indices[0]] = 1;
-        return;
+        return true;
     }
-    switch (type) {
-        case AlphaZero:
-            alpha_zero(q_values, pi_values, counts, result);
-            break;
-        case RPO:
-            try {
-                mcts_rpo(q_values, pi_values, counts, result);
-            }
-            catch (std::runtime_error &e) {
-                result.clear();
-                result.insert(result.begin(), q_values.size(), 0);
-                alpha_zero(q_values, pi_values, counts, result);
-            }
+    return false;
+}
 
-            break;
-        default:
-            throw std::invalid_argument("Invalid policy type");
-    }
+void Policy::check_policy([[maybe_unused]] std::span<const double> q_values,
+                          [[maybe_unused]] std::span<const double> result) {
+#ifndef NDEBUG
     bool is_nan = std::any_of(result.begin(), result.end(), [](double d) { return std::isnan(d); });
     assert (!is_nan);
     assert (q_values.size() == result.size());
@@ -67,91 +54,152 @@ void Policy::get_policy(const std::vector<double> &q_values, const std::vector<d
             sum += result[i];
     }
     assert (sum > 0.99 && sum < 1.01);
+#endif
 }
 
+template<PolicyType policy_type>
+void Policy::evaluate(std::span<const double> q_values, std::span<const double> pi_values,
+                      std::span<const size_t> counts, std::span<double> result) const {
+    if (trivial_policy(q_values, result))
+        return;
+    if constexpr (policy_type == AlphaZero) {
+        alpha_zero(q_values, pi_values, counts, result);
+    } else {
+        static_assert(policy_type == RPO);
+        if (!mcts_rpo(q_values, pi_values, counts, result))
+            alpha_zero(q_values, pi_values, counts, result);
+    }
+    check_policy(q_values, result);
+}
 
-void Policy::alpha_zero(const std::vector<double> &q_values, const std::vector<double> &pi_values,
-                        const std::vector<size_t> &counts, std::vector<double> &result) const {
-    std::vector<double> scores(q_values.size());
-    auto count_sum = static_cast<double>(std::accumulate(counts.begin(), counts.end(), static_cast<size_t>(0)));
-    std::vector<double> counts_d(counts.begin(), counts.end());
-    double score_sum = 0;
-    size_t valid_count = 0;
-    for (size_t i = 0; i < q_values.size(); i++) {
-        if (pi_values[i] > MIN_FLOAT && q_values[i] > MIN_FLOAT) {
-            scores[i] = q_values[i] + exploration * pi_values[i] * std::sqrt(count_sum) / (1 + counts_d[i]);
-            valid_count++;
-            score_sum += scores[i];
+template void Policy::evaluate<AlphaZero>(std::span<const double>, std::span<const double>, std::span<const size_t>,
+                                          std::span<double>) const;
+
+template void Policy::evaluate<RPO>(std::span<const double>, std::span<const double>, std::span<const size_t>,
+                                    std::span<double>) const;
+
+void Policy::get_policy(std::span<const double> q_values, std::span<const double> pi_values,
+                        std::span<const size_t> counts, std::span<double> result) const {
+    switch (type) {
+        case AlphaZero:
+            evaluate<AlphaZero>(q_values, pi_values, counts, result);
+            break;
+        case RPO:
+            evaluate<RPO>(q_values, pi_values, counts, result);
+            break;
+        default:
+            throw std::invalid_argument("Invalid policy type");
+    }
+}
+
+void Policy::get_policies(const std::vector<PolicyInput> &inputs, std::vector<std::vector<double>> &results) const {
+    results.resize(inputs.size());
+    if (type != RPO) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            results[i].resize(inputs[i].q_values.size());
+            get_policy(inputs[i].q_values, inputs[i].pi_values, inputs[i].counts, std::span<double>(results[i]));
+        }
+        return;
+    }
+    std::vector<RPOSolver> solvers;
+    std::vector<size_t> solver_inputs;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const PolicyInput &input = inputs[i];
+        results[i].resize(input.q_values.size());
+        if (trivial_policy(input.q_values, results[i]))
+            continue;
+        RPOSolver solver{};
+        if (prepare_rpo(input.q_values, input.pi_values, input.counts, results[i], solver)) {
+            solvers.push_back(solver);
+            solver_inputs.push_back(i);
         } else {
-            scores[i] = MIN_FLOAT;
+            check_policy(input.q_values, results[i]);
         }
     }
-    assert (valid_count > 0);
-    // If score sum is 0, simply return the uniform distribution over valid actions
-    if (1e-10 > score_sum && score_sum > -1e-10) {
-        for (size_t i = 0; i < q_values.size(); i++) {
-            if (q_values[i] > MIN_FLOAT && pi_values[i] > MIN_FLOAT) {
-                result[i] = 1.0 / static_cast<double>(valid_count);
-            } else {
-                result[i] = MIN_FLOAT;
+    bool running = !solvers.empty();
+    while (running) {
+        running = false;
+        for (auto &solver: solvers) {
+            if (solver.status == RPOSolver::Running) {
+                rpo_step(solver);
+                running |= solver.status == RPOSolver::Running;
             }
         }
-        return;
     }
-    // Normalize the scores
-    for (size_t i = 0; i < q_values.size(); i++) {
-        if (scores[i] > MIN_FLOAT)
-            result[i] = scores[i] / score_sum;
+    for (size_t j = 0; j < solvers.size(); j++) {
+        const PolicyInput &input = inputs[solver_inputs[j]];
+        std::vector<double> &result = results[solver_inputs[j]];
+        if (solvers[j].status == RPOSolver::Converged)
+            finish_rpo(solvers[j], result);
         else
-            result[i] = MIN_FLOAT;
+            alpha_zero(input.q_values, input.pi_values, input.counts, result);
+        check_policy(input.q_values, result);
     }
 }
 
-double Policy::find_rpo_alpha(double alpha_min, double alpha_max, const std::vector<double> &q_values,
-                              const std::vector<double> &scaled_pi_values) {
-    double alpha_mid;
-    double pi_difference_sum;
-    double diff;
 
-    for (size_t j = 0; j < MAX_DEPTH; j++) {
-        assert(alpha_min < alpha_max);
-        alpha_mid = (alpha_min + alpha_max) / 2;
-        pi_difference_sum = 0;
+void Policy::alpha_zero(std::span<const double> q_values, std::span<const double> pi_values,
+                        std::span<const size_t> counts, std::span<double> result) const {
+    const PolicyKernels &kernels = policy_kernels();
+    auto count_sum = static_cast<double>(std::accumulate(counts.begin(), counts.end(), static_cast<size_t>(0)));
+    double score_sum;
+    // The scores are computed in place in result, which avoids allocating a buffer per selection
+    size_t valid_count = kernels.alpha_zero_scores(q_values.data(), pi_values.data(), counts.data(), q_values.size(),
+                                                   exploration, std::sqrt(count_sum), result.data(), score_sum);
+    assert (valid_count > 0);
+    // If score sum is 0, simply return the uniform distribution over valid actions
+    if (1e-10 > score_sum && score_sum > -1e-10) {
         for (size_t i = 0; i < q_values.size(); i++) {
-            diff = alpha_mid - q_values[i];
-            if (diff == 0) {
-                throw std::runtime_error("Precision error");
+            if (result[i] > MIN_FLOAT) {
+                result[i] = 1.0 / static_cast<double>(valid_count);
             }
-            pi_difference_sum += scaled_pi_values[i] / diff;
         }
-        if (std::abs(pi_difference_sum - 1) < TOLERANCE) {
-            return alpha_mid;
+        return;
+    }
+    kernels.normalize(result.data(), result.size(), score_sum);
+}
+
+void Policy::rpo_step(RPOSolver &solver) {
+    double derivative_sum;
+    bool zero_difference;
+    double pi_difference_sum = policy_kernels().rpo_difference_sum(solver.q_values, solver.scaled_pi_values,
+                                                                   solver.size, solver.alpha, derivative_sum,
+                                                                   zero_difference);
+    solver.iterations++;
+    double next_alpha;
+    if (zero_difference || !std::isfinite(pi_difference_sum)) {
+        // alpha hit a pole, which can only happen at alpha_low for tactics without prior
+        next_alpha = (solver.alpha_low + solver.alpha_high) / 2;
+    } else {
+        double residual = pi_difference_sum - 1;
+        if (std::abs(residual) < TOLERANCE) {
+            solver.status = RPOSolver::Converged;
+            return;
         }
-        if (pi_difference_sum > 1)
-            alpha_min = alpha_mid;
+        if (residual > 0)
+            solver.alpha_low = solver.alpha;
         else
-            alpha_max = alpha_mid;
+            solver.alpha_high = solver.alpha;
+        // The derivative of the sum with respect to alpha is -derivative_sum
+        next_alpha = solver.alpha + residual / derivative_sum;
+        if (!(next_alpha > solver.alpha_low && next_alpha < solver.alpha_high))
+            next_alpha = (solver.alpha_low + solver.alpha_high) / 2;
+    }
+    if (solver.iterations >= MAX_ITERATIONS || !(solver.alpha_low < solver.alpha_high)) {
+        solver.status = RPOSolver::Failed;
+        return;
     }
-    throw std::runtime_error("Max depth reached");
+    solver.alpha = next_alpha;
 }
 
-
-void Policy::mcts_rpo(const std::vector<double> &q_values, const std::vector<double> &pi_values,
-                      const std::vector<size_t> &counts, std::vector<double> &result) const {
+bool Policy::prepare_rpo(std::span<const double> q_values, std::span<const double> pi_values,
+                         std::span<const size_t> counts, std::span<double> result, RPOSolver &solver) const {
+    const PolicyKernels &kernels = policy_kernels();
     auto count_sum = static_cast<double>(std::accumulate(counts.begin(), counts.end(), static_cast<size_t>(0)));
     double multiplier = std::sqrt(count_sum) / (count_sum + static_cast<double>(counts.size())) * exploration;
     if (multiplier <= 0) {
-        size_t valid_count = 0;
-        double q_sum = 0;
-        for (size_t i = 0; i < q_values.size(); i++) {
-            if (q_values[i] > MIN_FLOAT) {
-                result[i] = q_values[i];
-                q_sum += q_values[i];
-                valid_count++;
-            } else {
-                result[i] = MIN_FLOAT;
-            }
-        }
+        double q_sum;
+        size_t valid_count = kernels.masked_copy(q_values.data(), q_values.size(), result.data(), q_sum);
         // If q sum is 0, simply return the uniform distribution over valid actions
         assert (valid_count > 0);
         if (1e-10 > q_sum && q_sum > -1e-10) {
@@ -162,20 +210,14 @@ void Policy::mcts_rpo(const std::vector<double> &q_values, const std::vector<dou
                     result[i] = MIN_FLOAT;
                 }
             }
-            return;
-        }
-
-        for (size_t i = 0; i < q_values.size(); i++) {
-            if (q_values[i] > MIN_FLOAT) {
-                result[i] = result[i] / q_sum;
-            } else {
-                result[i] = MIN_FLOAT;
-            }
+            return false;
         }
-        return;
+        kernels.normalize(result.data(), result.size(), q_sum);
+        return false;
     }
 
-    std::vector<double> scaled_pi_values(q_values.size());
+    // result holds the scaled priors until the weights overwrite them in place
+    std::span<double> scaled_pi_values = result;
 
     double alpha_min = 0, alpha_max = 0;
 
@@ -184,23 +226,29 @@ void Policy::mcts_rpo(const std::vector<double> &q_values, const std::vector<dou
         alpha_min = std::max(alpha_min, q_values[i] + multiplier * pi_values[i]);
         alpha_max = std::max(alpha_max, q_values[i] + multiplier);
     }
-    double alpha = find_rpo_alpha(alpha_min, alpha_max, q_values, scaled_pi_values);
-    double result_sum = 0;
-    for (size_t i = 0; i < q_values.size(); i++) {
-        if (q_values[i] > MIN_FLOAT) {
-            result[i] = scaled_pi_values[i] / std::max((alpha - q_values[i]), EPSILON);
-            result_sum += result[i];
-        }
-        else {
-            result[i] = MIN_FLOAT;
-        }
-    }
-    for (size_t i = 0; i < q_values.size(); i++) {
-        if (result[i] > MIN_FLOAT)
-            result[i] = result[i] / result_sum;
-        else
-            result[i] = MIN_FLOAT;
-    }
+    solver = {q_values.data(), scaled_pi_values.data(), q_values.size(), alpha_min, alpha_max, alpha_min, 0,
+              alpha_min < alpha_max ? RPOSolver::Running : RPOSolver::Failed};
+    return true;
+}
+
+void Policy::finish_rpo(const RPOSolver &solver, std::span<double> result) {
+    const PolicyKernels &kernels = policy_kernels();
+    double result_sum = kernels.rpo_weights(solver.q_values, result.data(), solver.size, solver.alpha, EPSILON,
+                                            result.data());
+    kernels.normalize(result.data(), result.size(), result_sum);
+}
+
+bool Policy::mcts_rpo(std::span<const double> q_values, std::span<const double> pi_values,
+                      std::span<const size_t> counts, std::span<double> result) const {
+    RPOSolver solver{};
+    if (!prepare_rpo(q_values, pi_values, counts, result, solver))
+        return true;
+    while (solver.status == RPOSolver::Running)
+        rpo_step(solver);
+    if (solver.status == RPOSolver::Failed)
+        return false;
+    finish_rpo(solver, result);
+    return true;
 }
 
 Policy Policy::from_json(const nlohmann::json &j) {
@@ -8,6 +8,8 @@
 #include <vector>
 #include <cassert>
 #include <limits>
+#include <cstddef>
+#include <span>
 #include "../json.hpp"
 
 namespace htps {
@@ -17,6 +19,14 @@ namespace htps {
     };
 
 
+    /* Inputs of the policy of a single node, see Policy::get_policy */
+    struct PolicyInput {
+        std::span<const double> q_values;
+        std::span<const double> pi_values;
+        std::span<const size_t> counts;
+    };
+
+
 /* Tree policy for MCTS */
     class Policy {
     private:
@@ -28,28 +38,87 @@ namespace htps {
          * q_values: The q-values for each action
          * pi_values: The prior values for each action
          * counts: The number of times each action has been taken
-         * result: The resulting policy vector
+         * result: The resulting policy, of the same size as q_values. It doubles as scratch space, the policies do not
+         * allocate.
          * */
+        void get_policy(std::span<const double> q_values, std::span<const double> pi_values,
+                        std::span<const size_t> counts, std::span<double> result) const;
+
+        /* get_policy for a fixed policy type, without the dispatch on the type. Ignores overrides of get_policy, callers
+         * have to make sure to only use it on plain Policy objects of this type. */
+        template<PolicyType policy_type>
+        void evaluate(std::span<const double> q_values, std::span<const double> pi_values,
+                      std::span<const size_t> counts, std::span<double> result) const;
+
+        // Resizes result to the number of actions, which only allocates if it has to grow
         void get_policy(const std::vector<double> &q_values, const std::vector<double> &pi_values,
-                        const std::vector<size_t> &counts, std::vector<double> &result) const;
+                        const std::vector<size_t> &counts, std::vector<double> &result) const {
+            result.resize(q_values.size());
+            get_policy(std::span<const double>(q_values), std::span<const double>(pi_values),
+                       std::span<const size_t>(counts), std::span<double>(result));
+        }
+
+        /* Policies of several nodes at once, results[i] is set to the policy of inputs[i].
+         * For RPO, the solvers of all nodes advance in lockstep, so the iterations of different nodes overlap instead
+         * of waiting on each other. Subclasses that override get_policy should override this as well.
+         * */
+        virtual void get_policies(const std::vector<PolicyInput> &inputs,
+                                  std::vector<std::vector<double>> &results) const;
 
         Policy(PolicyType type, double exploration) : type(type), exploration(exploration) {
             assert(type != PolicyTypeCount);
         }
 
+        PolicyType get_type() const {
+            return type;
+        }
+
         static Policy from_json(const nlohmann::json &j);
 
         explicit operator nlohmann::json() const;
 
     protected:
-        void alpha_zero(const std::vector<double> &q_values, const std::vector<double> &pi_values,
-                        const std::vector<size_t> &counts, std::vector<double> &result) const;
+        /* Solver for the alpha of the RPO policy, the root of sum_i scaled_pi_i / (alpha - q_i) = 1.
+         * The sum is decreasing and convex in alpha, so Newton steps from alpha_low approach the root from below without
+         * overshooting. The bracket [alpha_low, alpha_high] is kept nevertheless, steps leaving it fall back to
+         * bisection, which also handles poles of the sum.
+         * */
+        struct RPOSolver {
+            enum Status {
+                Running, Converged, Failed
+            };
+            const double *q_values;
+            const double *scaled_pi_values;
+            size_t size;
+            double alpha_low;
+            double alpha_high;
+            double alpha;
+            size_t iterations;
+            Status status;
+        };
+
+        // Returns true if the policy does not depend on the policy type, in which case it is written to result
+        static bool trivial_policy(std::span<const double> q_values, std::span<double> result);
+
+        static void check_policy(std::span<const double> q_values, std::span<const double> result);
+
+        void alpha_zero(std::span<const double> q_values, std::span<const double> pi_values,
+                        std::span<const size_t> counts, std::span<double> result) const;
+
+        // Returns false if alpha could not be found, the caller falls back to AlphaZero in that case
+        bool mcts_rpo(std::span<const double> q_values, std::span<const double> pi_values,
+                      std::span<const size_t> counts, std::span<double> result) const;
+
+        /* Stores the scaled priors in result and sets up the solver for them. Returns false if no root has to be found,
+         * in which case result already holds the policy. */
+        bool prepare_rpo(std::span<const double> q_values, std::span<const double> pi_values,
+                         std::span<const size_t> counts, std::span<double> result, RPOSolver &solver) const;
 
-        void mcts_rpo(const std::vector<double> &q_values, const std::vector<double> &pi_values,
-                      const std::vector<size_t> &counts, std::vector<double> &result) const;
+        // A single safeguarded Newton step, one pass over the tactics
+        static void rpo_step(RPOSolver &solver);
 
-        static double find_rpo_alpha(double alpha_min, double alpha_max, const std::vector<double> &q_values,
-                                     const std::vector<double> &scaled_pi_values);
+        // Replaces the scaled priors in result by the normalized policy of the converged solver
+        static void finish_rpo(const RPOSolver &solver, std::span<double> result);
     };
 }
 #endif //HTPS_POLICY_H
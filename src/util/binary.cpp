@@ -0,0 +1,99 @@
+#include "binary.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace htps;
+
+BinaryFileWriter::BinaryFileWriter(const std::string &path) : path(path), fd(-1), position(0), buffer() {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+    }
+    buffer.reserve(BUFFER_SIZE);
+}
+
+BinaryFileWriter::~BinaryFileWriter() {
+    try {
+        close();
+    } catch (const std::exception &) {}
+}
+
+void BinaryFileWriter::write(const void *data, size_t size) {
+    if (fd < 0) {
+        throw std::runtime_error("Writing to closed file " + path);
+    }
+    if (size == 0)
+        return;
+    buffer.append(static_cast<const char *>(data), size);
+    position += size;
+    if (buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+void BinaryFileWriter::write_string(std::string_view s) {
+    write_value<uint64_t>(s.size());
+    write(s.data(), s.size());
+}
+
+void BinaryFileWriter::pad(size_t alignment) {
+    static constexpr char zeros[16] = {};
+    size_t padding = (alignment - position % alignment) % alignment;
+    while (padding > 0) {
+        size_t n = std::min(padding, sizeof(zeros));
+        write(zeros, n);
+        padding -= n;
+    }
+}
+
+void BinaryFileWriter::flush() {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Could not write " + path + ": " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(n);
+    }
+    buffer.clear();
+}
+
+void BinaryFileWriter::close() {
+    if (fd < 0)
+        return;
+    flush();
+    int status = ::close(fd);
+    fd = -1;
+    if (status != 0) {
+        throw std::runtime_error("Could not close " + path + ": " + std::strerror(errno));
+    }
+}
+
+MappedFile::MappedFile(const std::string &path) : fd(-1), mapped(nullptr), mapped_size(0) {
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not read " + path);
+    }
+    mapped_size = info.st_size;
+    void *mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("Could not map " + path);
+    }
+    mapped = static_cast<const char *>(mapping);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char *>(mapped), mapped_size);
+    ::close(fd);
+}
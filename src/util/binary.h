@@ -0,0 +1,133 @@
+#ifndef HTPS_BINARY_H
+#define HTPS_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace htps {
+
+    /* Writes a new file through a buffer. Values are written in native byte order, the files are not meant to be moved
+     * between machines with a different byte order. */
+    class BinaryFileWriter {
+    private:
+        static constexpr size_t BUFFER_SIZE = 1 << 20;
+        std::string path;
+        int fd;
+        uint64_t position; // Bytes written so far, including the buffered ones
+        std::string buffer;
+
+    public:
+        // Creates the file, or truncates it if it exists
+        explicit BinaryFileWriter(const std::string &path);
+
+        BinaryFileWriter(const BinaryFileWriter &) = delete;
+
+        BinaryFileWriter &operator=(const BinaryFileWriter &) = delete;
+
+        // Closes the file, errors while flushing are lost, call close to see them
+        ~BinaryFileWriter();
+
+        void write(const void *data, size_t size);
+
+        template<typename T>
+        void write_value(const T &value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write(&value, sizeof(T));
+        }
+
+        // [uint64 length][bytes]
+        void write_string(std::string_view s);
+
+        // Writes zero bytes until the position is a multiple of alignment
+        void pad(size_t alignment);
+
+        uint64_t tell() const {
+            return position;
+        }
+
+        void flush();
+
+        void close();
+
+        const std::string &get_path() const {
+            return path;
+        }
+    };
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+    private:
+        int fd;
+        const char *mapped;
+        size_t mapped_size;
+
+    public:
+        explicit MappedFile(const std::string &path);
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile();
+
+        const char *data() const {
+            return mapped;
+        }
+
+        size_t size() const {
+            return mapped_size;
+        }
+    };
+
+    // Reads values from a range of bytes, throwing std::runtime_error instead of reading past its end
+    class BinaryReader {
+    private:
+        const char *data;
+        size_t size;
+        size_t position;
+
+    public:
+        BinaryReader(const char *data, size_t size, size_t position = 0) : data(data), size(size), position(position) {
+            if (position > size)
+                throw std::runtime_error("Position outside of the data");
+        }
+
+        const char *read_bytes(size_t n) {
+            if (n > size - position)
+                throw std::runtime_error("Unexpected end of data");
+            const char *start = data + position;
+            position += n;
+            return start;
+        }
+
+        template<typename T>
+        T read() {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value;
+            std::memcpy(&value, read_bytes(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        // Reads what BinaryFileWriter::write_string wrote, the view points into the data
+        std::string_view read_string() {
+            auto length = read<uint64_t>();
+            return {read_bytes(length), static_cast<size_t>(length)};
+        }
+
+        void align(size_t alignment) {
+            size_t padding = (alignment - position % alignment) % alignment;
+            read_bytes(padding);
+        }
+
+        size_t tell() const {
+            return position;
+        }
+    };
+}
+
+#endif //HTPS_BINARY_H
@@ -0,0 +1,85 @@
+#include "concurrency.h"
+#include <stdexcept>
+
+using namespace htps;
+
+ThreadPool::ThreadPool(size_t num_threads) : workers(), job(nullptr), job_size(0), next_index(0), busy_workers(0),
+                                             generation(0), stopping(false), error() {
+    if (num_threads == 0) {
+        throw std::invalid_argument("Thread pool needs at least one thread");
+    }
+    workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::worker_loop(size_t worker_id) {
+    size_t seen_generation = 0;
+    while (true) {
+        const std::function<void(size_t, size_t)> *current_job;
+        size_t current_size;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_available.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping)
+                return;
+            seen_generation = generation;
+            current_job = job;
+            current_size = job_size;
+        }
+        for (size_t index = next_index.fetch_add(1); index < current_size; index = next_index.fetch_add(1)) {
+            try {
+                (*current_job)(index, worker_id);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers--;
+            if (busy_workers == 0)
+                job_finished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t, size_t)> &fn) {
+    if (count == 0)
+        return;
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+    std::exception_ptr job_error;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &fn;
+        job_size = count;
+        next_index.store(0);
+        busy_workers = workers.size();
+        error = nullptr;
+        generation++;
+        job_available.notify_all();
+        job_finished.wait(lock, [this] { return busy_workers == 0; });
+        job = nullptr;
+        job_error = error;
+        error = nullptr;
+    }
+    if (job_error)
+        std::rethrow_exception(job_error);
+}
@@ -0,0 +1,148 @@
+#ifndef HTPS_CONCURRENCY_H
+#define HTPS_CONCURRENCY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace htps {
+
+    /* Fixed size pool of worker threads.
+     * The pool only supports blocking parallel loops, i.e. a single job runs at a time and the caller waits until all
+     * indices of the job have been processed.
+     * */
+    class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::mutex job_mutex; // Serializes calls to parallel_for
+        std::mutex mutex;
+        std::condition_variable job_available;
+        std::condition_variable job_finished;
+        const std::function<void(size_t, size_t)> *job;
+        size_t job_size;
+        std::atomic<size_t> next_index;
+        size_t busy_workers;
+        size_t generation; // Incremented for every job, so that workers can detect new work
+        bool stopping;
+        std::exception_ptr error;
+
+        void worker_loop(size_t worker_id);
+
+    public:
+        explicit ThreadPool(size_t num_threads);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        size_t size() const;
+
+        /* Calls fn(index, worker_id) for every index in [0, count) and blocks until all calls returned.
+         * Indices are handed out dynamically, worker_id is in [0, size()) and can be used to address per-thread
+         * state. The first exception thrown by fn is rethrown in the calling thread once the job finished.
+         * */
+        void parallel_for(size_t count, const std::function<void(size_t, size_t)> &fn);
+    };
+
+    /* Blocking multi-producer, multi-consumer queue with a fixed capacity.
+     * Closing the queue wakes up all waiting threads. Pushing to a closed queue fails, popping from a closed queue
+     * still returns the remaining items before signalling the end with an empty optional.
+     * */
+    template<typename T>
+    class BoundedQueue {
+    private:
+        mutable std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed;
+
+    public:
+        explicit BoundedQueue(size_t capacity) : items(), capacity(capacity), closed(false) {
+            if (capacity == 0) {
+                throw std::invalid_argument("Queue capacity must be positive");
+            }
+        }
+
+        BoundedQueue(const BoundedQueue &) = delete;
+
+        BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+        // Blocks while the queue is full. Returns false if the queue was closed, in which case item is dropped
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+            lock.unlock();
+            not_empty.notify_one();
+            return true;
+        }
+
+        // Blocks while the queue is empty. Returns an empty optional once the queue is closed and drained
+        std::optional<T> pop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this] { return closed || !items.empty(); });
+            if (items.empty())
+                return std::nullopt;
+            T item = std::move(items.front());
+            items.pop_front();
+            lock.unlock();
+            not_full.notify_one();
+            return item;
+        }
+
+        std::optional<T> try_pop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (items.empty())
+                return std::nullopt;
+            T item = std::move(items.front());
+            items.pop_front();
+            lock.unlock();
+            not_full.notify_one();
+            return item;
+        }
+
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            not_empty.notify_all();
+            not_full.notify_all();
+        }
+
+        bool is_closed() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return closed;
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return items.size();
+        }
+
+        // Removes all items without closing the queue
+        void clear() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                items.clear();
+            }
+            not_full.notify_all();
+        }
+    };
+}
+
+#endif //HTPS_CONCURRENCY_H
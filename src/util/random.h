@@ -0,0 +1,86 @@
+#ifndef HTPS_RANDOM_H
+#define HTPS_RANDOM_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace htps {
+
+    // SplitMix64, advances state and returns the next output. Used to expand seeds into generator states.
+    inline uint64_t splitmix64(uint64_t &state) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /* xoshiro256** (Blackman and Vigna), a small and fast generator with 256 bits of state. It satisfies
+     * UniformRandomBitGenerator, so it works with the standard distributions.
+     * Generators are not thread-safe. Concurrent users each take their own substream instead.
+     * */
+    class Xoshiro256 {
+    private:
+        std::array<uint64_t, 4> state{};
+
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+    public:
+        using result_type = uint64_t;
+
+        explicit Xoshiro256(uint64_t seed = 0) {
+            this->seed(seed);
+        }
+
+        void seed(uint64_t seed) {
+            for (auto &s: state)
+                s = splitmix64(seed);
+        }
+
+        static constexpr result_type min() {
+            return 0;
+        }
+
+        static constexpr result_type max() {
+            return std::numeric_limits<result_type>::max();
+        }
+
+        result_type operator()() {
+            uint64_t result = rotl(state[1] * 5, 7) * 9;
+            uint64_t t = state[1] << 17;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = rotl(state[3], 45);
+            return result;
+        }
+
+        /* An independent generator for the given index, e.g. one per descent of a batch. It only depends on the
+         * current state and the index, not on how many numbers other substreams have drawn or on which thread uses
+         * them. The generator itself is not advanced. */
+        Xoshiro256 substream(uint64_t index) const {
+            uint64_t mixed = state[0] ^ rotl(state[1], 16) ^ rotl(state[2], 32) ^ rotl(state[3], 48);
+            uint64_t index_state = index;
+            return Xoshiro256(mixed ^ splitmix64(index_state));
+        }
+
+        const std::array<uint64_t, 4> &get_state() const {
+            return state;
+        }
+
+        void set_state(const std::array<uint64_t, 4> &new_state) {
+            state = new_state;
+        }
+
+        bool operator==(const Xoshiro256 &other) const = default;
+    };
+
+    // The generator of the search, see HTPS::set_seed
+    using Rng = Xoshiro256;
+}
+
+#endif //HTPS_RANDOM_H
@@ -4,14 +4,135 @@
 
 // C++
 #include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <cstdlib>
 #include <memory>
+#include <new>
+#include <random>
+#include <set>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <stdexcept>
+#include <filesystem>
 #include <fstream>
 #include "../src/graph/htps.h"
+#include "../src/graph/columns.h"
+#include "../src/graph/shard.h"
+#include "../src/graph/engine.h"
+#include "../src/graph/scheduler.h"
+#include "../src/model/kernels.h"
 
 using namespace htps;
 
+/* Counts the heap allocations of the current thread while enabled, to check that hot paths do not allocate.
+ * All replaceable forms are replaced, so every allocation of the binary goes through malloc and free in pairs. */
+thread_local bool count_allocations = false;
+thread_local size_t allocation_count = 0;
+
+static void *counted_allocation(size_t size, size_t alignment = 0) noexcept {
+    if (count_allocations)
+        allocation_count++;
+    if (size == 0)
+        size = 1;
+    if (alignment <= alignof(std::max_align_t))
+        return std::malloc(size);
+    // aligned_alloc requires the size to be a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+/* Not inlined into the replaced operator delete: GCC would otherwise see free called on the result of a new expression
+ * at every delete, and report it as -Wmismatched-new-delete. */
+[[gnu::noinline]] static void counted_release(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void *operator new(size_t size) {
+    if (void *ptr = counted_allocation(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    if (void *ptr = counted_allocation(size, static_cast<size_t>(alignment)))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return counted_allocation(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return counted_allocation(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return counted_allocation(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return counted_allocation(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    counted_release(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    counted_release(ptr);
+}
+
 nlohmann::json load_json_from_file(const std::string &filename) {
     std::ifstream file(filename);
     if (!file) {
@@ -54,11 +175,11 @@ public:
 // Dummy policy that simply returns the priors as the computed policy.
 class DummyPolicy : public Policy {
 public:
-    void get_policy(const std::vector<double> &q_values,
-                    const std::vector<double> &priors,
-                    const std::vector<size_t> &counts,
-                    std::vector<double> &result) const override {
-        result = priors;
+    void get_policy(std::span<const double> q_values,
+                    std::span<const double> priors,
+                    std::span<const size_t> counts,
+                    std::span<double> result) const override {
+        std::copy(priors.begin(), priors.end(), result.begin());
     }
 
     DummyPolicy() : Policy(PolicyType::AlphaZero, 0.2) {}
@@ -188,6 +309,21 @@ TEST_F(HTPSTest, GetResultImmediatelySolvedTest) {
     EXPECT_FALSE(samples_critic.empty());
     EXPECT_FALSE(samples_tactic.empty());
     EXPECT_FALSE(samples_effect.empty());
+
+    // The getters are views, taking the samples moves them out without copying
+    EXPECT_EQ(&result.get_critic_samples(), &samples_critic);
+    const HTPSSampleTactics *tactic_data = samples_tactic.data();
+    size_t tactic_count = samples_tactic.size();
+    auto taken_tactics = result.take_tactic_samples();
+    EXPECT_EQ(taken_tactics.data(), tactic_data);
+    EXPECT_EQ(taken_tactics.size(), tactic_count);
+    EXPECT_TRUE(result.get_tactic_samples().empty());
+    auto taken_critic = result.take_critic_samples();
+    EXPECT_FALSE(taken_critic.empty());
+    EXPECT_TRUE(result.get_critic_samples().empty());
+    EXPECT_EQ(result.take_effect_samples().size(), 1);
+    EXPECT_EQ(result.take_proof_samples().size(), 1);
+    EXPECT_TRUE(result.get_proof_samples().empty());
 }
 
 
@@ -1125,4 +1261,1538 @@ TEST_F(HTPSTest, TestJsonExpectations) {
     }
 //    auto theorems = search.theorems_to_expand();
 //    auto result = search.get_result();
-}
\ No newline at end of file
+}
+/* Same setup as TestSiblingEquality, but the shared grandchild B3 is expanded afterwards.
+ * Both paths to B3 belong to the same simulation, so both need to receive the value for the backup to succeed.
+ */
+TEST_F(HTPSTest, TestSiblingEqualityBackup) {
+    htps_instance->set_params(dummyParams);
+    htps_instance->theorems_to_expand();
+
+    TheoremPointer child1 = static_pointer_cast<htps::theorem>(std::make_shared<DummyTheorem>("B1"));
+    TheoremPointer child2 = static_pointer_cast<htps::theorem>(std::make_shared<DummyTheorem>("B2"));
+    TheoremPointer child3 = static_pointer_cast<htps::theorem>(std::make_shared<DummyTheorem>("B3"));
+    std::vector<size_t> envDurations = {1};
+    std::vector<double> priors = {1.0};
+
+    auto make_expansion = [&](TheoremPointer thm, std::shared_ptr<DummyTactic> tac, std::vector<TheoremPointer> children) {
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = tac;
+        effect->children = children;
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {tac};
+        std::vector<std::vector<htps::TheoremPointer>> childrenForTactic = {children};
+        return std::make_shared<htps::env_expansion>(thm, 1, 1, envDurations, effects, -0.5, tactics,
+                                                     childrenForTactic, priors);
+    };
+
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions = {make_expansion(root, dummyTac, {child1, child2})};
+    htps_instance->expand_and_backup(expansions);
+    htps_instance->theorems_to_expand();
+    expansions = {make_expansion(child1, dummyTac2, {child3}), make_expansion(child2, dummyTac3, {child3})};
+    htps_instance->expand_and_backup(expansions);
+
+    auto theorems = htps_instance->theorems_to_expand();
+    EXPECT_TRUE(theorems.size() == 1 && theorems[0] == child3);
+    expansions = {make_expansion(child3, dummyTac, {})};
+    htps_instance->expand_and_backup(expansions);
+    EXPECT_TRUE(htps_instance->is_proven());
+    htps_instance->get_result();
+}
+
+/* Selecting with several threads has to hand out each theorem at most once, spread the batch over the tactics by
+ * the virtual loss of earlier waves, and leave no virtual counts behind once all expansions are received.
+ */
+TEST_F(HTPSTest, TestParallelSelection) {
+    dummyParams.num_threads = 4;
+    dummyParams.succ_expansions = 32;
+    dummyParams.virtual_loss = 1;
+    htps_instance->set_params(dummyParams);
+    htps_instance->theorems_to_expand();
+
+    std::vector<std::shared_ptr<htps::env_effect>> effects;
+    std::vector<std::shared_ptr<htps::tactic>> tactics;
+    std::vector<std::vector<htps::TheoremPointer>> childrenForTactic;
+    std::vector<TheoremPointer> children;
+    for (size_t i = 0; i < 8; i++) {
+        TheoremPointer child = static_pointer_cast<htps::theorem>(
+                std::make_shared<DummyTheorem>("B" + std::to_string(i)));
+        auto tac = std::make_shared<DummyTactic>("tactic_" + std::to_string(i));
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = root;
+        effect->tac = tac;
+        effect->children = {child};
+        effects.push_back(effect);
+        tactics.push_back(tac);
+        childrenForTactic.push_back({child});
+        children.push_back(child);
+    }
+    std::vector<double> priors(8, 1.0 / 8);
+    std::vector<size_t> envDurations(8, 1);
+    htps::env_expansion expansion(root, 1, 1, envDurations, effects, -0.5, tactics, childrenForTactic, priors);
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions = {std::make_shared<htps::env_expansion>(expansion)};
+    htps_instance->expand_and_backup(expansions);
+
+    auto theorems = htps_instance->theorems_to_expand();
+    EXPECT_GT(theorems.size(), 1);
+    TheoremSet unique_theorems;
+    for (const auto &thm: theorems) {
+        EXPECT_FALSE(unique_theorems.contains(thm));
+        unique_theorems.insert(thm);
+        EXPECT_TRUE(std::find(children.begin(), children.end(), thm) != children.end());
+    }
+
+    expansions.clear();
+    for (const auto &thm: theorems) {
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = dummyTac;
+        effect->children = {};
+        std::vector<std::shared_ptr<htps::env_effect>> solving_effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> solving_tactics = {dummyTac};
+        std::vector<std::vector<htps::TheoremPointer>> solving_children = {{}};
+        std::vector<double> solving_priors = {1.0};
+        std::vector<size_t> solving_durations = {1};
+        TheoremPointer goal = thm;
+        expansions.push_back(std::make_shared<htps::env_expansion>(goal, 1, 1, solving_durations, solving_effects, 0.0,
+                                                                   solving_tactics, solving_children, solving_priors));
+    }
+    htps_instance->expand_and_backup(expansions);
+    EXPECT_TRUE(htps_instance->is_proven());
+    EXPECT_FALSE(htps_instance->is_expanding());
+    htps_instance->get_result();
+}
+
+/* The engine searches on its own thread, the test thread acts as the environment.
+ * The root has two tactics with one child each, every child is solved directly.
+ * */
+TEST_F(HTPSTest, TestEngineSearch) {
+    dummyParams.succ_expansions = 4;
+    HTPSEngine engine(root, dummyParams, 4, 2);
+    engine.start();
+
+    size_t expanded = 0;
+    while (auto theorems = engine.get_theorems()) {
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+        for (const auto &thm: *theorems) {
+            TheoremPointer goal = thm;
+            std::vector<std::shared_ptr<htps::env_effect>> effects;
+            std::vector<std::shared_ptr<htps::tactic>> tactics;
+            std::vector<std::vector<htps::TheoremPointer>> childrenForTactic;
+            if (thm == root) {
+                for (size_t i = 0; i < 2; i++) {
+                    TheoremPointer child = static_pointer_cast<htps::theorem>(
+                            std::make_shared<DummyTheorem>("B" + std::to_string(i)));
+                    auto tac = std::make_shared<DummyTactic>("tactic_" + std::to_string(i));
+                    auto effect = std::make_shared<htps::env_effect>();
+                    effect->goal = goal;
+                    effect->tac = tac;
+                    effect->children = {child};
+                    effects.push_back(effect);
+                    tactics.push_back(tac);
+                    childrenForTactic.push_back({child});
+                }
+            } else {
+                auto effect = std::make_shared<htps::env_effect>();
+                effect->goal = goal;
+                effect->tac = dummyTac;
+                effect->children = {};
+                effects.push_back(effect);
+                tactics.push_back(dummyTac);
+                childrenForTactic.push_back({});
+            }
+            std::vector<double> priors(tactics.size(), 1.0 / static_cast<double>(tactics.size()));
+            std::vector<size_t> envDurations(tactics.size(), 1);
+            expansions.push_back(std::make_shared<htps::env_expansion>(goal, 1, 1, envDurations, effects, -0.5,
+                                                                       tactics, childrenForTactic, priors));
+            expanded++;
+        }
+        EXPECT_TRUE(engine.submit_expansions(expansions));
+    }
+    auto result = engine.get_result();
+    ASSERT_TRUE(result.has_value());
+    EXPECT_TRUE(result->get_proof().has_value());
+    EXPECT_GE(expanded, 2);
+    EXPECT_FALSE(engine.is_running());
+}
+
+TEST_F(HTPSTest, TestEngineRejectsUnknownTheorem) {
+    HTPSEngine engine(root, dummyParams);
+    engine.start();
+    auto theorems = engine.get_theorems();
+    ASSERT_TRUE(theorems.has_value());
+    TheoremPointer unknown = std::make_shared<DummyTheorem>("unknown");
+    std::vector<std::shared_ptr<htps::tactic>> tactics = {dummyTac};
+    std::vector<std::shared_ptr<htps::env_effect>> effects;
+    std::vector<std::vector<htps::TheoremPointer>> childrenForTactic = {{}};
+    std::vector<double> priors = {1.0};
+    std::vector<size_t> envDurations = {1};
+    engine.submit_expansions({std::make_shared<htps::env_expansion>(unknown, 1, 1, envDurations, effects, 0.0, tactics,
+                                                                    childrenForTactic, priors)});
+    EXPECT_THROW(engine.get_result(), std::runtime_error);
+    EXPECT_FALSE(engine.get_theorems().has_value());
+}
+
+/* With async_expansions, new theorems can be requested before all outstanding ones were expanded, and expansions can
+ * arrive one by one.
+ * */
+TEST_F(HTPSTest, TestAsyncExpansions) {
+    dummyParams.async_expansions = true;
+    dummyParams.succ_expansions = 2;
+    dummyParams.virtual_loss = 1;
+    htps_instance->set_params(dummyParams);
+
+    auto solving_expansion = [this](const TheoremPointer &thm) {
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = dummyTac;
+        effect->children = {};
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {dummyTac};
+        std::vector<std::vector<htps::TheoremPointer>> childrenForTactic = {{}};
+        std::vector<double> priors = {1.0};
+        std::vector<size_t> envDurations = {1};
+        TheoremPointer goal = thm;
+        return std::make_shared<htps::env_expansion>(goal, 1, 1, envDurations, effects, 0.0, tactics,
+                                                     childrenForTactic, priors);
+    };
+
+    htps_instance->theorems_to_expand();
+    std::vector<std::shared_ptr<htps::env_effect>> effects;
+    std::vector<std::shared_ptr<htps::tactic>> tactics;
+    std::vector<std::vector<htps::TheoremPointer>> childrenForTactic;
+    for (size_t i = 0; i < 3; i++) {
+        TheoremPointer child = static_pointer_cast<htps::theorem>(
+                std::make_shared<DummyTheorem>("B" + std::to_string(i)));
+        auto tac = std::make_shared<DummyTactic>("tactic_" + std::to_string(i));
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = root;
+        effect->tac = tac;
+        effect->children = {child};
+        effects.push_back(effect);
+        tactics.push_back(tac);
+        childrenForTactic.push_back({child});
+    }
+    std::vector<double> priors(3, 1.0 / 3);
+    std::vector<size_t> envDurations(3, 1);
+    htps::env_expansion expansion(root, 1, 1, envDurations, effects, -0.5, tactics, childrenForTactic, priors);
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions = {std::make_shared<htps::env_expansion>(expansion)};
+    htps_instance->expand_and_backup(expansions);
+
+    auto first = htps_instance->theorems_to_expand();
+    ASSERT_FALSE(first.empty());
+    // Only return the first theorem, the remaining ones stay outstanding
+    expansions = {solving_expansion(first[0])};
+    htps_instance->expand_and_backup(expansions);
+    EXPECT_EQ(htps_instance->is_expanding(), first.size() > 1);
+
+    std::vector<TheoremPointer> second;
+    EXPECT_NO_THROW(second = htps_instance->theorems_to_expand());
+    for (const auto &thm: second) {
+        // Theorems still in flight are not handed out twice
+        EXPECT_TRUE(std::find(first.begin(), first.end(), thm) == first.end());
+    }
+
+    expansions.clear();
+    for (size_t i = 1; i < first.size(); i++)
+        expansions.push_back(solving_expansion(first[i]));
+    for (const auto &thm: second)
+        expansions.push_back(solving_expansion(thm));
+    htps_instance->expand_and_backup(expansions);
+    EXPECT_TRUE(htps_instance->is_proven());
+    EXPECT_FALSE(htps_instance->is_expanding());
+    htps_instance->get_result();
+}
+
+TEST_F(HTPSTest, TestAsyncDiscardExpansions) {
+    dummyParams.async_expansions = true;
+    htps_instance->set_params(dummyParams);
+    auto theorems = htps_instance->theorems_to_expand();
+    ASSERT_EQ(theorems.size(), 1);
+    EXPECT_TRUE(htps_instance->is_expanding());
+    // Outstanding expansions are dropped when collecting the result
+    htps_instance->get_result();
+    EXPECT_FALSE(htps_instance->is_expanding());
+    auto effect = std::make_shared<htps::env_effect>();
+    effect->goal = root;
+    effect->tac = dummyTac;
+    effect->children = {};
+    std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+    std::vector<std::shared_ptr<htps::tactic>> tactics = {dummyTac};
+    std::vector<std::vector<htps::TheoremPointer>> childrenForTactic = {{}};
+    std::vector<double> priors = {1.0};
+    std::vector<size_t> envDurations = {1};
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions = {
+            std::make_shared<htps::env_expansion>(root, 1, 1, envDurations, effects, 0.0, tactics, childrenForTactic,
+                                                  priors)};
+    EXPECT_THROW(htps_instance->expand_and_backup(expansions), std::runtime_error);
+}
+
+/* Two searches share the root A, a third one searches C with a higher priority.
+ * With a batch size of one, C is asked first, the searches for A follow in round-robin order.
+ * */
+TEST_F(HTPSTest, TestScheduler) {
+    auto solving_expansion = [this](const TheoremPointer &thm) {
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = dummyTac;
+        effect->children = {};
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {dummyTac};
+        std::vector<std::vector<htps::TheoremPointer>> childrenForTactic = {{}};
+        std::vector<double> priors = {1.0};
+        std::vector<size_t> envDurations = {1};
+        TheoremPointer goal = thm;
+        return std::make_shared<htps::env_expansion>(goal, 1, 1, envDurations, effects, 0.0, tactics,
+                                                     childrenForTactic, priors);
+    };
+    dummyParams.early_stopping = true;
+    HTPSScheduler scheduler(1);
+    TheoremPointer other_root = std::make_shared<DummyTheorem>("A");
+    TheoremPointer prioritized_root = std::make_shared<DummyTheorem>("C");
+    size_t first = scheduler.add_search(root, dummyParams);
+    size_t second = scheduler.add_search(other_root, dummyParams);
+    size_t prioritized = scheduler.add_search(prioritized_root, dummyParams, 1);
+    EXPECT_EQ(scheduler.num_searches(), 3);
+
+    auto theorems = scheduler.theorems_to_expand();
+    ASSERT_EQ(theorems.size(), 1);
+    EXPECT_EQ(theorems[0]->unique_string, "C");
+    // Both searches for A ask for the root, it is handed out once
+    theorems = scheduler.theorems_to_expand();
+    ASSERT_EQ(theorems.size(), 1);
+    EXPECT_EQ(theorems[0]->unique_string, "A");
+    EXPECT_TRUE(scheduler.theorems_to_expand().empty());
+    EXPECT_TRUE(scheduler.is_expanding());
+
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions = {solving_expansion(theorems[0])};
+    scheduler.expand_and_backup(expansions);
+    EXPECT_THROW(scheduler.expand_and_backup(expansions), std::runtime_error);
+    auto results = scheduler.take_results();
+    ASSERT_EQ(results.size(), 2);
+    EXPECT_EQ(results[0].first, first);
+    EXPECT_EQ(results[1].first, second);
+    for (const auto &[id, result]: results) {
+        EXPECT_TRUE(result.get_proof().has_value());
+        EXPECT_EQ(result.get_goal()->unique_string, "A");
+    }
+    EXPECT_EQ(scheduler.num_searches(), 1);
+    EXPECT_FALSE(scheduler.is_done());
+
+    expansions = {solving_expansion(prioritized_root)};
+    scheduler.expand_and_backup(expansions);
+    results = scheduler.take_results();
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].first, prioritized);
+    EXPECT_TRUE(scheduler.is_done());
+    EXPECT_FALSE(scheduler.is_expanding());
+}
+
+/* A tactic closing a circle is killed during the descent, and the tactic is chosen again at the same node.
+ * The root leads to B only, where the circle tactic back to the root has the larger prior. All descents end up at D.
+ * */
+TEST_F(HTPSTest, TestCircleReselectsAtNode) {
+    htps_instance->set_params(dummyParams);
+    htps_instance->theorems_to_expand();
+    TheoremPointer child = std::make_shared<DummyTheorem>("B");
+    TheoremPointer grandchild = std::make_shared<DummyTheorem>("D");
+
+    auto effect = std::make_shared<htps::env_effect>();
+    effect->goal = root;
+    effect->tac = dummyTac;
+    effect->children = {child};
+    std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+    std::vector<std::shared_ptr<htps::tactic>> tactics = {dummyTac};
+    std::vector<std::vector<htps::TheoremPointer>> childrenForTactic = {{child}};
+    std::vector<double> priors = {1.0};
+    std::vector<size_t> envDurations = {1};
+    std::vector<std::shared_ptr<htps::env_expansion>> expansions = {
+            std::make_shared<htps::env_expansion>(root, 1, 1, envDurations, effects, -0.5, tactics, childrenForTactic,
+                                                  priors)};
+    htps_instance->expand_and_backup(expansions);
+    auto theorems = htps_instance->theorems_to_expand();
+    ASSERT_EQ(theorems.size(), 1);
+    EXPECT_EQ(theorems[0], child);
+
+    auto circle = std::make_shared<htps::env_effect>();
+    circle->goal = child;
+    circle->tac = dummyTac2;
+    circle->children = {root};
+    auto progress = std::make_shared<htps::env_effect>();
+    progress->goal = child;
+    progress->tac = dummyTac3;
+    progress->children = {grandchild};
+    effects = {circle, progress};
+    tactics = {dummyTac2, dummyTac3};
+    childrenForTactic = {{root}, {grandchild}};
+    priors = {0.9, 0.1};
+    envDurations = {1, 1};
+    expansions = {std::make_shared<htps::env_expansion>(child, 1, 1, envDurations, effects, -0.5, tactics,
+                                                        childrenForTactic, priors)};
+    htps_instance->expand_and_backup(expansions);
+
+    theorems = htps_instance->theorems_to_expand();
+    ASSERT_EQ(theorems.size(), 1);
+    EXPECT_EQ(theorems[0], grandchild);
+    EXPECT_FALSE(htps_instance->dead_root());
+
+    effect = std::make_shared<htps::env_effect>();
+    effect->goal = grandchild;
+    effect->tac = dummyTac;
+    effect->children = {};
+    effects = {effect};
+    tactics = {dummyTac};
+    childrenForTactic = {{}};
+    priors = {1.0};
+    envDurations = {1};
+    expansions = {std::make_shared<htps::env_expansion>(grandchild, 1, 1, envDurations, effects, 0.0, tactics,
+                                                        childrenForTactic, priors)};
+    htps_instance->expand_and_backup(expansions);
+    EXPECT_TRUE(htps_instance->is_proven());
+}
+
+/* After moving the root to B, only B and its descendants remain. The subgoal D of B is solved, so the moved search
+ * is proven right away and the result is relative to B.
+ * A -> {B, C} | {E}, B -> {D}, C and D are solved, all other goals X -> {X'}
+ * */
+TEST_F(HTPSTest, TestMoveRoot) {
+    dummyParams.succ_expansions = 4;
+    dummyParams.virtual_loss = 1;
+    htps_instance->set_params(dummyParams);
+    std::map<std::string, std::vector<std::vector<std::string>>> children_of = {
+            {"A", {{"B", "C"}, {"E"}}},
+            {"B", {{"D"}}},
+            {"C", {{}}},
+            {"D", {{}}},
+    };
+    auto expand = [&](const TheoremPointer &thm) {
+        std::vector<std::shared_ptr<htps::env_effect>> effects;
+        std::vector<std::shared_ptr<htps::tactic>> tactics;
+        std::vector<std::vector<htps::TheoremPointer>> childrenForTactic;
+        std::vector<std::vector<std::string>> tactic_children = {{thm->unique_string + "'"}};
+        if (children_of.contains(thm->unique_string))
+            tactic_children = children_of.at(thm->unique_string);
+        for (size_t i = 0; i < tactic_children.size(); i++) {
+            auto tac = std::make_shared<DummyTactic>(thm->unique_string + "_tactic_" + std::to_string(i));
+            std::vector<TheoremPointer> children;
+            for (const auto &name: tactic_children[i])
+                children.push_back(std::make_shared<DummyTheorem>(name));
+            auto effect = std::make_shared<htps::env_effect>();
+            effect->goal = thm;
+            effect->tac = tac;
+            effect->children = children;
+            effects.push_back(effect);
+            tactics.push_back(tac);
+            childrenForTactic.push_back(children);
+        }
+        std::vector<double> priors(tactics.size(), 1.0 / static_cast<double>(tactics.size()));
+        std::vector<size_t> envDurations(tactics.size(), 1);
+        TheoremPointer goal = thm;
+        return std::make_shared<htps::env_expansion>(goal, 1, 1, envDurations, effects, -0.5, tactics,
+                                                     childrenForTactic, priors);
+    };
+    std::set<std::string> expanded;
+    for (size_t round = 0; round < 20 && !expanded.contains("D"); round++) {
+        auto theorems = htps_instance->theorems_to_expand();
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+        for (const auto &thm: theorems) {
+            expansions.push_back(expand(thm));
+            expanded.insert(thm->unique_string);
+        }
+        htps_instance->expand_and_backup(expansions);
+    }
+    ASSERT_TRUE(expanded.contains("D"));
+    ASSERT_TRUE(expanded.contains("B"));
+
+    TheoremPointer unknown = std::make_shared<DummyTheorem>("unknown");
+    EXPECT_THROW(htps_instance->move_root(unknown), std::invalid_argument);
+
+    TheoremPointer new_root = std::make_shared<DummyTheorem>("B");
+    htps_instance->move_root(new_root);
+    EXPECT_EQ(htps_instance->num_expansions(), 2);
+    EXPECT_TRUE(htps_instance->is_proven());
+    auto result = htps_instance->get_result();
+    EXPECT_EQ(result.get_goal()->unique_string, "B");
+    ASSERT_TRUE(result.get_proof().has_value());
+    EXPECT_EQ(result.get_proof()->proof_theorem->unique_string, "B");
+    for (const auto &sample: result.get_critic_samples()) {
+        EXPECT_TRUE(sample.get_goal()->unique_string == "B" || sample.get_goal()->unique_string == "D");
+    }
+}
+
+/* Circle kills are relative to the path from the old root. From A, the only tactic of N leads back to C and is killed,
+ * which kills N and the tactic of C leading there. After moving the root to N, there is no circle anymore, so N and
+ * the subtree of C are alive again.
+ * A -> {C}, C -> {N} | {Y}, N -> {C}, all other goals X -> {X'}
+ * */
+TEST_F(HTPSTest, TestMoveRootRevivesCircleKills) {
+    dummyParams.succ_expansions = 1;
+    htps_instance->set_params(dummyParams);
+    std::map<std::string, std::vector<std::vector<std::string>>> children_of = {
+            {"A", {{"C"}}},
+            {"C", {{"N"}, {"Y"}}},
+            {"N", {{"C"}}},
+    };
+    auto expand = [&](const TheoremPointer &thm) {
+        std::vector<std::shared_ptr<htps::env_effect>> effects;
+        std::vector<std::shared_ptr<htps::tactic>> tactics;
+        std::vector<std::vector<htps::TheoremPointer>> childrenForTactic;
+        std::vector<std::vector<std::string>> tactic_children = {{thm->unique_string + "'"}};
+        if (children_of.contains(thm->unique_string))
+            tactic_children = children_of.at(thm->unique_string);
+        for (size_t i = 0; i < tactic_children.size(); i++) {
+            auto tac = std::make_shared<DummyTactic>(thm->unique_string + "_tactic_" + std::to_string(i));
+            std::vector<TheoremPointer> children;
+            for (const auto &name: tactic_children[i])
+                children.push_back(std::make_shared<DummyTheorem>(name));
+            auto effect = std::make_shared<htps::env_effect>();
+            effect->goal = thm;
+            effect->tac = tac;
+            effect->children = children;
+            effects.push_back(effect);
+            tactics.push_back(tac);
+            childrenForTactic.push_back(children);
+        }
+        std::vector<double> priors(tactics.size(), 1.0 / static_cast<double>(tactics.size()));
+        std::vector<size_t> envDurations(tactics.size(), 1);
+        TheoremPointer goal = thm;
+        return std::make_shared<htps::env_expansion>(goal, 1, 1, envDurations, effects, -0.5, tactics,
+                                                     childrenForTactic, priors);
+    };
+    auto node_json = [&](const std::string &thm) {
+        auto j = static_cast<nlohmann::json>(*htps_instance);
+        for (const auto &node: j["nodes"]) {
+            if (node["theorem"]["unique_string"] == thm)
+                return node;
+        }
+        return nlohmann::json();
+    };
+    auto killed = [&](const std::string &thm, size_t tactic_id) {
+        return node_json(thm)["killed_tactics"].get<std::set<size_t>>().contains(tactic_id);
+    };
+    std::set<std::string> expanded;
+    for (size_t round = 0; round < 20 && !(expanded.contains("N") && killed("N", 0)); round++) {
+        auto theorems = htps_instance->theorems_to_expand();
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+        for (const auto &thm: theorems) {
+            expansions.push_back(expand(thm));
+            expanded.insert(thm->unique_string);
+        }
+        htps_instance->expand_and_backup(expansions);
+    }
+    ASSERT_TRUE(killed("N", 0));
+    ASSERT_TRUE(killed("C", 0));
+    EXPECT_FALSE(htps_instance->dead_root());
+
+    TheoremPointer new_root = std::make_shared<DummyTheorem>("N");
+    htps_instance->move_root(new_root);
+    EXPECT_FALSE(htps_instance->dead_root());
+    EXPECT_FALSE(killed("N", 0));
+    EXPECT_FALSE(killed("C", 0));
+    EXPECT_FALSE(node_json("C").is_null());
+    EXPECT_TRUE(node_json("A").is_null());
+    EXPECT_TRUE(node_json("N")["circle_killed_tactics"].empty());
+
+    // From N, the tactic of C leading back to N closes a circle now
+    for (size_t round = 0; round < 5 && !htps_instance->is_done(); round++) {
+        auto theorems = htps_instance->theorems_to_expand();
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+        for (const auto &thm: theorems)
+            expansions.push_back(expand(thm));
+        htps_instance->expand_and_backup(expansions);
+    }
+    EXPECT_FALSE(killed("N", 0));
+    EXPECT_FALSE(htps_instance->dead_root());
+}
+
+TEST_F(HTPSTest, TestBatchedNodeUpdate) {
+    TheoremPointer child = std::make_shared<DummyTheorem>("B");
+    std::vector<std::shared_ptr<tactic>> tactics = {dummyTac, dummyTac2};
+    std::vector<std::vector<TheoremPointer>> children = {{child}, {child}};
+    HTPSNode sequential(root, tactics, children, dummyPolicy, {0.5, 0.5}, 0.2, -0.5, QValueSolved::One, 0.0, {});
+    HTPSNode batched(sequential);
+
+    // The first batch overrides the reset value, the second one is combined with the stored value
+    std::vector<std::vector<double>> batches = {{-0.1, -2.0, -0.7}, {-30.0, -0.01}};
+    for (const auto &batch: batches) {
+        for (double value: batch) {
+            sequential.update(0, value);
+        }
+        batched.update_batch(0, batch);
+    }
+    batched.update_batch(1, {});
+    auto j_sequential = static_cast<nlohmann::json>(sequential);
+    auto j_batched = static_cast<nlohmann::json>(batched);
+    EXPECT_EQ(j_sequential["counts"], j_batched["counts"]);
+    EXPECT_EQ(j_batched["counts"][0], 5);
+    EXPECT_EQ(j_batched["counts"][1], 0);
+    // Both round to stat_t only once per update, so single precision statistics differ by a few float ulps
+    double tolerance = std::is_same_v<htps::stat_t, double> ? 1e-12 : 1e-5;
+    EXPECT_NEAR(j_sequential["log_w"][0].get<double>(), j_batched["log_w"][0].get<double>(), tolerance);
+    EXPECT_EQ(j_sequential["reset_mask"], j_batched["reset_mask"]);
+}
+
+TEST_F(HTPSTest, TestLogSpaceUpdate) {
+    EXPECT_DOUBLE_EQ(htps::log_add_exp(1000.0, 1000.0), 1000.0 + std::log(2.0));
+    EXPECT_DOUBLE_EQ(htps::log_add_exp(-0.5, htps::MIN_FLOAT), -0.5);
+    EXPECT_EQ(htps::log_add_exp(htps::MIN_FLOAT, htps::MIN_FLOAT), htps::MIN_FLOAT);
+
+    TheoremPointer child = std::make_shared<DummyTheorem>("B");
+    std::vector<std::shared_ptr<tactic>> tactics = {dummyTac, dummyTac2};
+    std::vector<std::vector<TheoremPointer>> children = {{child}, {child}};
+    HTPSNode node(root, tactics, children, dummyPolicy, {0.5, 0.5}, 0.2, -0.5, QValueSolved::One, 0.0, {});
+    // A dead first backup must not turn later ones into NaN, and large gaps must not overflow
+    node.update(0, htps::MIN_FLOAT);
+    node.update(0, -0.5);
+    node.update(1, -800.0);
+    node.update(1, -1.0);
+    auto j = static_cast<nlohmann::json>(node);
+    EXPECT_NEAR(j["log_w"][0].get<double>(), -0.5, 1e-6);
+    EXPECT_NEAR(j["log_w"][1].get<double>(), -1.0, 1e-6);
+    EXPECT_FALSE(std::isnan(node.get_value()));
+}
+
+TEST_F(HTPSTest, TestTemperatureSampling) {
+    std::vector<double> policy = {0.5, 0.3, 0.2, 0.0, htps::MIN_FLOAT};
+    htps::Rng rng(0);
+    const size_t samples = 100000;
+    for (double temperature: {0.5, 1.0, 2.0}) {
+        std::vector<double> expected(policy.size(), 0.0);
+        double sum = 0;
+        for (size_t i = 0; i < 3; i++) {
+            expected[i] = std::pow(policy[i], 1 / temperature);
+            sum += expected[i];
+        }
+        std::vector<size_t> frequencies(policy.size(), 0);
+        std::vector<double> weights;
+        for (size_t k = 0; k < samples; k++) {
+            weights = policy;
+            frequencies[htps::sample_tactic(weights, temperature, rng)]++;
+        }
+        for (size_t i = 0; i < policy.size(); i++) {
+            EXPECT_NEAR(static_cast<double>(frequencies[i]) / samples, expected[i] / sum, 0.01)
+                                << "tactic " << i << ", temperature " << temperature;
+        }
+    }
+    // Weights of 1e-200^100 underflow, the most likely tactic remains
+    std::vector<double> tiny = {1e-200, 3e-200, 2e-200};
+    EXPECT_EQ(htps::sample_tactic(tiny, 0.01, rng), 1);
+    std::vector<double> single = {1.0};
+    EXPECT_EQ(htps::sample_tactic(single, 1.0, rng), 0);
+}
+
+TEST_F(HTPSTest, TestExpansionCache) {
+    auto solving_expansion = [](const TheoremPointer &thm, const std::vector<std::string> &children_names) {
+        auto tac = std::make_shared<DummyTactic>(thm->unique_string + "_tactic");
+        std::vector<TheoremPointer> children;
+        for (const auto &name: children_names)
+            children.push_back(std::make_shared<DummyTheorem>(name));
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = tac;
+        effect->children = children;
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {tac};
+        std::vector<std::vector<TheoremPointer>> childrenForTactic = {children};
+        std::vector<double> priors = {1.0};
+        std::vector<size_t> envDurations = {1};
+        TheoremPointer goal = thm;
+        return std::make_shared<htps::env_expansion>(goal, 1, 1, envDurations, effects, -0.5, tactics,
+                                                     childrenForTactic, priors);
+    };
+    auto path = (std::filesystem::temp_directory_path() / "htps_expansion_cache_test.bin").string();
+    std::filesystem::remove(path);
+
+    {
+        auto cache = std::make_shared<ExpansionCache>(path, 8);
+        htps_instance->set_expansion_cache(cache);
+        auto theorems = htps_instance->theorems_to_expand();
+        ASSERT_EQ(theorems.size(), 1);
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions = {solving_expansion(theorems[0], {"B"})};
+        htps_instance->expand_and_backup(expansions);
+        theorems = htps_instance->theorems_to_expand();
+        ASSERT_EQ(theorems.size(), 1);
+        EXPECT_EQ(theorems[0]->unique_string, "B");
+        expansions = {solving_expansion(theorems[0], {})};
+        htps_instance->expand_and_backup(expansions);
+        EXPECT_TRUE(htps_instance->is_proven());
+        EXPECT_EQ(cache->size(), 2);
+        EXPECT_EQ(cache->get_hits(), 0);
+    }
+
+    // A second search on the same goal is answered from the file without involving the caller
+    auto cache = std::make_shared<ExpansionCache>(path, 8);
+    EXPECT_EQ(cache->size(), 2);
+    HTPS search(root, dummyParams, dummyPolicy);
+    search.set_expansion_cache(cache);
+    auto theorems = search.theorems_to_expand();
+    EXPECT_TRUE(theorems.empty());
+    EXPECT_TRUE(search.is_done());
+    EXPECT_TRUE(search.is_proven());
+    EXPECT_EQ(cache->get_hits(), 2);
+    EXPECT_EQ(search.num_expansions(), 2);
+    auto result = search.get_result();
+    ASSERT_TRUE(result.get_proof().has_value());
+
+    // Evictions are least recently used first, compaction keeps that order
+    TheoremPointer other = std::make_shared<DummyTheorem>("C");
+    cache->compact();
+    auto small_cache = std::make_shared<ExpansionCache>(path, 1);
+    EXPECT_EQ(small_cache->size(), 1);
+    EXPECT_EQ(small_cache->lookup(root), nullptr);
+    TheoremPointer b = std::make_shared<DummyTheorem>("B");
+    auto hit = small_cache->lookup(b);
+    ASSERT_NE(hit, nullptr);
+    EXPECT_EQ(hit->thm, b);
+    small_cache->insert(solving_expansion(other, {}));
+    EXPECT_EQ(small_cache->lookup(b), nullptr);
+    EXPECT_NE(small_cache->lookup(other), nullptr);
+    EXPECT_EQ(small_cache->get_hits(), 2);
+    EXPECT_EQ(small_cache->get_misses(), 2);
+    std::filesystem::remove(path);
+}
+
+// Records of evicted goals are compacted away automatically, so the file does not grow with the number of insertions
+TEST_F(HTPSTest, TestExpansionCacheFileBounded) {
+    auto path = (std::filesystem::temp_directory_path() / "htps_expansion_cache_bounded_test.bin").string();
+    std::filesystem::remove(path);
+    constexpr size_t capacity = 4;
+    auto expansion_of = [](size_t i) {
+        char name[8];
+        std::snprintf(name, sizeof(name), "G%03zu", i);
+        TheoremPointer thm = std::make_shared<DummyTheorem>(name);
+        auto tac = std::make_shared<DummyTactic>("tactic");
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = tac;
+        effect->children = {};
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {tac};
+        std::vector<std::vector<TheoremPointer>> childrenForTactic = {{}};
+        std::vector<double> priors = {1.0};
+        std::vector<size_t> envDurations = {1};
+        return std::make_shared<htps::env_expansion>(thm, 1, 1, envDurations, effects, -0.5, tactics,
+                                                     childrenForTactic, priors);
+    };
+    size_t largest = 0;
+    {
+        ExpansionCache cache(path, capacity);
+        for (size_t i = 0; i < 100; i++) {
+            cache.insert(expansion_of(i));
+            largest = std::max(largest, static_cast<size_t>(std::filesystem::file_size(path)));
+        }
+        EXPECT_EQ(cache.size(), capacity);
+        cache.compact();
+    }
+    // All records have the same size, at most twice as many as there are live goals are kept
+    auto compacted = static_cast<size_t>(std::filesystem::file_size(path));
+    EXPECT_LE(largest, 2 * compacted);
+
+    ExpansionCache reopened(path, capacity);
+    EXPECT_EQ(reopened.size(), capacity);
+    EXPECT_NE(reopened.lookup(expansion_of(99)->thm), nullptr);
+    EXPECT_EQ(reopened.lookup(expansion_of(95)->thm), nullptr);
+    std::filesystem::remove(path);
+}
+
+TEST_F(HTPSTest, TestTimeBudget) {
+    using namespace std::chrono_literals;
+    TimeBudget budget(1000);
+    auto start = TimeBudget::Clock::now();
+    // Without observations, the full batch is used
+    EXPECT_EQ(budget.batch_size(32, start), 32);
+    EXPECT_EQ(budget.expected_batch_ms(32), 0.0);
+    budget.record_batch(32, 32, start);
+    std::vector<size_t> env_durations = {50, 50};
+    std::string error;
+    std::vector<std::shared_ptr<env_expansion>> expansions;
+    for (size_t i = 0; i < 32; i++) {
+        TheoremPointer thm = std::make_shared<DummyTheorem>("T" + std::to_string(i));
+        auto expansion = std::make_shared<env_expansion>(thm, 150, 100, env_durations, error);
+        expansions.push_back(expansion);
+    }
+    budget.record_expansions(expansions);
+    // 32 expansions of 200ms each came back after 320ms, i.e. 10ms per descent
+    budget.end_round(start + 320ms);
+    EXPECT_NEAR(budget.expected_batch_ms(1), 10.0, 1e-9);
+    EXPECT_EQ(budget.batch_size(32, start + 500ms), 32);
+    EXPECT_EQ(budget.batch_size(32, start + 900ms), 10);
+    EXPECT_EQ(budget.batch_size(32, start + 995ms), 0);
+    EXPECT_FALSE(budget.expired(start + 995ms));
+    EXPECT_TRUE(budget.expired(start + 1000ms));
+    EXPECT_EQ(budget.batch_size(32, start + 1000ms), 0);
+    EXPECT_THROW(TimeBudget(0), std::invalid_argument);
+}
+
+TEST_F(HTPSTest, TestTimeBudgetStopsSearch) {
+    dummyParams.time_budget_ms = 50;
+    htps_instance->set_params(dummyParams);
+    auto expand = [&](const TheoremPointer &thm) {
+        auto tac = std::make_shared<DummyTactic>(thm->unique_string + "_tactic");
+        std::vector<TheoremPointer> children = {std::make_shared<DummyTheorem>(thm->unique_string + "'")};
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = tac;
+        effect->children = children;
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {tac};
+        std::vector<std::vector<TheoremPointer>> childrenForTactic = {children};
+        std::vector<double> priors = {1.0};
+        std::vector<size_t> envDurations = {10};
+        TheoremPointer goal = thm;
+        return std::make_shared<htps::env_expansion>(goal, 20, 10, envDurations, effects, -0.5, tactics,
+                                                     childrenForTactic, priors);
+    };
+    size_t rounds = 0;
+    while (!htps_instance->is_done() && rounds < 1000) {
+        auto theorems = htps_instance->theorems_to_expand();
+        if (theorems.empty())
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions;
+        for (const auto &thm: theorems)
+            expansions.push_back(expand(thm));
+        htps_instance->expand_and_backup(expansions);
+        rounds++;
+    }
+    // Each round takes at least 20ms, so no fourth round starts before the deadline
+    EXPECT_TRUE(htps_instance->is_done());
+    EXPECT_LE(rounds, 3);
+    EXPECT_GE(rounds, 1);
+    EXPECT_FALSE(htps_instance->is_proven());
+}
+
+TEST_F(HTPSTest, TestProgressiveWidening) {
+    std::vector<std::shared_ptr<tactic>> tactics;
+    std::vector<std::vector<TheoremPointer>> children;
+    for (size_t i = 0; i < 4; i++) {
+        tactics.push_back(std::make_shared<DummyTactic>("tactic_" + std::to_string(i)));
+        children.push_back({std::make_shared<DummyTheorem>("child_" + std::to_string(i))});
+    }
+    HTPSNode node(root, tactics, children, dummyPolicy, {0.1, 0.4, 0.2, 0.3}, 0.2, -0.5, QValueSolved::One, 0.0, {});
+    auto admitted = [&node]() {
+        std::set<size_t> result;
+        auto policy = node.compute_policy();
+        for (size_t i = 0; i < policy.size(); i++) {
+            if (policy[i] > 0)
+                result.insert(i);
+        }
+        return result;
+    };
+    EXPECT_EQ(admitted().size(), 4);
+
+    node.set_widening(1.0, 0.5);
+    EXPECT_EQ(node.active_tactic_count(), 1);
+    EXPECT_EQ(admitted(), std::set<size_t>({1}));
+    EXPECT_NEAR(node.compute_policy()[1], 1.0, 1e-9);
+    // ceil(sqrt(3 + 1)) = 2 tactics after three visits
+    for (size_t i = 0; i < 3; i++)
+        node.update(1, -0.1);
+    EXPECT_EQ(node.active_tactic_count(), 2);
+    EXPECT_EQ(admitted(), std::set<size_t>({1, 3}));
+    // Killed tactics give up their slot
+    node.kill_tactic(1);
+    EXPECT_EQ(admitted(), std::set<size_t>({2, 3}));
+    // Virtual counts widen the node as well, so that a batch of descents spreads out
+    node.add_virtual_count(3, 12);
+    EXPECT_EQ(node.active_tactic_count(), 4);
+    EXPECT_EQ(admitted(), std::set<size_t>({0, 2, 3}));
+}
+
+TEST_F(HTPSTest, TestPolicyKernels) {
+    const PolicyKernels *scalar = policy_kernels(InstructionSet::Scalar);
+    ASSERT_NE(scalar, nullptr);
+    EXPECT_NE(policy_kernels(InstructionSet::AVX512) == nullptr && policy_kernels(InstructionSet::AVX2) == nullptr,
+              policy_kernels().instruction_set != InstructionSet::Scalar);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for (auto instruction_set: {InstructionSet::AVX2, InstructionSet::AVX512}) {
+        const PolicyKernels *kernels = policy_kernels(instruction_set);
+        if (!kernels)
+            continue;
+        // Sizes that are not a multiple of the vector width exercise the tails
+        for (size_t n = 0; n < 37; n++) {
+            std::vector<double> q(n), pi(n), expected(n), actual(n);
+            std::vector<size_t> counts(n);
+            for (size_t i = 0; i < n; i++) {
+                q[i] = i % 5 == 3 ? MIN_FLOAT : uniform(rng);
+                pi[i] = i % 7 == 2 ? MIN_FLOAT : (uniform(rng) + 1) / 2;
+                counts[i] = rng() % 1000;
+            }
+            double expected_sum, actual_sum;
+            EXPECT_EQ(scalar->alpha_zero_scores(q.data(), pi.data(), counts.data(), n, 0.7, 3.0, expected.data(),
+                                                expected_sum),
+                      kernels->alpha_zero_scores(q.data(), pi.data(), counts.data(), n, 0.7, 3.0, actual.data(),
+                                                 actual_sum));
+            EXPECT_NEAR(expected_sum, actual_sum, 1e-12);
+            // Scores are computed with the same operations, only sums may differ in the last bits
+            EXPECT_EQ(expected, actual);
+            if (n > 0) {
+                scalar->normalize(expected.data(), n, expected_sum);
+                kernels->normalize(actual.data(), n, expected_sum);
+                EXPECT_EQ(expected, actual);
+            }
+
+            EXPECT_EQ(scalar->masked_copy(q.data(), n, expected.data(), expected_sum),
+                      kernels->masked_copy(q.data(), n, actual.data(), actual_sum));
+            EXPECT_NEAR(expected_sum, actual_sum, 1e-12);
+            EXPECT_EQ(expected, actual);
+
+            // Scaled priors of the RPO policy are never invalid
+            std::vector<double> scaled_pi(n);
+            for (size_t i = 0; i < n; i++)
+                scaled_pi[i] = (uniform(rng) + 1) / 2;
+            bool expected_zero, actual_zero;
+            double expected_derivative, actual_derivative;
+            EXPECT_NEAR(scalar->rpo_difference_sum(q.data(), scaled_pi.data(), n, 2.0, expected_derivative,
+                                                   expected_zero),
+                        kernels->rpo_difference_sum(q.data(), scaled_pi.data(), n, 2.0, actual_derivative,
+                                                    actual_zero), 1e-12);
+            EXPECT_NEAR(expected_derivative, actual_derivative, 1e-12);
+            EXPECT_FALSE(actual_zero);
+            EXPECT_NEAR(scalar->rpo_weights(q.data(), scaled_pi.data(), n, 2.0, 1e-10, expected.data()),
+                        kernels->rpo_weights(q.data(), scaled_pi.data(), n, 2.0, 1e-10, actual.data()), 1e-12);
+            EXPECT_EQ(expected, actual);
+            if (n > 0) {
+                kernels->rpo_difference_sum(q.data(), scaled_pi.data(), n, q[n - 1] == MIN_FLOAT ? 2.0 : q[n - 1],
+                                            actual_derivative, actual_zero);
+                EXPECT_EQ(actual_zero, q[n - 1] != MIN_FLOAT);
+            }
+        }
+    }
+}
+
+TEST_F(HTPSTest, TestAVX512KernelTails) {
+    const PolicyKernels *kernels = policy_kernels(InstructionSet::AVX512);
+    if (!kernels)
+        GTEST_SKIP() << "CPU does not support avx512f";
+    const PolicyKernels *scalar = policy_kernels(InstructionSet::Scalar);
+    constexpr double SENTINEL = 12345.0;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    // Every tail length of one and two vectors, the masked lanes beyond n must neither be read into sums nor written
+    for (size_t n = 1; n <= 16; n++) {
+        std::vector<double> q(n), pi(n), scaled_pi(n);
+        std::vector<size_t> counts(n);
+        for (size_t i = 0; i < n; i++) {
+            // All entries of the last partial vector are invalid for odd n
+            q[i] = n % 2 == 1 && i >= n / 8 * 8 ? MIN_FLOAT : uniform(rng);
+            pi[i] = (uniform(rng) + 1) / 2;
+            scaled_pi[i] = (uniform(rng) + 1) / 2;
+            counts[i] = rng() % 1000;
+        }
+        std::vector<double> expected(n + 8, SENTINEL), actual(n + 8, SENTINEL);
+        double expected_sum, actual_sum;
+        EXPECT_EQ(scalar->alpha_zero_scores(q.data(), pi.data(), counts.data(), n, 0.7, 3.0, expected.data(),
+                                            expected_sum),
+                  kernels->alpha_zero_scores(q.data(), pi.data(), counts.data(), n, 0.7, 3.0, actual.data(),
+                                             actual_sum));
+        EXPECT_NEAR(expected_sum, actual_sum, 1e-12);
+        EXPECT_EQ(expected, actual);
+        kernels->normalize(actual.data(), n, 2.0);
+        scalar->normalize(expected.data(), n, 2.0);
+        EXPECT_EQ(expected, actual);
+
+        EXPECT_EQ(scalar->masked_copy(q.data(), n, expected.data(), expected_sum),
+                  kernels->masked_copy(q.data(), n, actual.data(), actual_sum));
+        EXPECT_NEAR(expected_sum, actual_sum, 1e-12);
+        EXPECT_EQ(expected, actual);
+
+        bool zero;
+        double expected_derivative, actual_derivative;
+        EXPECT_NEAR(scalar->rpo_difference_sum(q.data(), scaled_pi.data(), n, 2.0, expected_derivative, zero),
+                    kernels->rpo_difference_sum(q.data(), scaled_pi.data(), n, 2.0, actual_derivative, zero), 1e-12);
+        EXPECT_NEAR(expected_derivative, actual_derivative, 1e-12);
+        EXPECT_NEAR(scalar->rpo_weights(q.data(), scaled_pi.data(), n, 2.0, 1e-10, expected.data()),
+                    kernels->rpo_weights(q.data(), scaled_pi.data(), n, 2.0, 1e-10, actual.data()), 1e-12);
+        EXPECT_EQ(expected, actual);
+        for (size_t i = n; i < n + 8; i++)
+            EXPECT_EQ(actual[i], SENTINEL);
+    }
+}
+
+// Exposes the RPO solver, to count the passes over the tactics it needs
+class RPOSolverPolicy : public Policy {
+public:
+    RPOSolverPolicy() : Policy(PolicyType::RPO, 0.5) {}
+
+    std::optional<size_t> iterations(const std::vector<double> &q_values, const std::vector<double> &pi_values,
+                                      const std::vector<size_t> &counts) const {
+        std::vector<double> result(q_values.size());
+        if (trivial_policy(q_values, result))
+            return 0;
+        RPOSolver solver{};
+        if (!prepare_rpo(q_values, pi_values, counts, result, solver))
+            return 0;
+        while (solver.status == RPOSolver::Running)
+            rpo_step(solver);
+        if (solver.status == RPOSolver::Failed)
+            return std::nullopt;
+        return solver.iterations;
+    }
+};
+
+TEST_F(HTPSTest, TestRPOSolver) {
+    RPOSolverPolicy policy;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<std::vector<double>> q_values, pi_values;
+    std::vector<std::vector<size_t>> counts;
+    for (size_t node = 0; node < 64; node++) {
+        size_t n = 2 + rng() % 100;
+        std::vector<double> q(n), pi(n);
+        std::vector<size_t> c(n);
+        double pi_sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            q[i] = i % 9 == 4 ? MIN_FLOAT : uniform(rng);
+            pi[i] = uniform(rng);
+            pi_sum += pi[i];
+            c[i] = rng() % 20;
+        }
+        for (auto &p: pi)
+            p /= pi_sum;
+        q_values.push_back(q);
+        pi_values.push_back(pi);
+        counts.push_back(c);
+    }
+    std::vector<PolicyInput> inputs;
+    for (size_t node = 0; node < q_values.size(); node++)
+        inputs.push_back({q_values[node], pi_values[node], counts[node]});
+    std::vector<std::vector<double>> batched;
+    policy.get_policies(inputs, batched);
+    ASSERT_EQ(batched.size(), inputs.size());
+    for (size_t node = 0; node < inputs.size(); node++) {
+        std::vector<double> single;
+        policy.get_policy(q_values[node], pi_values[node], counts[node], single);
+        EXPECT_EQ(single, batched[node]);
+        double sum = 0;
+        for (size_t i = 0; i < single.size(); i++) {
+            if (q_values[node][i] == MIN_FLOAT)
+                EXPECT_EQ(single[i], MIN_FLOAT);
+            else
+                sum += single[i];
+        }
+        EXPECT_NEAR(sum, 1.0, 1e-9);
+        // Newton converges in a few passes, where bisection needed around ten
+        auto iterations = policy.iterations(q_values[node], pi_values[node], counts[node]);
+        ASSERT_TRUE(iterations.has_value());
+        EXPECT_LE(*iterations, 6);
+    }
+}
+
+/* Selection at a node, as HTPS::select_tactic_generic does it: the policy is computed into the per-thread scratch
+ * buffers, a tactic is sampled with temperature and the virtual loss is added. Once the buffers have grown, none of it
+ * allocates, and neither does recomputing the value of a node that changed. */
+TEST_F(HTPSTest, TestSelectionDoesNotAllocate) {
+    std::vector<std::shared_ptr<tactic>> tactics;
+    std::vector<std::vector<TheoremPointer>> children;
+    std::vector<double> priors;
+    for (size_t i = 0; i < 24; i++) {
+        tactics.push_back(std::make_shared<DummyTactic>("tactic_" + std::to_string(i)));
+        children.push_back({std::make_shared<DummyTheorem>("child_" + std::to_string(i))});
+        priors.push_back(1.0 / 24);
+    }
+    Rng rng(0);
+    for (auto type: {PolicyType::AlphaZero, PolicyType::RPO}) {
+        for (double widening: {0.0, 2.0}) {
+            auto policy = std::make_shared<Policy>(type, 0.5);
+            HTPSNode node(root, tactics, children, policy, priors, 0.5, -0.5, QValueSolved::One, 0.0, {});
+            node.set_widening(widening, 0.5);
+            for (size_t i = 0; i < tactics.size(); i += 3)
+                node.update(i, -0.1 * static_cast<double>(i));
+            node.kill_tactic(4);
+            PolicyScratch &scratch = PolicyScratch::local();
+            auto select = [&] {
+                node.compute_policy(scratch.policy, scratch, true);
+                size_t tactic_id = sample_tactic(scratch.policy, 0.7, rng);
+                node.add_virtual_count(tactic_id, 1);
+                return tactic_id;
+            };
+            // The first calls grow the buffers
+            node.subtract_virtual_count(select(), 1);
+            node.get_value();
+            size_t cached_version = node.get_version();
+
+            allocation_count = 0;
+            count_allocations = true;
+            size_t first = select();
+            size_t second = select();
+            // The virtual counts changed the version, so the value is computed again
+            EXPECT_NE(node.get_version(), cached_version);
+            double value = node.get_value();
+            count_allocations = false;
+            EXPECT_EQ(allocation_count, 0) << "policy type " << type << ", widening " << widening;
+            EXPECT_NE(first, 4);
+            EXPECT_NE(second, 4);
+            EXPECT_LE(value, 0.0);
+            node.subtract_virtual_count(first, 1);
+            node.subtract_virtual_count(second, 1);
+
+            std::vector<double> result;
+            node.compute_policy(result, true);
+            EXPECT_EQ(result[4], widening > 0 ? 0.0 : MIN_FLOAT);
+        }
+    }
+}
+
+// Behaves like Policy, but is a subclass, so the search has to use the generic selection with virtual calls
+class OpaquePolicy : public Policy {
+public:
+    OpaquePolicy(PolicyType type, double exploration) : Policy(type, exploration) {}
+};
+
+/* Every goal has branching tactics with one child each, goals at depth three are solved by a single tactic.
+ * The priors are either uniform or decrease with the index of the tactic. */
+static std::shared_ptr<env_expansion> expand_tree(const TheoremPointer &thm, size_t branching, bool uniform_priors) {
+    const std::string &name = thm->conclusion;
+    size_t depth = std::count(name.begin(), name.end(), '.');
+    std::vector<std::shared_ptr<env_effect>> effects;
+    std::vector<std::shared_ptr<tactic>> tactics;
+    std::vector<std::vector<TheoremPointer>> children;
+    std::vector<double> priors;
+    size_t n = depth >= 3 ? 1 : branching;
+    for (size_t k = 0; k < n; k++) {
+        auto tac = std::make_shared<DummyTactic>(name + "_tac" + std::to_string(k));
+        std::vector<TheoremPointer> tactic_children;
+        if (depth < 3)
+            tactic_children.push_back(std::make_shared<DummyTheorem>(name + "." + std::to_string(k)));
+        auto effect = std::make_shared<env_effect>();
+        effect->goal = thm;
+        effect->tac = tac;
+        effect->children = tactic_children;
+        effects.push_back(effect);
+        tactics.push_back(tac);
+        children.push_back(tactic_children);
+        if (uniform_priors)
+            priors.push_back(1.0 / static_cast<double>(n));
+        else
+            priors.push_back(static_cast<double>(n - k) / static_cast<double>(n * (n + 1) / 2));
+    }
+    double critic = -0.1 * static_cast<double>(std::hash<std::string>{}(name) % 7);
+    std::vector<size_t> durations(n, 1);
+    TheoremPointer goal = thm;
+    return std::make_shared<env_expansion>(goal, 1, 1, durations, effects, critic, tactics, children, priors);
+}
+
+TEST_F(HTPSTest, TestSpecializedSelection) {
+    for (auto type: {PolicyType::AlphaZero, PolicyType::RPO}) {
+        for (double temperature: {0.0, 1.0}) {
+            for (auto q_value_solved: {QValueSolved::One, QValueSolved::CountOverCountsNoFPU}) {
+                std::vector<std::vector<std::string>> batches[2];
+                for (size_t opaque = 0; opaque < 2; opaque++) {
+                    dummyParams.policy_type = type;
+                    dummyParams.policy_temperature = temperature;
+                    dummyParams.q_value_solved = q_value_solved;
+                    dummyParams.num_expansions = 20;
+                    dummyParams.succ_expansions = 2;
+                    dummyParams.early_stopping = false;
+                    std::shared_ptr<Policy> policy;
+                    if (opaque)
+                        policy = std::make_shared<OpaquePolicy>(type, dummyParams.exploration);
+                    else
+                        policy = std::make_shared<Policy>(type, dummyParams.exploration);
+                    HTPS search(root, dummyParams, policy);
+                    search.set_seed(0);
+                    while (!search.is_done()) {
+                        auto theorems = search.theorems_to_expand();
+                        if (theorems.empty())
+                            break;
+                        std::vector<std::string> names;
+                        std::vector<std::shared_ptr<env_expansion>> expansions;
+                        for (const auto &thm: theorems) {
+                            names.push_back(thm->conclusion);
+                            expansions.push_back(expand_tree(thm, 3, false));
+                        }
+                        std::sort(names.begin(), names.end());
+                        batches[opaque].push_back(names);
+                        search.expand_and_backup(expansions);
+                    }
+                }
+                EXPECT_GT(batches[0].size(), 3);
+                EXPECT_EQ(batches[0], batches[1]) << "policy type " << type << ", temperature " << temperature
+                                                  << ", q value solved " << q_value_solved;
+            }
+        }
+    }
+}
+
+TEST_F(HTPSTest, TestSeedReproducibleAcrossThreads) {
+    /* Each descent only depends on its own random numbers and the virtual loss of the earlier waves, both are the same
+     * for every thread count. Batches of 12 descents span two waves. */
+    auto run = [&](size_t num_threads, uint64_t seed, size_t virtual_loss) {
+        dummyParams.policy_type = PolicyType::AlphaZero;
+        dummyParams.policy_temperature = 1.0;
+        dummyParams.virtual_loss = virtual_loss;
+        dummyParams.num_expansions = 60;
+        dummyParams.succ_expansions = 12;
+        dummyParams.early_stopping = false;
+        dummyParams.num_threads = num_threads;
+        HTPS search(root, dummyParams);
+        search.set_seed(seed);
+        std::vector<std::vector<std::string>> batches;
+        while (!search.is_done()) {
+            auto theorems = search.theorems_to_expand();
+            if (theorems.empty())
+                break;
+            std::vector<std::string> names;
+            std::vector<std::shared_ptr<env_expansion>> expansions;
+            for (const auto &thm: theorems) {
+                names.push_back(thm->conclusion);
+                expansions.push_back(expand_tree(thm, 3, false));
+            }
+            std::sort(names.begin(), names.end());
+            batches.push_back(names);
+            search.expand_and_backup(expansions);
+        }
+        return batches;
+    };
+    for (size_t virtual_loss: {0, 1}) {
+        auto sequential = run(1, 7, virtual_loss);
+        EXPECT_GT(sequential.size(), 3);
+        EXPECT_EQ(sequential, run(1, 7, virtual_loss)) << "virtual loss " << virtual_loss;
+        EXPECT_EQ(sequential, run(4, 7, virtual_loss)) << "virtual loss " << virtual_loss;
+        EXPECT_NE(sequential, run(1, 8, virtual_loss)) << "virtual loss " << virtual_loss;
+    }
+
+    // The generator state is part of the serialized search
+    HTPS search(root, dummyParams);
+    search.set_seed(3);
+    auto j = static_cast<nlohmann::json>(search);
+    EXPECT_EQ(j["seed"], 3);
+    EXPECT_EQ(static_cast<nlohmann::json>(HTPS::from_json(j))["rng"], j["rng"]);
+}
+
+// Counts how often the policy of a node is computed
+class CountingPolicy : public Policy {
+public:
+    mutable size_t evaluations = 0;
+
+    CountingPolicy() : Policy(PolicyType::RPO, 0.5) {}
+
+    void get_policy(std::span<const double> q_values, std::span<const double> pi_values,
+                    std::span<const size_t> counts, std::span<double> result) const override {
+        evaluations++;
+        Policy::get_policy(q_values, pi_values, counts, result);
+    }
+};
+
+TEST_F(HTPSTest, TestCachedPolicyAndValue) {
+    std::vector<std::shared_ptr<tactic>> tactics;
+    std::vector<std::vector<TheoremPointer>> children;
+    for (size_t i = 0; i < 5; i++) {
+        tactics.push_back(std::make_shared<DummyTactic>("tactic_" + std::to_string(i)));
+        children.push_back({std::make_shared<DummyTheorem>("child_" + std::to_string(i))});
+    }
+    auto policy = std::make_shared<CountingPolicy>();
+    std::shared_ptr<Policy> base_policy = policy;
+    HTPSNode node(root, tactics, children, base_policy, {0.1, 0.2, 0.3, 0.2, 0.2}, 0.5, -0.5, QValueSolved::One, 0.0,
+                  {});
+    node.update(0, -0.2);
+    node.update(2, -0.05);
+    // Every read has to agree with a fresh computation, which itself is not cached
+    auto expect_fresh = [&node, &policy]() {
+        size_t before = policy->evaluations;
+        auto fresh = node.compute_policy();
+        EXPECT_EQ(policy->evaluations, before + 1);
+        EXPECT_EQ(node.get_policy(), fresh);
+    };
+    expect_fresh();
+    size_t evaluations = policy->evaluations;
+    double value = node.get_value();
+    EXPECT_LE(value, 0.0);
+    node.get_policy();
+    node.get_critic_sample();
+    node.get_tactics_sample(Metric::SIZE, NodeMask::None, false);
+    EXPECT_EQ(node.get_value(), value);
+    EXPECT_EQ(policy->evaluations, evaluations);
+
+    // Every kind of change invalidates the cache
+    node.update(1, -0.01);
+    expect_fresh();
+    node.add_virtual_count(3, 2);
+    expect_fresh();
+    node.subtract_virtual_count(3, 2);
+    expect_fresh();
+    node.kill_tactic(2);
+    expect_fresh();
+    EXPECT_EQ(node.get_policy()[2], MIN_FLOAT);
+    node.update_batch(4, {-0.3, -0.4});
+    expect_fresh();
+    evaluations = policy->evaluations;
+    node.get_value();
+    EXPECT_EQ(policy->evaluations, evaluations);
+    node.solved_by(1);
+    EXPECT_EQ(node.get_value(), 0.0);
+}
+
+TEST_F(HTPSTest, TestSampleColumns) {
+    TheoremPointer b = std::make_shared<DummyTheorem>("B");
+    std::vector<HTPSSampleTactics> tactic_samples = {
+            HTPSSampleTactics(root, {dummyTac, dummyTac2}, {0.25, 0.75}, IsInProof, {0.5, 0.9}, 7),
+            HTPSSampleTactics(b, {dummyTac2}, {1.0}, NotInProof, {}, 2)};
+    std::vector<HTPSSampleCritic> critic_samples = {HTPSSampleCritic(b, 0.4, false, true, 0.3, 2)};
+    std::vector<HTPSSampleEffect> effect_samples = {HTPSSampleEffect(root, dummyTac, {b, root})};
+    HTPSResult result(critic_samples, tactic_samples, effect_samples, Metric::SIZE, {tactic_samples[0]}, root,
+                      std::nullopt);
+    SampleColumns columns(result);
+
+    EXPECT_EQ(columns.goals.strings, (std::vector<std::string>{root->unique_string, b->unique_string}));
+    EXPECT_EQ(columns.tactics.strings, (std::vector<std::string>{"dummy_tactic", "dummy_tactic2"}));
+    const auto &tactics = columns.tactic_samples;
+    EXPECT_EQ(tactics.size(), 2);
+    EXPECT_EQ(tactics.goal_ids, (std::vector<uint32_t>{0, 1}));
+    EXPECT_EQ(tactics.offsets, (std::vector<uint64_t>{0, 2, 3}));
+    EXPECT_EQ(tactics.tactic_ids, (std::vector<uint32_t>{0, 1, 1}));
+    EXPECT_EQ(tactics.target_pi, (std::vector<double>{0.25, 0.75, 1.0}));
+    EXPECT_EQ(tactics.q_estimates[1], 0.9);
+    EXPECT_TRUE(std::isnan(tactics.q_estimates[2]));
+    EXPECT_EQ(tactics.inproof, (std::vector<uint8_t>{IsInProof, NotInProof}));
+    EXPECT_EQ(tactics.visit_counts, (std::vector<uint64_t>{7, 2}));
+    EXPECT_EQ(columns.proof_samples.size(), 1);
+    EXPECT_EQ(columns.proof_samples.offsets, (std::vector<uint64_t>{0, 2}));
+
+    EXPECT_EQ(columns.critic_samples.goal_ids, (std::vector<uint32_t>{1}));
+    EXPECT_EQ(columns.critic_samples.bad, (std::vector<uint8_t>{1}));
+    EXPECT_EQ(columns.critic_samples.critic, (std::vector<double>{0.3}));
+
+    EXPECT_EQ(columns.effect_samples.tactic_ids, (std::vector<uint32_t>{0}));
+    EXPECT_EQ(columns.effect_samples.child_offsets, (std::vector<uint64_t>{0, 2}));
+    EXPECT_EQ(columns.effect_samples.child_ids, (std::vector<uint32_t>{1, 0}));
+}
+
+TEST_F(HTPSTest, TestIncrementalHarvest) {
+    for (auto mask: {NodeMask::None, NodeMask::MinimalProof}) {
+        dummyParams.node_mask = mask;
+        dummyParams.num_expansions = 40;
+        dummyParams.succ_expansions = 4;
+        dummyParams.early_stopping = false;
+        HTPS search(root, dummyParams);
+        // A later sample for a goal replaces the earlier ones
+        std::map<std::string, HTPSSampleCritic> critic;
+        std::map<std::string, HTPSSampleTactics> tactics;
+        std::multiset<std::string> effects;
+        auto collect = [&](HTPSResult result) {
+            for (auto &sample: result.take_critic_samples())
+                critic[sample.get_goal()->unique_string] = sample;
+            for (auto &sample: result.take_tactic_samples())
+                tactics[sample.get_goal()->unique_string] = sample;
+            for (auto &sample: result.take_effect_samples())
+                effects.insert(sample.get_goal()->unique_string + "/" + sample.get_tactic()->unique_string);
+        };
+        size_t during_search = 0;
+        while (!search.is_done()) {
+            auto theorems = search.theorems_to_expand();
+            if (theorems.empty())
+                break;
+            std::vector<std::shared_ptr<env_expansion>> expansions;
+            for (const auto &thm: theorems)
+                expansions.push_back(expand_tree(thm, 3, false));
+            search.expand_and_backup(expansions);
+            auto harvested = search.harvest();
+            EXPECT_FALSE(harvested.get_proof().has_value());
+            during_search += harvested.get_critic_samples().size() + harvested.get_tactic_samples().size();
+            collect(std::move(harvested));
+        }
+        EXPECT_GT(during_search, 0);
+        collect(search.get_result());
+
+        // Together, the harvests hold the same samples as a full extraction at the end
+        std::vector<HTPSSampleEffect> all_effects;
+        std::vector<HTPSSampleCritic> all_critic;
+        std::vector<HTPSSampleTactics> all_tactics;
+        search.get_train_samples(all_effects, all_critic, all_tactics);
+        std::multiset<std::string> expected_effects;
+        for (const auto &sample: all_effects)
+            expected_effects.insert(sample.get_goal()->unique_string + "/" + sample.get_tactic()->unique_string);
+        EXPECT_EQ(effects, expected_effects);
+        EXPECT_EQ(critic.size(), all_critic.size());
+        for (const auto &sample: all_critic) {
+            const auto &harvested = critic.at(sample.get_goal()->unique_string);
+            EXPECT_DOUBLE_EQ(harvested.get_q_estimate(), sample.get_q_estimate());
+            EXPECT_EQ(harvested.get_visit_count(), sample.get_visit_count());
+            EXPECT_EQ(harvested.is_solved(), sample.is_solved());
+        }
+        EXPECT_EQ(tactics.size(), all_tactics.size()) << "node mask " << mask;
+        for (const auto &sample: all_tactics) {
+            const auto &harvested = tactics.at(sample.get_goal()->unique_string);
+            EXPECT_EQ(harvested.get_target_pi(), sample.get_target_pi());
+            EXPECT_EQ(harvested.get_inproof(), sample.get_inproof());
+            EXPECT_EQ(harvested.get_visit_count(), sample.get_visit_count());
+        }
+
+        // Nothing changed since the final harvest
+        auto again = search.harvest();
+        EXPECT_TRUE(again.get_effect_samples().empty());
+        EXPECT_TRUE(again.get_critic_samples().empty());
+    }
+}
+
+TEST_F(HTPSTest, TestParallelSampleExtraction) {
+    // Eight tactics per goal, large enough for several chunks
+    dummyParams.node_mask = NodeMask::None;
+    dummyParams.count_threshold = 0;
+    dummyParams.num_expansions = 1000;
+    dummyParams.succ_expansions = 64;
+    dummyParams.early_stopping = false;
+    dummyParams.effect_subsampling_rate = 0.5;
+    dummyParams.critic_subsampling_rate = 0.5;
+    HTPS search(root, dummyParams);
+    while (!search.is_done()) {
+        auto theorems = search.theorems_to_expand();
+        if (theorems.empty())
+            break;
+        std::vector<std::shared_ptr<env_expansion>> expansions;
+        for (const auto &thm: theorems)
+            expansions.push_back(expand_tree(thm, 8, true));
+        search.expand_and_backup(expansions);
+    }
+
+    // The samples, including which ones are subsampled, are the same for every number of threads
+    using Samples = std::tuple<std::vector<std::string>, std::vector<std::string>, std::vector<std::string>, size_t>;
+    auto extract = [&](size_t num_threads) {
+        dummyParams.num_threads = num_threads;
+        search.set_params(dummyParams);
+        std::vector<HTPSSampleEffect> effects;
+        std::vector<HTPSSampleCritic> critic;
+        std::vector<HTPSSampleTactics> tactics;
+        search.get_train_samples(effects, critic, tactics);
+        std::vector<HTPSSampleTactics> proof_tactics;
+        search.get_proof_samples(proof_tactics);
+        Samples samples;
+        for (const auto &sample: effects)
+            std::get<0>(samples).push_back(sample.get_tactic()->unique_string);
+        for (const auto &sample: critic)
+            std::get<1>(samples).push_back(sample.get_goal()->unique_string + std::to_string(sample.get_q_estimate()));
+        for (const auto &sample: tactics)
+            std::get<2>(samples).push_back(sample.get_goal()->unique_string + std::to_string(sample.get_visit_count()));
+        std::get<3>(samples) = proof_tactics.size();
+        return samples;
+    };
+    auto sequential = extract(1);
+    // Every node has a tactic sample, and about half of the effects are kept
+    size_t n_nodes = std::get<2>(sequential).size();
+    ASSERT_GT(n_nodes, 2 * 256);
+    EXPECT_GT(std::get<0>(sequential).size(), 0);
+    EXPECT_LT(std::get<0>(sequential).size(), 8 * n_nodes * 3 / 4);
+    EXPECT_EQ(sequential, extract(4));
+    EXPECT_EQ(sequential, extract(3));
+}
+
+TEST_F(HTPSTest, TestShardRoundtrip) {
+    TheoremPointer b = std::make_shared<DummyTheorem>("B");
+    std::vector<HTPSSampleTactics> tactic_samples = {
+            HTPSSampleTactics(root, {dummyTac, dummyTac2}, {0.25, 0.75}, IsInProof, {0.5, 0.9}, 7)};
+    std::vector<HTPSSampleCritic> critic_samples = {HTPSSampleCritic(b, 0.4, false, true, 0.3, 2)};
+    std::vector<HTPSSampleEffect> effect_samples = {HTPSSampleEffect(root, dummyTac, {b})};
+    HTPSResult first(critic_samples, tactic_samples, effect_samples, Metric::SIZE, tactic_samples, root,
+                     std::nullopt);
+    HTPSResult second({}, {HTPSSampleTactics(b, {dummyTac2, dummyTac3}, {0.5, 0.5}, NotInProof, {}, 3)}, {},
+                      Metric::DEPTH, {}, b, std::nullopt);
+
+    auto path = (std::filesystem::temp_directory_path() / "htps_shard_test.bin").string();
+    {
+        ShardWriter writer(path);
+        writer.append(first);
+        writer.append(second);
+        EXPECT_EQ(writer.size(), 2);
+        // Without a footer, the shard is rejected
+        EXPECT_THROW(ShardReader{path}, std::runtime_error);
+        writer.close();
+        EXPECT_THROW(writer.append(first), std::runtime_error);
+    }
+    ShardReader reader(path);
+    ASSERT_EQ(reader.size(), 2);
+    // The string tables are shared by the records
+    EXPECT_EQ(reader.get_goals(), (std::vector<std::string>{root->unique_string, b->unique_string}));
+    EXPECT_EQ(reader.get_tactics(), (std::vector<std::string>{"dummy_tactic", "dummy_tactic2", "dummy_tactic3"}));
+    EXPECT_EQ(reader.get_goal_id(1), 1);
+    EXPECT_EQ(reader.get_metric(1), Metric::DEPTH);
+    EXPECT_FALSE(reader.is_proven(0));
+
+    auto offsets = reader.column<uint64_t>(0, "tactic_samples", "offsets");
+    EXPECT_EQ(std::vector<uint64_t>(offsets.begin(), offsets.end()), (std::vector<uint64_t>{0, 2}));
+    auto target_pi = reader.column<double>(0, "proof_samples", "target_pi");
+    EXPECT_EQ(std::vector<double>(target_pi.begin(), target_pi.end()), (std::vector<double>{0.25, 0.75}));
+    EXPECT_EQ(reader.column<uint8_t>(0, "critic_samples", "bad")[0], 1);
+    EXPECT_EQ(reader.column<uint32_t>(0, "effect_samples", "child_ids")[0], 1);
+    auto tactic_ids = reader.column<uint32_t>(1, "tactic_samples", "tactic_ids");
+    EXPECT_EQ(std::vector<uint32_t>(tactic_ids.begin(), tactic_ids.end()), (std::vector<uint32_t>{1, 2}));
+    EXPECT_TRUE(reader.column<uint32_t>(1, "critic_samples", "goal_ids").empty());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(tactic_ids.data()) % alignof(uint64_t), 0);
+    EXPECT_THROW(reader.column<double>(0, "tactic_samples", "offsets"), std::invalid_argument);
+    EXPECT_THROW(reader.get_metric(2), std::out_of_range);
+    std::filesystem::remove(path);
+}
+
+TEST_F(HTPSTest, TestBinarySnapshot) {
+    nlohmann::json value = {{"theorem", {{"conclusion", "A"}, {"hypotheses", {"h0", "h1"}}}},
+                            {"copy",    {{"conclusion", "A"}, {"hypotheses", {"h0", "h1"}}}},
+                            {"numbers", {0, -1, std::numeric_limits<int64_t>::min(),
+                                         std::numeric_limits<uint64_t>::max(), 0.25, nullptr, true}}};
+    auto encoded = snapshot::encode(value);
+    EXPECT_EQ(snapshot::decode(encoded), value);
+    EXPECT_THROW(snapshot::decode(encoded.substr(0, encoded.size() - 1)), std::runtime_error);
+    EXPECT_THROW(snapshot::decode("HTPSSHD1"), std::runtime_error);
+
+    auto j = load_json_from_file("../samples/search_6.json");
+    HTPS search = HTPS::from_json(j);
+    auto state = nlohmann::json(search);
+    auto binary = search.get_binary();
+    // Repeated theorems are only stored once
+    EXPECT_LT(binary.size() * 4, state.dump().size());
+    // The snapshot restores the same search as the JSON state it encodes
+    auto expected = nlohmann::json(HTPS::from_json(state));
+    EXPECT_EQ(nlohmann::json(HTPS::from_binary(binary)), expected);
+
+    auto path = (std::filesystem::temp_directory_path() / "htps_snapshot_test.bin").string();
+    search.save_binary(path);
+    EXPECT_EQ(nlohmann::json(HTPS::load_binary(path)), expected);
+    std::filesystem::remove(path);
+}
+
+/* Simulations waiting for an expansion are referenced by id in the JSON, so a search restored while awaiting
+ * expansions can still back them up.
+ */
+TEST_F(HTPSTest, TestJsonPendingSimulations) {
+    htps_instance->set_params(dummyParams);
+    htps_instance->theorems_to_expand();
+
+    // Expands thm with a single tactic leading to children
+    auto expand = [](HTPS &search, TheoremPointer thm, std::shared_ptr<htps::tactic> tac,
+                     std::vector<TheoremPointer> children) {
+        auto effect = std::make_shared<htps::env_effect>();
+        effect->goal = thm;
+        effect->tac = tac;
+        effect->children = children;
+        std::vector<size_t> durations = {1};
+        std::vector<std::shared_ptr<htps::env_effect>> effects = {effect};
+        std::vector<std::shared_ptr<htps::tactic>> tactics = {tac};
+        std::vector<std::vector<TheoremPointer>> children_for_tactic = {children};
+        std::vector<double> priors = {1.0};
+        std::vector<std::shared_ptr<htps::env_expansion>> expansions = {std::make_shared<htps::env_expansion>(
+                thm, 1, 1, durations, effects, 0.0, tactics, children_for_tactic, priors)};
+        search.expand_and_backup(expansions);
+    };
+
+    TheoremPointer child = std::make_shared<DummyTheorem>("B1");
+    expand(*htps_instance, root, dummyTac, {child});
+    ASSERT_EQ(htps_instance->theorems_to_expand().size(), 1);
+
+    auto j = nlohmann::json(*htps_instance);
+    // Every pending simulation waits for the child
+    auto pending = j["simulations_for_theorem"][child->unique_string];
+    ASSERT_EQ(pending.size(), j["simulations"].size());
+    for (size_t i = 0; i < pending.size(); i++) {
+        EXPECT_EQ(pending[i][0], j["simulations"][i]["id"]);
+    }
+
+    HTPS restored = HTPS::from_json(j);
+    EXPECT_EQ(nlohmann::json(restored)["simulations_for_theorem"], j["simulations_for_theorem"]);
+    expand(restored, child, dummyTac2, {});
+    restored.theorems_to_expand();
+    EXPECT_TRUE(restored.is_proven());
+
+    j["simulations_for_theorem"][child->unique_string][0][0] = pending.size();
+    EXPECT_THROW(HTPS::from_json(j), std::runtime_error);
+}
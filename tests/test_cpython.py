@@ -1,3 +1,6 @@
+import json
+import time
+
 import pytest
 
 from htps import *
@@ -381,6 +384,83 @@ def test_result():
     _compare_theorem(result.goal, goal)
     _compare_theorem(result.proof.theorem, proof_obj.theorem)
 
+def test_result_columns():
+    context = Context(["∧", "", " "])
+    tactics = [Tactic("tac1", True, 5), Tactic("tac2", True, 1)]
+    goal = Theorem("goal_conclusion", "goal_unique", [], context, tactics)
+    child = Theorem("child_conclusion", "child_unique", [], context, [])
+    result = Result(
+        critic_samples=[SampleCritic(child, 0.8, True, False, 0.3, 42)],
+        tactic_samples=[SampleTactics(goal, tactics, [0.6, 0.4], InProof.InProof, [0.7, 0.2], 100),
+                        SampleTactics(child, tactics[1:], [1.0], InProof.NotInProof, [], 3)],
+        effect_samples=[SampleEffect(goal, tactics[0], [child])],
+        metric=Metric.Depth,
+        proof_samples_tactics=[],
+        goal=goal,
+        proof=Proof(theorem=goal, tactic=tactics[0], children=[])
+    )
+    columns = result.columns()
+    assert columns["goals"] == ["goal_unique", "child_unique"]
+    assert columns["tactics"] == ["tac1", "tac2"]
+    tactic_samples = columns["tactic_samples"]
+    offsets = memoryview(tactic_samples["offsets"])
+    assert offsets.format == "Q" and offsets.readonly
+    assert offsets.tolist() == [0, 2, 3]
+    assert memoryview(tactic_samples["goal_ids"]).tolist() == [0, 1]
+    assert memoryview(tactic_samples["tactic_ids"]).tolist() == [0, 1, 1]
+    assert memoryview(tactic_samples["target_pi"]).tolist() == pytest.approx([0.6, 0.4, 1.0])
+    q_estimates = memoryview(tactic_samples["q_estimates"]).tolist()
+    assert q_estimates[:2] == pytest.approx([0.7, 0.2]) and q_estimates[2] != q_estimates[2]
+    assert memoryview(tactic_samples["inproof"]).tolist() == [InProof.InProof.value, InProof.NotInProof.value]
+    assert memoryview(tactic_samples["visit_counts"]).tolist() == [100, 3]
+    assert len(memoryview(columns["proof_samples"]["goal_ids"])) == 0
+    assert memoryview(columns["critic_samples"]["solved"]).tolist() == [1]
+    assert memoryview(columns["effect_samples"]["child_ids"]).tolist() == [1]
+    # The buffers keep the columns alive after the result is gone
+    del result
+    assert memoryview(tactic_samples["visit_counts"]).tolist() == [100, 3]
+
+
+def test_shard(tmp_path):
+    context = Context(["∧", "", " "])
+    tactics = [Tactic("tac1", True, 5), Tactic("tac2", True, 1)]
+    goal = Theorem("goal_conclusion", "goal_unique", [], context, tactics)
+    child = Theorem("child_conclusion", "child_unique", [], context, [])
+    results = [Result(critic_samples=[SampleCritic(goal, 0.8, True, False, 0.3, 42)],
+                      tactic_samples=[SampleTactics(goal, tactics, [0.6, 0.4], InProof.InProof, [0.7, 0.2], 100)],
+                      effect_samples=[SampleEffect(goal, tactics[0], [child])], metric=Metric.Depth,
+                      proof_samples_tactics=[], goal=goal, proof=Proof(theorem=goal, tactic=tactics[0], children=[])),
+               Result(critic_samples=[], tactic_samples=[SampleTactics(child, tactics[1:], [1.0], InProof.NotInProof, [], 3)],
+                      effect_samples=[], metric=Metric.Size, proof_samples_tactics=[], goal=child,
+                      proof=Proof(theorem=child, tactic=tactics[1], children=[]))]
+    path = str(tmp_path / "samples.shard")
+    with ShardWriter(path) as writer:
+        for result in results:
+            writer.append(result)
+        assert writer.size() == 2
+    with pytest.raises(RuntimeError):
+        writer.append(results[0])
+    reader = ShardReader(path)
+    assert reader.size() == 2
+    assert reader.goals() == ["goal_unique", "child_unique"]
+    assert reader.tactics() == ["tac1", "tac2"]
+    record = reader.record(1)
+    assert record["goal"] == 1 and record["metric"] == Metric.Size
+    assert memoryview(record["tactic_samples"]["tactic_ids"]).tolist() == [1]
+    assert memoryview(record["tactic_samples"]["visit_counts"]).tolist() == [3]
+    first = reader.record(0)
+    assert memoryview(first["critic_samples"]["visit_counts"]).tolist() == [42]
+    assert memoryview(first["effect_samples"]["child_ids"]).tolist() == [1]
+    # The columns view the mapped file, which stays mapped while they are alive
+    target_pi = first["tactic_samples"]["target_pi"]
+    del reader, first
+    assert memoryview(target_pi).tolist() == pytest.approx([0.6, 0.4])
+    with pytest.raises(IndexError):
+        ShardReader(path).record(2)
+    with pytest.raises(RuntimeError):
+        ShardReader(str(tmp_path / "missing.shard"))
+
+
 def test_htps_basic():
     context = Context([])
     hypotheses = []
@@ -529,6 +609,8 @@ def test_metadata_garbage_collection():
                           node_mask=NodeMask.NoMask, effect_subsampling_rate=1.0, critic_subsampling_rate=1.0,
                           early_stopping_solved_if_root_not_proven=True, virtual_loss=0)
     search = HTPS(root_thm, params)
+    # Both tactics lead to the same goal with different metadata, the seed fixes which of them is sampled
+    search.set_seed(2)
     theorems = search.theorems_to_expand()
     assert len(theorems) == 1
     _compare_theorem(theorems[0], root_thm)
@@ -601,3 +683,231 @@ def test_result_json():
     # No proof
     assert not search.is_done()
     assert not result.proof
+
+
+def test_binary_snapshot(tmp_path):
+    with open("samples/test.json", "r") as file:
+        search = HTPS.from_json_str(file.read())
+    data = search.get_binary()
+    assert isinstance(data, bytes)
+    assert len(data) < len(search.get_json_str())
+    # Restores the same search as the JSON state it encodes
+    expected = json.loads(HTPS.from_json_str(search.get_json_str()).get_json_str())
+    assert json.loads(HTPS.from_binary(data).get_json_str()) == expected
+
+    path = str(tmp_path / "search.bin")
+    search.save_binary(path)
+    assert json.loads(HTPS.load_binary(path).get_json_str()) == expected
+    with pytest.raises(RuntimeError):
+        HTPS.from_binary(data[:-1])
+
+
+def _solving_expansion(theorem):
+    tactic = Tactic("solve", True, 1)
+    effects = [EnvEffect(theorem, tactic, [])]
+    return EnvExpansion(theorem, 1, 1, [1], effects, 0.0, tactics=[tactic], children_for_tactic=[[]], priors=[1.0])
+
+
+def test_search_engine():
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    theorem.metadata = {"key": "value"}
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    with pytest.raises(RuntimeError):
+        SearchEngine(theorem, params, queue_capacity=1, max_batches_in_flight=2)
+    engine = SearchEngine(theorem, params)
+    engine.start()
+    with pytest.raises(RuntimeError):
+        engine.start()
+    while (theorems := engine.get_theorems()) is not None:
+        expansions = []
+        for thm in theorems:
+            if thm.unique_string == "A":
+                assert thm.metadata == {"key": "value"}
+                expansions.append(_create_expansion(thm))
+            else:
+                expansions.append(_solving_expansion(thm))
+        assert engine.submit(expansions)
+    result = engine.get_result()
+    assert result is not None
+    assert result.proof is not None
+    _compare_theorem(result.goal, theorem)
+    assert not engine.is_running()
+
+
+def test_search_engine_stop():
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    engine = SearchEngine(theorem, params)
+    engine.start()
+    theorems = engine.get_theorems()
+    assert len(theorems) == 1
+    engine.stop()
+    assert not engine.is_running()
+    assert engine.get_result() is None
+    assert not engine.submit([_create_expansion(theorems[0])])
+
+
+def test_async_expansions():
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    assert not params.async_expansions
+    search = HTPS(theorem, params)
+    search.theorems_to_expand()
+    with pytest.raises(RuntimeError):
+        search.theorems_to_expand()
+
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1, async_expansions=True)
+    assert params.async_expansions
+    search = HTPS(theorem, params)
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    first = search.theorems_to_expand()
+    assert len(first) > 0
+    # The second batch is selected while the first one is still outstanding
+    second = search.theorems_to_expand()
+    assert all(thm.unique_string != other.unique_string for thm in second for other in first)
+    search.expand_and_backup([_solving_expansion(thm) for thm in first + second])
+    assert search.proven()
+    assert not search.is_expanding()
+
+
+def test_scheduler():
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    scheduler = Scheduler(max_batch_size=16)
+    ids = [scheduler.add_search(Theorem(name, unique_string=name, hypotheses=[], context=Context([]), past_tactics=[]), params) for name in ["A", "A", "D"]]
+    assert scheduler.num_searches() == 3
+    theorems = scheduler.theorems_to_expand()
+    # The shared root is only expanded once
+    assert sorted(thm.unique_string for thm in theorems) == ["A", "D"]
+    scheduler.expand_and_backup([_solving_expansion(thm) for thm in theorems])
+    with pytest.raises(RuntimeError):
+        scheduler.expand_and_backup([_solving_expansion(theorems[0])])
+    results = scheduler.take_results()
+    assert sorted(search_id for search_id, _ in results) == ids
+    assert all(result.proof is not None for _, result in results)
+    assert scheduler.is_done()
+    assert not scheduler.is_expanding()
+
+
+def test_move_root():
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    search = HTPS(theorem, params)
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    theorems = search.theorems_to_expand()
+    assert [thm.unique_string for thm in theorems] == ["B"]
+    with pytest.raises(RuntimeError):
+        search.move_root(theorems[0])
+    search.expand_and_backup([_solving_expansion(theorems[0])])
+    assert search.expansions == 2
+    with pytest.raises(RuntimeError):
+        search.move_root(Theorem("X", unique_string="X", hypotheses=[], context=Context([]), past_tactics=[]))
+    search.move_root(theorems[0])
+    assert search.expansions == 1
+    assert search.proven()
+    result = search.get_result()
+    assert result.goal.unique_string == "B"
+    assert result.proof is not None
+
+
+def test_harvest():
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 0, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    search = HTPS(theorem, params)
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    harvested = search.harvest()
+    assert harvested.proof is None
+    assert sorted(sample.tactic.unique_string for sample in harvested.effect_samples) == ["TACA", "TACB"]
+    assert [sample.goal.unique_string for sample in harvested.critic_samples] == ["A"]
+    # Nothing changed since the last harvest
+    assert search.harvest().effect_samples == []
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_solving_expansion(theorems[0])])
+    assert search.proven()
+    result = search.get_result()
+    assert result.proof is not None
+    # Only the new node contributes effects, the critic samples of both nodes changed
+    assert [sample.goal.unique_string for sample in result.effect_samples] == ["B"]
+    assert sorted(sample.goal.unique_string for sample in result.critic_samples) == ["A", "B"]
+
+
+def test_restore_pending_simulations():
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    search = HTPS(theorem, params)
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    theorems = search.theorems_to_expand()
+    # The restored searches still know which simulations wait for the expansion
+    for restored in [HTPS.from_json_str(search.get_json_str()), HTPS.from_binary(search.get_binary())]:
+        restored.expand_and_backup([_solving_expansion(theorems[0])])
+        assert restored.proven()
+
+
+def test_set_seed():
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    states = []
+    for seed in [5, 5, 6]:
+        search = HTPS(Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[]), params)
+        search.set_seed(seed)
+        search.theorems_to_expand()
+        states.append(json.loads(search.get_json_str())["rng"])
+    assert states[0] == states[1]
+    assert states[0] != states[2]
+
+
+def test_expansion_cache(tmp_path):
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    path = str(tmp_path / "cache.bin")
+    cache = ExpansionCache(16, path)
+    theorem = Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[])
+    search = HTPS(theorem, params)
+    search.set_expansion_cache(cache)
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_solving_expansion(theorems[0])])
+    assert search.proven()
+    assert cache.size() == 2
+
+    reopened = ExpansionCache(16, path)
+    other = HTPS(Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[]), params)
+    other.set_expansion_cache(reopened)
+    assert other.theorems_to_expand() == []
+    assert other.proven()
+    assert reopened.hits() == 2
+    assert other.get_result().proof is not None
+    with pytest.raises(ValueError):
+        ExpansionCache(0)
+
+
+def test_time_budget():
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    assert params.time_budget_ms == 0
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, False, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1, time_budget_ms=5)
+    assert params.time_budget_ms == 5
+    search = HTPS(Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[]), params)
+    theorems = search.theorems_to_expand()
+    assert len(theorems) == 1
+    time.sleep(0.01)
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    # The deadline passed while the batch was expanded
+    assert search.is_done()
+    assert search.theorems_to_expand() == []
+
+
+def test_progressive_widening():
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1)
+    assert params.widening_constant == 0.0
+    assert params.widening_exponent == 0.5
+    params = SearchParams(0.3, PolicyType.RPO, 10, 3, True, True, True, True, 0.99, 10, True, True, True, 0.0, QValueSolved.One, 0.7, Metric.Time, NodeMask.NoMask, 1.0, 1.0, True, 1, widening_constant=1.0, widening_exponent=0.7)
+    assert params.widening_constant == 1.0
+    assert params.widening_exponent == 0.7
+    search = HTPS(Theorem("A", unique_string="A", hypotheses=[], context=Context([]), past_tactics=[]), params)
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_create_expansion(theorems[0])])
+    theorems = search.theorems_to_expand()
+    search.expand_and_backup([_solving_expansion(thm) for thm in theorems])
+    assert search.proven()